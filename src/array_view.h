@@ -0,0 +1,36 @@
+#ifndef ARRAY_VIEW_H
+#define ARRAY_VIEW_H
+
+#include <cstddef>
+
+// Read-only view of a contiguous array the view does not own: a vector
+// owned by a tree, or a section of a memory-mapped file
+template <typename T>
+class ArrayView {
+public:
+    using value_type = T;
+    using const_iterator = const T*;
+
+    ArrayView() = default;
+    ArrayView(const T* data, size_t size) : ptr(data), count(size) {}
+
+    template <typename Container>
+    explicit ArrayView(const Container& container) : ptr(container.data()), count(container.size()) {}
+
+    const T* data() const { return ptr; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    const T& operator[](size_t i) const { return ptr[i]; }
+    const T& front() const { return ptr[0]; }
+    const T& back() const { return ptr[count - 1]; }
+
+    const T* begin() const { return ptr; }
+    const T* end() const { return ptr + count; }
+
+private:
+    const T* ptr = nullptr;
+    size_t count = 0;
+};
+
+#endif // ARRAY_VIEW_H
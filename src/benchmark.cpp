@@ -0,0 +1,635 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <optional>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <thread>
+#include <memory>
+#include <cstdio>
+#include <cmath>
+#include <type_traits>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "point.h"
+#include "octree.h"
+#include "octree_instrumentation.h"
+#include "point_generators.h"
+
+// Sweeps tree types, point counts, distributions, leaf sizes and thread
+// counts, and reports build time, query latency percentiles, throughput and
+// memory for every combination as a table, CSV or JSON.
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchmarkConfig {
+    std::vector<std::string> trees = {"classic", "hashmap", "morton", "linear"};
+    std::vector<int> sizes = {100000};
+    std::vector<std::string> distributions = {"random", "grid", "spiral"};
+    std::vector<uint32_t> leafSizes = {8};
+    std::vector<size_t> threads = {1};
+    int maxDepth = 20;
+    size_t queries = 1000;
+    size_t k = 10;
+    // Range query box edge as a fraction of the bounds
+    float rangeFraction = 0.05f;
+    int repeats = 3;
+    unsigned seed = 42;
+    std::string format = "table";
+    std::string output;
+    // Chrome trace of the build and query scopes; needs OCTREE_INSTRUMENTATION
+    std::string traceFile;
+};
+
+// Latency distribution of one query type, in microseconds
+struct LatencyStats {
+    double p50 = 0, p90 = 0, p99 = 0, max = 0, mean = 0;
+    // Queries per second over all threads
+    double throughput = 0;
+    // Average result size
+    double averageResults = 0;
+};
+
+// Everything runTree measures. Trivially copyable, so a child process can
+// send it back through a pipe as raw bytes.
+struct BenchmarkMeasurements {
+    size_t points = 0;
+    // Range and kNN queries per run
+    size_t queries = 0;
+    uint32_t leafSize = 0;
+    size_t threads = 1;
+    double buildMs = 0;
+    double buildPointsPerSecond = 0;
+    LatencyStats range;
+    LatencyStats knn;
+    // Resident set growth across the first build, and the peak resident set
+    // of the process the configuration ran in
+    size_t rssGrowthBytes = 0;
+    size_t peakRssBytes = 0;
+    // The tree's own accounting of its footprint, see getMemoryStatistics()
+    size_t treeBytes = 0;
+    double bytesPerPoint = 0;
+    // Instrumentation counters of the last build and of each query set;
+    // zero unless built with OCTREE_INSTRUMENTATION
+    OctreeCounters buildCounters;
+    OctreeCounters rangeCounters;
+    OctreeCounters knnCounters;
+};
+
+static_assert(std::is_trivially_copyable_v<BenchmarkMeasurements>, "measurements are sent as raw bytes");
+
+struct BenchmarkResult : BenchmarkMeasurements {
+    std::string tree;
+    std::string distribution;
+};
+
+// Current resident set size in bytes, 0 if unknown
+size_t currentRss() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return counters.WorkingSetSize;
+    return 0;
+#else
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    if (statm >> pages >> resident) return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return 0;
+#endif
+}
+
+// Peak resident set size of the process in bytes
+size_t peakRss() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return counters.PeakWorkingSetSize;
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss);
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+double elapsedMs(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// Nearest-rank percentile of sorted latencies
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+    return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+static const char* OUT_OF_CORE_FILE = "octree_benchmark.oct";
+
+// Runs count queries split over threads, timing each one; query(i) returns its result size
+template <typename Query>
+LatencyStats measureQueries(size_t count, size_t threads, Query&& query) {
+    threads = std::max<size_t>(1, std::min(threads, count));
+    std::vector<std::vector<double>> latencies(threads);
+    std::vector<size_t> resultCounts(threads, 0);
+
+    auto worker = [&](size_t t) {
+        for (size_t i = t; i < count; i += threads) {
+            auto start = Clock::now();
+            size_t results = query(i);
+            latencies[t].push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+            resultCounts[t] += results;
+        }
+    };
+
+    auto start = Clock::now();
+    if (threads == 1) {
+        worker(0);
+    } else {
+        std::vector<std::thread> pool;
+        for (size_t t = 0; t < threads; ++t) pool.emplace_back(worker, t);
+        for (auto& thread : pool) thread.join();
+    }
+    double seconds = elapsedMs(start) / 1000.0;
+
+    std::vector<double> all;
+    size_t totalResults = 0;
+    for (size_t t = 0; t < threads; ++t) {
+        all.insert(all.end(), latencies[t].begin(), latencies[t].end());
+        totalResults += resultCounts[t];
+    }
+    std::sort(all.begin(), all.end());
+
+    LatencyStats stats;
+    if (all.empty()) return stats;
+    stats.p50 = percentile(all, 50);
+    stats.p90 = percentile(all, 90);
+    stats.p99 = percentile(all, 99);
+    stats.max = all.back();
+    double sum = 0;
+    for (double v : all) sum += v;
+    stats.mean = sum / all.size();
+    stats.throughput = seconds > 0 ? all.size() / seconds : 0;
+    stats.averageResults = static_cast<double>(totalResults) / all.size();
+    return stats;
+}
+
+// Builds and measures the named tree into result; false, with a message,
+// for an unknown name or a failed build
+bool runTree(const std::string& name, const BenchmarkConfig& config, const std::vector<Point>& points,
+             const Point& min, const Point& max, uint32_t leafSize, size_t threads,
+             const std::vector<Point>& queryMins, const std::vector<Point>& queryMaxs,
+             const std::vector<Point>& knnQueries, BenchmarkResult& result) {
+    result = BenchmarkResult();
+    result.points = points.size();
+    result.queries = config.queries;
+    result.leafSize = leafSize;
+    result.threads = threads;
+
+    OctreeOptions options{leafSize, config.maxDepth};
+    std::vector<double> buildTimes;
+    std::optional<Octree> tree;
+    size_t queryThreads = threads == 0 ? std::max(1u, std::thread::hardware_concurrency()) : threads;
+    for (int r = 0; r < std::max(1, config.repeats); ++r) {
+        // Free the previous tree first so every build starts from the same heap
+        tree.reset();
+        size_t rssBefore = currentRss();
+        OctreeCounters beforeBuild = OctreeInstrumentation::snapshot();
+        auto start = Clock::now();
+        tree = Octree::create(name, min, max, options);
+        if (!tree) {
+            std::cerr << "Invalid tree type: " << name << std::endl;
+            return false;
+        }
+        tree->setPageFile(OUT_OF_CORE_FILE);
+        if (!tree->build(points, threads)) {
+            std::cerr << "Error: building the " << name << " octree failed" << std::endl;
+            return false;
+        }
+        buildTimes.push_back(elapsedMs(start));
+        result.buildCounters = OctreeInstrumentation::snapshot() - beforeBuild;
+        if (r == 0) {
+            size_t rssAfter = currentRss();
+            result.rssGrowthBytes = rssAfter > rssBefore ? rssAfter - rssBefore : 0;
+        }
+    }
+    std::sort(buildTimes.begin(), buildTimes.end());
+    result.buildMs = buildTimes[buildTimes.size() / 2];
+    result.buildPointsPerSecond = result.buildMs > 0 ? points.size() / (result.buildMs / 1000.0) : 0;
+
+    const Octree& built = *tree;
+    OctreeMemoryStats memory = built.getMemoryStatistics();
+    result.treeBytes = memory.totalBytes();
+    result.bytesPerPoint = memory.bytesPerPoint();
+    // Inside visitTree the timed calls go straight to the concrete tree
+    built.visitTree([&](const auto& concrete) {
+        OctreeCounters before = OctreeInstrumentation::snapshot();
+        result.range = measureQueries(queryMins.size(), queryThreads, [&](size_t i) {
+            return concrete.rangeQuery(queryMins[i], queryMaxs[i]).size();
+        });
+        OctreeCounters afterRange = OctreeInstrumentation::snapshot();
+        result.knn = measureQueries(knnQueries.size(), queryThreads, [&](size_t i) {
+            return concrete.knn(knnQueries[i], config.k).size();
+        });
+        result.rangeCounters = afterRange - before;
+        result.knnCounters = OctreeInstrumentation::snapshot() - afterRange;
+    });
+    result.peakRssBytes = peakRss();
+
+    tree.reset();
+    if (name == "outofcore") std::remove(OUT_OF_CORE_FILE);
+    return true;
+}
+
+#ifndef _WIN32
+// runTree in a forked child, so that the peak RSS and RSS growth it reports
+// belong to this configuration alone: the child's peak starts from the
+// parent's current resident set, and no earlier tree's freed memory is
+// reused. The measurements come back through a pipe.
+bool runTreeIsolated(const std::string& name, const BenchmarkConfig& config, const std::vector<Point>& points,
+                     const Point& min, const Point& max, uint32_t leafSize, size_t threads,
+                     const std::vector<Point>& queryMins, const std::vector<Point>& queryMaxs,
+                     const std::vector<Point>& knnQueries, BenchmarkResult& result) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        std::cerr << "Error: Could not create a pipe for the benchmark process" << std::endl;
+        return false;
+    }
+    // Nothing buffered may be written twice
+    std::cout.flush();
+    std::cerr.flush();
+    std::fflush(nullptr);
+    pid_t pid = fork();
+    if (pid < 0) {
+        std::cerr << "Error: Could not start the benchmark process" << std::endl;
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+
+    if (pid == 0) {
+        close(fds[0]);
+        BenchmarkResult measured;
+        bool ok = runTree(name, config, points, min, max, leafSize, threads, queryMins, queryMaxs, knnQueries,
+                          measured);
+        const BenchmarkMeasurements& measurements = measured;
+        const char* bytes = reinterpret_cast<const char*>(&measurements);
+        for (size_t sent = 0; ok && sent < sizeof(measurements);) {
+            ssize_t n = write(fds[1], bytes + sent, sizeof(measurements) - sent);
+            if (n <= 0) ok = false;
+            else sent += static_cast<size_t>(n);
+        }
+        // Skip exit handlers and stream flushes, which belong to the parent
+        _exit(ok ? 0 : 1);
+    }
+
+    close(fds[1]);
+    result = BenchmarkResult();
+    BenchmarkMeasurements& measurements = result;
+    char* bytes = reinterpret_cast<char*>(&measurements);
+    size_t received = 0;
+    while (received < sizeof(measurements)) {
+        ssize_t n = read(fds[0], bytes + received, sizeof(measurements) - received);
+        if (n <= 0) break;
+        received += static_cast<size_t>(n);
+    }
+    close(fds[0]);
+    int status = 0;
+    bool exited = waitpid(pid, &status, 0) == pid && WIFEXITED(status);
+    // A failing runTree has printed why; a crash has not
+    if (!exited) {
+        std::cerr << "Error: the benchmark process for the " << name << " octree did not finish" << std::endl;
+    }
+    return exited && WEXITSTATUS(status) == 0 && received == sizeof(measurements);
+}
+#endif
+
+std::vector<Point> generatePoints(const std::string& distribution, int numPoints, const Point& min,
+                                  const Point& max, unsigned seed) {
+    if (distribution == "random") return generateRandomPoints(numPoints, min, max, seed);
+    if (distribution == "grid") {
+        // Same rounding as the example program: the largest cube with at most numPoints points
+        int pointsPerSide = static_cast<int>(std::cbrt(static_cast<double>(numPoints)) + 1e-9);
+        return generateGridPoints(std::max(pointsPerSide, 2), min, max);
+    }
+    if (distribution == "spiral") return generateSpiralPoints(numPoints, min, max);
+    return {};
+}
+
+const char* CSV_HEADER =
+    "tree,distribution,points,leaf_size,threads,build_ms,build_points_per_s,"
+    "range_p50_us,range_p90_us,range_p99_us,range_max_us,range_mean_us,range_qps,range_avg_results,"
+    "knn_p50_us,knn_p90_us,knn_p99_us,knn_max_us,knn_mean_us,knn_qps,"
+    "rss_growth_bytes,peak_rss_bytes,tree_bytes,bytes_per_point";
+
+// Extra columns of an instrumented build: per-query work and pruning
+const char* CSV_COUNTER_HEADER =
+    ",range_nodes_per_query,range_points_tested_per_query,range_match_ratio,"
+    "knn_nodes_per_query,knn_points_tested_per_query";
+
+// Average of one counter over a query set
+double perQuery(const OctreeCounters& counters, OctreeCounter counter, size_t queries) {
+    return queries > 0 ? static_cast<double>(counters[counter]) / queries : 0.0;
+}
+
+void writeCsvRow(std::ostream& out, const BenchmarkResult& r) {
+    out << r.tree << ',' << r.distribution << ',' << r.points << ',' << r.leafSize << ',' << r.threads << ','
+        << r.buildMs << ',' << r.buildPointsPerSecond << ','
+        << r.range.p50 << ',' << r.range.p90 << ',' << r.range.p99 << ',' << r.range.max << ','
+        << r.range.mean << ',' << r.range.throughput << ',' << r.range.averageResults << ','
+        << r.knn.p50 << ',' << r.knn.p90 << ',' << r.knn.p99 << ',' << r.knn.max << ','
+        << r.knn.mean << ',' << r.knn.throughput << ','
+        << r.rssGrowthBytes << ',' << r.peakRssBytes << ',' << r.treeBytes << ',' << r.bytesPerPoint;
+    if constexpr (OctreeInstrumentation::enabled) {
+        out << ',' << perQuery(r.rangeCounters, OctreeCounter::NodesVisited, r.queries)
+            << ',' << perQuery(r.rangeCounters, OctreeCounter::PointsTested, r.queries)
+            << ',' << r.rangeCounters.matchRatio()
+            << ',' << perQuery(r.knnCounters, OctreeCounter::NodesVisited, r.queries)
+            << ',' << perQuery(r.knnCounters, OctreeCounter::PointsTested, r.queries);
+    }
+    out << '\n';
+}
+
+void writeJsonLatency(std::ostream& out, const char* name, const LatencyStats& s, bool withResults) {
+    out << "\"" << name << "\": {\"p50_us\": " << s.p50 << ", \"p90_us\": " << s.p90 << ", \"p99_us\": " << s.p99
+        << ", \"max_us\": " << s.max << ", \"mean_us\": " << s.mean << ", \"qps\": " << s.throughput;
+    if (withResults) out << ", \"avg_results\": " << s.averageResults;
+    out << "}";
+}
+
+void writeJson(std::ostream& out, const std::vector<BenchmarkResult>& results) {
+    out << "[\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchmarkResult& r = results[i];
+        out << "  {\"tree\": \"" << r.tree << "\", \"distribution\": \"" << r.distribution
+            << "\", \"points\": " << r.points << ", \"leaf_size\": " << r.leafSize << ", \"threads\": " << r.threads
+            << ", \"build_ms\": " << r.buildMs << ", \"build_points_per_s\": " << r.buildPointsPerSecond << ", ";
+        writeJsonLatency(out, "range", r.range, true);
+        out << ", ";
+        writeJsonLatency(out, "knn", r.knn, false);
+        out << ", \"rss_growth_bytes\": " << r.rssGrowthBytes << ", \"peak_rss_bytes\": " << r.peakRssBytes
+            << ", \"tree_bytes\": " << r.treeBytes << ", \"bytes_per_point\": " << r.bytesPerPoint;
+        if constexpr (OctreeInstrumentation::enabled) {
+            out << ", \"counters\": {\"build\": ";
+            r.buildCounters.writeJson(out);
+            out << ", \"range\": ";
+            r.rangeCounters.writeJson(out);
+            out << ", \"knn\": ";
+            r.knnCounters.writeJson(out);
+            out << "}";
+        }
+        out << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "]\n";
+}
+
+void writeTableHeader(std::ostream& out) {
+    out << std::left << std::setw(16) << "tree" << std::setw(8) << "dist" << std::right << std::setw(10) << "points"
+        << std::setw(6) << "leaf" << std::setw(5) << "thr" << std::setw(11) << "build ms"
+        << std::setw(11) << "range p50" << std::setw(11) << "range p99" << std::setw(11) << "range qps"
+        << std::setw(10) << "knn p50" << std::setw(10) << "knn p99" << std::setw(11) << "knn qps"
+        << std::setw(10) << "rss MB" << std::setw(10) << "peak MB" << std::setw(10) << "tree MB" << std::setw(8) << "B/pt";
+    if constexpr (OctreeInstrumentation::enabled) {
+        out << std::setw(12) << "rng nodes/q" << std::setw(13) << "rng tested/q" << std::setw(8) << "match"
+            << std::setw(12) << "knn nodes/q" << std::setw(13) << "knn tested/q";
+    }
+    out << "\n";
+}
+
+void writeTableRow(std::ostream& out, const BenchmarkResult& r) {
+    out << std::left << std::setw(16) << r.tree << std::setw(8) << r.distribution << std::right
+        << std::setw(10) << r.points << std::setw(6) << r.leafSize << std::setw(5) << r.threads
+        << std::fixed << std::setprecision(1) << std::setw(11) << r.buildMs
+        << std::setprecision(2) << std::setw(11) << r.range.p50 << std::setw(11) << r.range.p99
+        << std::setprecision(0) << std::setw(11) << r.range.throughput
+        << std::setprecision(2) << std::setw(10) << r.knn.p50 << std::setw(10) << r.knn.p99
+        << std::setprecision(0) << std::setw(11) << r.knn.throughput
+        << std::setprecision(1) << std::setw(10) << r.rssGrowthBytes / (1024.0 * 1024.0)
+        << std::setw(10) << r.peakRssBytes / (1024.0 * 1024.0)
+        << std::setw(10) << r.treeBytes / (1024.0 * 1024.0) << std::setw(8) << r.bytesPerPoint;
+    if constexpr (OctreeInstrumentation::enabled) {
+        out << std::setw(12) << perQuery(r.rangeCounters, OctreeCounter::NodesVisited, r.queries)
+            << std::setw(13) << perQuery(r.rangeCounters, OctreeCounter::PointsTested, r.queries)
+            << std::setprecision(2) << std::setw(8) << r.rangeCounters.matchRatio() << std::setprecision(1)
+            << std::setw(12) << perQuery(r.knnCounters, OctreeCounter::NodesVisited, r.queries)
+            << std::setw(13) << perQuery(r.knnCounters, OctreeCounter::PointsTested, r.queries);
+    }
+    out << "\n";
+    out.unsetf(std::ios::floatfield);
+    out << std::setprecision(6);
+}
+
+template <typename T, typename Parse>
+std::vector<T> parseList(const std::string& text, Parse parse) {
+    std::vector<T> values;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) values.push_back(parse(item));
+    }
+    return values;
+}
+
+void printUsage() {
+    std::cout << "Usage: ./octree_benchmark [options]" << std::endl;
+    std::cout << "  --trees LIST          classic,hashmap,morton,linear,linear-hilbert,hashmap-compact,morton-compact,"
+                 "concurrent,outofcore (default classic,hashmap,morton,linear)" << std::endl;
+    std::cout << "  --sizes LIST          Point counts (default 100000)" << std::endl;
+    std::cout << "  --distributions LIST  random,grid,spiral (default all)" << std::endl;
+    std::cout << "  --leaf-sizes LIST     Max points per leaf (default 8)" << std::endl;
+    std::cout << "  --threads LIST        Build and query threads, 0 = all cores (default 1)" << std::endl;
+    std::cout << "  --max-depth N         Depth limit (default 20)" << std::endl;
+    std::cout << "  --queries N           Range and kNN queries per run (default 1000)" << std::endl;
+    std::cout << "  --k N                 Neighbors per kNN query (default 10)" << std::endl;
+    std::cout << "  --range-fraction F    Range box edge relative to the bounds (default 0.05)" << std::endl;
+    std::cout << "  --repeats N           Builds per run, the median is reported (default 3)" << std::endl;
+    std::cout << "  --seed N              Seed for points and queries (default 42)" << std::endl;
+    std::cout << "  --format FORMAT       table, csv or json (default table)" << std::endl;
+    std::cout << "  --output FILE         Write results to FILE instead of stdout" << std::endl;
+    std::cout << "  --trace FILE          Write a Chrome trace of builds and queries (OCTREE_INSTRUMENTATION builds)"
+              << std::endl;
+}
+
+bool parseArguments(int argc, char* argv[], BenchmarkConfig& config) {
+    auto toInt = [](const std::string& s) { return std::stoi(s); };
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h" || i + 1 >= argc) return false;
+        std::string value = argv[++i];
+        if (arg == "--trees") {
+            config.trees = parseList<std::string>(value, [](const std::string& s) { return s; });
+        } else if (arg == "--sizes") {
+            config.sizes = parseList<int>(value, toInt);
+        } else if (arg == "--distributions") {
+            config.distributions = parseList<std::string>(value, [](const std::string& s) { return s; });
+        } else if (arg == "--leaf-sizes") {
+            config.leafSizes = parseList<uint32_t>(value, [](const std::string& s) {
+                return static_cast<uint32_t>(std::stoul(s));
+            });
+        } else if (arg == "--threads") {
+            config.threads = parseList<size_t>(value, [](const std::string& s) {
+                return static_cast<size_t>(std::stoul(s));
+            });
+        } else if (arg == "--max-depth") {
+            config.maxDepth = std::stoi(value);
+        } else if (arg == "--queries") {
+            config.queries = std::stoul(value);
+        } else if (arg == "--k") {
+            config.k = std::stoul(value);
+        } else if (arg == "--range-fraction") {
+            config.rangeFraction = std::stof(value);
+        } else if (arg == "--repeats") {
+            config.repeats = std::stoi(value);
+        } else if (arg == "--seed") {
+            config.seed = static_cast<unsigned>(std::stoul(value));
+        } else if (arg == "--format") {
+            config.format = value;
+        } else if (arg == "--output") {
+            config.output = value;
+        } else if (arg == "--trace") {
+            config.traceFile = value;
+        } else {
+            return false;
+        }
+    }
+    return config.format == "table" || config.format == "csv" || config.format == "json";
+}
+
+int main(int argc, char* argv[]) {
+    BenchmarkConfig config;
+    try {
+        if (!parseArguments(argc, argv, config)) {
+            printUsage();
+            return 1;
+        }
+    } catch (const std::exception&) {
+        printUsage();
+        return 1;
+    }
+
+    if (!config.traceFile.empty()) {
+        if (!OctreeInstrumentation::enabled) {
+            std::cerr << "Error: --trace needs a build with OCTREE_INSTRUMENTATION." << std::endl;
+            return 1;
+        }
+        OctreeInstrumentation::setTracing(true);
+    }
+
+    std::ofstream file;
+    if (!config.output.empty()) {
+        file.open(config.output);
+        if (!file.is_open()) {
+            std::cerr << "Error: Could not open file " << config.output << " for writing." << std::endl;
+            return 1;
+        }
+    }
+    // Results keep stdout; messages the trees print go to stderr so they
+    // cannot corrupt CSV or JSON output
+    std::ostream out(config.output.empty() ? std::cout.rdbuf() : file.rdbuf());
+    std::cout.rdbuf(std::cerr.rdbuf());
+
+    Point min = {-10.0f, -10.0f, -10.0f};
+    Point max = {10.0f, 10.0f, 10.0f};
+
+    // One query set for every run, so the trees answer identical queries
+    std::mt19937 gen(config.seed + 1);
+    std::uniform_real_distribution<float> coord(-10.0f, 10.0f);
+    float halfEdge = 10.0f * config.rangeFraction;
+    std::vector<Point> queryMins, queryMaxs, knnQueries;
+    for (size_t i = 0; i < config.queries; ++i) {
+        Point c(coord(gen), coord(gen), coord(gen));
+        queryMins.push_back(Point(c.x - halfEdge, c.y - halfEdge, c.z - halfEdge));
+        queryMaxs.push_back(Point(c.x + halfEdge, c.y + halfEdge, c.z + halfEdge));
+        knnQueries.push_back(Point(coord(gen), coord(gen), coord(gen)));
+    }
+
+    if (config.format == "csv") {
+        out << CSV_HEADER;
+        if constexpr (OctreeInstrumentation::enabled) out << CSV_COUNTER_HEADER;
+        out << "\n";
+    }
+    if (config.format == "table") writeTableHeader(out);
+
+    // Each configuration runs in a process of its own, except on Windows and
+    // when tracing, whose events are recorded in this process
+#ifdef _WIN32
+    const bool isolated = false;
+#else
+    const bool isolated = config.traceFile.empty();
+#endif
+    if (!isolated) {
+        std::cerr << "Note: all configurations run in one process, so rss_growth and peak_rss are process-wide; "
+                  << "only tree_bytes is per configuration" << std::endl;
+    }
+
+    std::vector<BenchmarkResult> results;
+    for (const auto& distribution : config.distributions) {
+        for (int size : config.sizes) {
+            std::vector<Point> points = generatePoints(distribution, size, min, max, config.seed);
+            if (points.empty()) {
+                std::cerr << "Invalid distribution type: " << distribution << std::endl;
+                return 1;
+            }
+            // The spiral climbs past the query cube, so the tree bounds grow to
+            // cover every generated point and no tree drops any of them
+            Point treeMin = min, treeMax = max;
+            for (const auto& p : points) {
+                treeMin = Point(std::min(treeMin.x, p.x), std::min(treeMin.y, p.y), std::min(treeMin.z, p.z));
+                treeMax = Point(std::max(treeMax.x, p.x), std::max(treeMax.y, p.y), std::max(treeMax.z, p.z));
+            }
+            for (const auto& tree : config.trees) {
+                for (uint32_t leafSize : config.leafSizes) {
+                    for (size_t threads : config.threads) {
+                        BenchmarkResult result;
+                        bool ran;
+#ifdef _WIN32
+                        ran = runTree(tree, config, points, treeMin, treeMax, leafSize, threads,
+                                      queryMins, queryMaxs, knnQueries, result);
+#else
+                        ran = isolated ? runTreeIsolated(tree, config, points, treeMin, treeMax, leafSize, threads,
+                                                         queryMins, queryMaxs, knnQueries, result)
+                                       : runTree(tree, config, points, treeMin, treeMax, leafSize, threads,
+                                                 queryMins, queryMaxs, knnQueries, result);
+#endif
+                        if (!ran) return 1;
+                        result.tree = tree;
+                        result.distribution = distribution;
+                        // Rows are written as they finish so long sweeps show progress
+                        if (config.format == "csv") writeCsvRow(out, result);
+                        if (config.format == "table") writeTableRow(out, result);
+                        out.flush();
+                        results.push_back(result);
+                    }
+                }
+            }
+        }
+    }
+
+    if (config.format == "json") writeJson(out, results);
+
+    if (!config.traceFile.empty()) {
+        std::ofstream trace(config.traceFile);
+        if (!trace.is_open()) {
+            std::cerr << "Error: Could not open file " << config.traceFile << " for writing." << std::endl;
+            return 1;
+        }
+        OctreeInstrumentation::writeChromeTrace(trace);
+    }
+    return 0;
+}
@@ -0,0 +1,227 @@
+#ifndef CHILD_STORAGE_H
+#define CHILD_STORAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <unordered_map>
+#include "octree_memory.h"
+
+// Child containers for the hashmap and Morton octrees. Both map a child key
+// to an owning ChildPtr and share one small interface:
+//   get(key)         -> raw child pointer or nullptr
+//   set(key, child)  -> stores the child and returns the raw pointer
+//   erase(key)       -> destroys the child, if present
+//   empty(), size(), clear(), range-for over (key, child) pairs
+//   addMemory(stats) -> adds the container's own allocations to stats
+// Allocator is the tree's allocator; it is rebound for the container memory.
+
+inline int childStoragePopcount(unsigned v) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    return static_cast<int>(__popcnt(v));
+#else
+    return __builtin_popcount(v);
+#endif
+}
+
+inline int childStorageLowestBit(unsigned v) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward(&index, v);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctz(v);
+#endif
+}
+
+// One std::unordered_map per node, keyed by the full child key
+template <typename Key, typename ChildPtr, typename Allocator>
+class HashChildStorage {
+public:
+    using Node = typename ChildPtr::element_type;
+    using Map = std::unordered_map<Key, ChildPtr, std::hash<Key>, std::equal_to<Key>,
+        typename std::allocator_traits<Allocator>::template rebind_alloc<std::pair<const Key, ChildPtr>>>;
+
+    explicit HashChildStorage(const Allocator& alloc) : map(typename Map::allocator_type(alloc)) {}
+
+    Node* get(Key key) const {
+        auto it = map.find(key);
+        return it == map.end() ? nullptr : it->second.get();
+    }
+
+    Node* set(Key key, ChildPtr child) {
+        ChildPtr& slot = map[key];
+        slot = std::move(child);
+        return slot.get();
+    }
+
+    void erase(Key key) { map.erase(key); }
+
+    bool empty() const { return map.empty(); }
+    size_t size() const { return map.size(); }
+    void clear() { map.clear(); }
+
+    typename Map::const_iterator begin() const { return map.begin(); }
+    typename Map::const_iterator end() const { return map.end(); }
+
+    const Map& container() const { return map; }
+
+    void addMemory(OctreeMemoryStats& stats) const { addUnorderedMap<Allocator>(stats, map); }
+
+private:
+    Map map;
+};
+
+// 8-bit occupancy mask plus a packed array of the present children, ordered
+// by octant. The slot of octant i is popcount(mask & ((1 << i) - 1)). Only
+// the low three bits of a key select the octant, which is all that differs
+// between the keys of siblings.
+template <typename Key, typename ChildPtr, typename Allocator>
+class CompactChildStorage
+    : private std::allocator_traits<Allocator>::template rebind_alloc<ChildPtr> {
+public:
+    using Node = typename ChildPtr::element_type;
+    using SlotAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<ChildPtr>;
+    using SlotTraits = std::allocator_traits<SlotAllocator>;
+
+    explicit CompactChildStorage(const Allocator& alloc) : SlotAllocator(alloc) {}
+
+    CompactChildStorage(const CompactChildStorage&) = delete;
+    CompactChildStorage& operator=(const CompactChildStorage&) = delete;
+
+    ~CompactChildStorage() { clear(); }
+
+    Node* get(Key key) const {
+        unsigned bit = 1u << (key & 7);
+        if (!(mask & bit)) return nullptr;
+        return slots[childStoragePopcount(mask & (bit - 1))].get();
+    }
+
+    Node* set(Key key, ChildPtr child) {
+        unsigned bit = 1u << (key & 7);
+        int slot = childStoragePopcount(mask & (bit - 1));
+        if (mask & bit) {
+            slots[slot] = std::move(child);
+            return slots[slot].get();
+        }
+
+        int count = static_cast<int>(size());
+        if (count == capacityFor(count)) {
+            reallocate(count, capacityFor(count), capacityFor(count + 1));
+        }
+        // Shift the later octants up by one slot
+        SlotAllocator& alloc = *this;
+        SlotTraits::construct(alloc, slots + count);
+        for (int i = count; i > slot; --i) {
+            slots[i] = std::move(slots[i - 1]);
+        }
+        slots[slot] = std::move(child);
+        mask |= static_cast<uint8_t>(bit);
+        return slots[slot].get();
+    }
+
+    void erase(Key key) {
+        unsigned bit = 1u << (key & 7);
+        if (!(mask & bit)) return;
+
+        int count = static_cast<int>(size());
+        if (count == 1) {
+            clear();
+            return;
+        }
+
+        // Shift the later octants down by one slot
+        int slot = childStoragePopcount(mask & (bit - 1));
+        for (int i = slot; i < count - 1; ++i) {
+            slots[i] = std::move(slots[i + 1]);
+        }
+        SlotAllocator& alloc = *this;
+        SlotTraits::destroy(alloc, slots + count - 1);
+        mask &= static_cast<uint8_t>(~bit);
+
+        if (capacityFor(count - 1) < capacityFor(count)) {
+            reallocate(count - 1, capacityFor(count), capacityFor(count - 1));
+        }
+    }
+
+    bool empty() const { return mask == 0; }
+    size_t size() const { return static_cast<size_t>(childStoragePopcount(mask)); }
+
+    void clear() {
+        if (slots == nullptr) return;
+        SlotAllocator& alloc = *this;
+        int count = static_cast<int>(size());
+        for (int i = 0; i < count; ++i) {
+            SlotTraits::destroy(alloc, slots + i);
+        }
+        SlotTraits::deallocate(alloc, slots, capacityFor(count));
+        slots = nullptr;
+        mask = 0;
+    }
+
+    uint8_t occupancy() const { return mask; }
+
+    // Bytes of the packed slot array
+    size_t slotBytes() const { return mask == 0 ? 0 : capacityFor(static_cast<int>(size())) * sizeof(ChildPtr); }
+
+    void addMemory(OctreeMemoryStats& stats) const {
+        stats.childIndexBytes += slotBytes();
+        addAllocation<Allocator>(stats, slotBytes());
+    }
+
+    // Iterates the present children in octant order, yielding (octant, child)
+    class const_iterator {
+    public:
+        const_iterator(const CompactChildStorage* storage, unsigned remaining, int slot)
+            : storage(storage), remaining(remaining), slot(slot) {}
+
+        std::pair<Key, Node*> operator*() const {
+            return {static_cast<Key>(childStorageLowestBit(remaining)), storage->slots[slot].get()};
+        }
+
+        const_iterator& operator++() {
+            remaining &= remaining - 1;
+            ++slot;
+            return *this;
+        }
+
+        bool operator==(const const_iterator& other) const { return remaining == other.remaining; }
+        bool operator!=(const const_iterator& other) const { return remaining != other.remaining; }
+
+    private:
+        const CompactChildStorage* storage;
+        unsigned remaining;
+        int slot;
+    };
+
+    const_iterator begin() const { return const_iterator(this, mask, 0); }
+    const_iterator end() const { return const_iterator(this, 0, 0); }
+
+private:
+    // Slot arrays are sized in powers of two: 1, 2, 4, 8
+    static int capacityFor(int count) {
+        int capacity = 1;
+        while (capacity < count) capacity <<= 1;
+        return count == 0 ? 0 : capacity;
+    }
+
+    // Move the first count slots into an array of newCapacity
+    void reallocate(int count, int oldCapacity, int newCapacity) {
+        SlotAllocator& alloc = *this;
+        ChildPtr* moved = SlotTraits::allocate(alloc, newCapacity);
+        for (int i = 0; i < count; ++i) {
+            SlotTraits::construct(alloc, moved + i, std::move(slots[i]));
+            SlotTraits::destroy(alloc, slots + i);
+        }
+        if (slots != nullptr) {
+            SlotTraits::deallocate(alloc, slots, oldCapacity);
+        }
+        slots = moved;
+    }
+
+    ChildPtr* slots = nullptr;
+    uint8_t mask = 0;
+};
+
+#endif // CHILD_STORAGE_H
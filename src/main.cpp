@@ -10,81 +10,54 @@
 // Include shared Point definition
 #include "point.h"
 
-// Include all three octree implementations
-#include "octree_classic.h"
-#include "octree_hashmap.h" 
-#include "octree_morton.h"
-
-// Function to generate random points within bounds
-std::vector<Point> generateRandomPoints(int numPoints, const Point& min, const Point& max) {
-    std::vector<Point> points;
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_real_distribution<float> distX(min.x, max.x);
-    std::uniform_real_distribution<float> distY(min.y, max.y);
-    std::uniform_real_distribution<float> distZ(min.z, max.z);
-
-    for (int i = 0; i < numPoints; ++i) {
-        points.push_back({distX(gen), distY(gen), distZ(gen)});
+// Every octree implementation behind one runtime-selected wrapper
+#include "octree.h"
+#include "point_generators.h"
+
+// Build the out-of-core octree into pageFile, streaming from inputFile if set.
+// False if the build failed.
+bool buildOutOfCore(OctreeOutOfCore& tree, const std::vector<Point>& points, const std::string& inputFile,
+                    int maxPoints, const std::string& pageFile) {
+    if (inputFile.empty()) {
+        return tree.build(points, pageFile);
     }
-    return points;
-}
-
-// Function to generate points in a grid pattern
-std::vector<Point> generateGridPoints(int pointsPerSide, const Point& min, const Point& max) {
-    std::vector<Point> points;
-    float stepX = (max.x - min.x) / (pointsPerSide - 1);
-    float stepY = (max.y - min.y) / (pointsPerSide - 1);
-    float stepZ = (max.z - min.z) / (pointsPerSide - 1);
-
-    for (int x = 0; x < pointsPerSide; ++x) {
-        for (int y = 0; y < pointsPerSide; ++y) {
-            for (int z = 0; z < pointsPerSide; ++z) {
-                points.push_back({
-                    min.x + x * stepX,
-                    min.y + y * stepY,
-                    min.z + z * stepZ
-                });
-            }
-        }
-    }
-    return points;
-}
-
-// Function to generate points in a spiral pattern
-std::vector<Point> generateSpiralPoints(int numPoints, const Point& min, const Point& max) {
-    std::vector<Point> points;
-    float centerX = (min.x + max.x) / 2;
-    float centerY = (min.y + max.y) / 2;
-    float centerZ = (min.z + max.z) / 2;
-    float radius = std::min({max.x - min.x, max.y - min.y, max.z - min.z}) / 2;
-
-    for (int i = 0; i < numPoints; ++i) {
-        float t = i * 0.1f;
-        float r = radius * (1.0f - float(i) / numPoints);
-        points.push_back({
-            centerX + r * cos(t),
-            centerY + r * sin(t),
-            centerZ + t * 0.1f
-        });
-    }
-    return points;
+    PointFileReader reader(inputFile);
+    size_t remaining = static_cast<size_t>(maxPoints);
+    return tree.buildStreaming([&](Point* out, size_t count) {
+        size_t n = reader.read(out, std::min(count, remaining));
+        remaining -= n;
+        return n;
+    }, pageFile);
 }
 
 void printUsage() {
-    std::cout << "Usage: ./octree <tree_type> <distribution_type> <num_points>" << std::endl;
+    std::cout << "Usage: ./octree <tree_type> <distribution_type> <num_points> [max_points_per_leaf] [max_depth] [threads] [min_cell_size]" << std::endl;
     std::cout << "Tree types:" << std::endl;
     std::cout << "  classic - Classic octree implementation" << std::endl;
     std::cout << "  hashmap - Hashmap-based octree implementation" << std::endl;
     std::cout << "  morton  - Morton code-based octree implementation" << std::endl;
+    std::cout << "  linear  - Linear (pointerless) Morton octree built by sorting" << std::endl;
+    std::cout << "  linear-hilbert  - Linear octree sorted along the Hilbert curve" << std::endl;
+    std::cout << "  hashmap-compact - Hashmap octree with mask + packed-array children" << std::endl;
+    std::cout << "  morton-compact  - Morton octree with mask + packed-array children" << std::endl;
+    std::cout << "  concurrent      - Octree with lock-free readers during inserts" << std::endl;
+    std::cout << "  outofcore       - Disk-backed octree, leaves paged in on demand" << std::endl;
     std::cout << "Distribution types:" << std::endl;
     std::cout << "  random - Random points in 3D space" << std::endl;
     std::cout << "  grid   - Points in a regular 3D grid" << std::endl;
     std::cout << "  spiral - Points in a 3D spiral pattern" << std::endl;
+    std::cout << "  file:<path> - Stream up to num_points points from a PLY or raw float xyz file (outofcore only)" << std::endl;
+    std::cout << "Optional subdivision limits (defaults: 1 point per leaf, depth 20):" << std::endl;
+    std::cout << "  max_points_per_leaf - Leaf capacity before a node is subdivided" << std::endl;
+    std::cout << "  max_depth           - Leaves at this depth are never subdivided" << std::endl;
+    std::cout << "Optional build threads (default 1, 0 = all hardware threads):" << std::endl;
+    std::cout << "  threads             - Worker threads for the parallel bulk load" << std::endl;
+    std::cout << "Optional minimum cell size (default 0):" << std::endl;
+    std::cout << "  min_cell_size       - Cells are not split into children smaller than this" << std::endl;
 }
 
 int main(int argc, char* argv[]) {
-    if (argc != 4) {
+    if (argc < 4 || argc > 8) {
         printUsage();
         return 1;
     }
@@ -93,13 +66,39 @@ int main(int argc, char* argv[]) {
     std::string distributionType = argv[2];
     int numPoints = std::stoi(argv[3]);
 
+    OctreeOptions options = OctreeNode::defaultOptions();
+    if (argc > 4) options.maxPointsPerLeaf = static_cast<uint32_t>(std::stoul(argv[4]));
+    if (argc > 5) options.maxDepth = std::stoi(argv[5]);
+    size_t threads = (argc > 6) ? static_cast<size_t>(std::stoul(argv[6])) : 1;
+    if (argc > 7) options.minCellSize = std::stof(argv[7]);
+
     // Define the bounding box for the octree
     Point min = {-10.0f, -10.0f, -10.0f};
     Point max = {10.0f, 10.0f, 10.0f};
 
     // Generate points based on the selected distribution
     std::vector<Point> points;
-    if (distributionType == "random") {
+    std::string inputFile;
+    if (distributionType.compare(0, 5, "file:") == 0) {
+        // Streamed straight into the out-of-core build; one pass finds the bounds
+        inputFile = distributionType.substr(5);
+        distributionType = "file";
+        PointFileReader reader(inputFile);
+        if (treeType != "outofcore" || !reader.isOpen()) {
+            std::cerr << "File input needs the outofcore tree and a readable PLY or xyz file" << std::endl;
+            printUsage();
+            return 1;
+        }
+        min = {HUGE_VALF, HUGE_VALF, HUGE_VALF};
+        max = {-HUGE_VALF, -HUGE_VALF, -HUGE_VALF};
+        std::vector<Point> chunk(1 << 16);
+        for (size_t n; (n = reader.read(chunk.data(), chunk.size())) > 0;) {
+            for (size_t i = 0; i < n; ++i) {
+                min = {std::min(min.x, chunk[i].x), std::min(min.y, chunk[i].y), std::min(min.z, chunk[i].z)};
+                max = {std::max(max.x, chunk[i].x), std::max(max.y, chunk[i].y), std::max(max.z, chunk[i].z)};
+            }
+        }
+    } else if (distributionType == "random") {
         points = generateRandomPoints(numPoints, min, max);
     } else if (distributionType == "grid") {
         int pointsPerSide = static_cast<int>(std::cbrt(numPoints));
@@ -113,38 +112,27 @@ int main(int argc, char* argv[]) {
     }
 
     // Create and populate the octree
-    std::unique_ptr<OctreeNode> classicOctree;
-    std::unique_ptr<OctreeHashMap> hashmapOctree;
-    std::unique_ptr<OctreeMorton> mortonOctree;
-
-    if (treeType == "classic") {
-        classicOctree = std::make_unique<OctreeNode>(min, max);
-    } else if (treeType == "hashmap") {
-        hashmapOctree = std::make_unique<OctreeHashMap>(min, max);
-    } else if (treeType == "morton") {
-        mortonOctree = std::make_unique<OctreeMorton>(min, max);
-    } else {
+    std::optional<Octree> octree = Octree::create(treeType, min, max, options);
+    if (!octree) {
         std::cerr << "Invalid tree type: " << treeType << std::endl;
         printUsage();
         return 1;
     }
+    octree->setPageFile("octree_" + distributionType + ".oct");
 
     // Measure build time
     auto start = std::chrono::high_resolution_clock::now();
-    
-    // Insert points into the appropriate octree
-    if (treeType == "classic") {
-        for (const auto& p : points) {
-            classicOctree->insert(p);
-        }
-    } else if (treeType == "hashmap") {
-        for (const auto& p : points) {
-            hashmapOctree->insert(p);
-        }
-    } else if (treeType == "morton") {
-        for (const auto& p : points) {
-            mortonOctree->insert(p);
-        }
+
+    // Bulk load the points; a file is streamed straight into the out-of-core tree
+    bool built;
+    if (OctreeOutOfCore* outOfCore = octree->get<OctreeOutOfCore>()) {
+        built = buildOutOfCore(*outOfCore, points, inputFile, numPoints, octree->getPageFile());
+    } else {
+        built = octree->build(points, threads);
+    }
+    if (!built) {
+        std::cerr << "Error: building the " << treeType << " octree failed" << std::endl;
+        return 1;
     }
 
     auto end = std::chrono::high_resolution_clock::now();
@@ -152,23 +140,11 @@ int main(int argc, char* argv[]) {
 
     // Print statistics
     std::cout << "\nBuild time: " << duration.count() << " ms" << std::endl;
-    
-    if (treeType == "classic") {
-        classicOctree->printStatistics();
-    } else if (treeType == "hashmap") {
-        hashmapOctree->printStatistics();
-    } else if (treeType == "morton") {
-        mortonOctree->printStatistics();
-    }
+    octree->printStatistics();
 
-    // Export to VTK for visualization
-    std::string filename = "octree_" + distributionType + ".vtk";
-    if (treeType == "classic") {
-        classicOctree->exportToVTK(filename);
-    } else if (treeType == "hashmap") {
-        hashmapOctree->exportToVTK(filename);
-    } else if (treeType == "morton") {
-        mortonOctree->exportToVTK(filename);
+    // Export to binary VTK for visualization
+    if (!octree->exportToVTK("octree_" + distributionType + ".vtk", VtkFormat::Binary)) {
+        return 1;
     }
 
     return 0;
@@ -0,0 +1,346 @@
+#ifndef MORTON_CODE_H
+#define MORTON_CODE_H
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include "point.h"
+
+#if defined(__BMI2__) && !defined(OCTREE_NO_BMI2)
+#include <immintrin.h>
+#define OCTREE_MORTON_BMI2 1
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define OCTREE_MORTON_AVX2 1
+#endif
+
+// Spatial keys for the sorted octrees. Coordinates are quantized to 21 bits
+// per axis and interleaved into a 63-bit Morton code, with PDEP/PEXT when the
+// build targets BMI2 (-mbmi2 or -march=native) and magic-bit shifts
+// otherwise. On AMD CPUs before Zen 3 PDEP and PEXT are microcoded and much
+// slower than the shifts; define OCTREE_NO_BMI2 there. Hilbert keys use the
+// same layout and give a sorted order with better locality.
+
+// Bits per axis in a 63-bit Morton code (3 * 21 = 63)
+static const int MORTON_BITS_PER_AXIS = 21;
+static const uint32_t MORTON_AXIS_MAX = (1u << MORTON_BITS_PER_AXIS) - 1;
+
+// Spread the lower 21 bits of v so that there are two zero bits between each bit
+inline uint64_t mortonSpreadBits(uint32_t v) {
+    uint64_t x = v & 0x1fffff;
+    x = (x | (x << 32)) & 0x001f00000000ffffULL;
+    x = (x | (x << 16)) & 0x001f0000ff0000ffULL;
+    x = (x | (x << 8))  & 0x100f00f00f00f00fULL;
+    x = (x | (x << 4))  & 0x10c30c30c30c30c3ULL;
+    x = (x | (x << 2))  & 0x1249249249249249ULL;
+    return x;
+}
+
+// Inverse of mortonSpreadBits: gather every third bit into the lower 21 bits
+inline uint32_t mortonCompactBits(uint64_t x) {
+    x &= 0x1249249249249249ULL;
+    x = (x | (x >> 2))  & 0x10c30c30c30c30c3ULL;
+    x = (x | (x >> 4))  & 0x100f00f00f00f00fULL;
+    x = (x | (x >> 8))  & 0x001f0000ff0000ffULL;
+    x = (x | (x >> 16)) & 0x001f00000000ffffULL;
+    x = (x | (x >> 32)) & 0x00000000001fffffULL;
+    return static_cast<uint32_t>(x);
+}
+
+// Bits of each axis in a Morton code
+static const uint64_t MORTON_MASK_X = 0x1249249249249249ULL;
+static const uint64_t MORTON_MASK_Y = MORTON_MASK_X << 1;
+static const uint64_t MORTON_MASK_Z = MORTON_MASK_X << 2;
+
+// Interleave three 21-bit cell coordinates. The x bit is the lowest bit of
+// every triple, matching the octant numbering used by getOctant (x=1, y=2, z=4).
+inline uint64_t mortonEncode(uint32_t x, uint32_t y, uint32_t z) {
+#if defined(OCTREE_MORTON_BMI2)
+    return _pdep_u64(x, MORTON_MASK_X) | _pdep_u64(y, MORTON_MASK_Y) | _pdep_u64(z, MORTON_MASK_Z);
+#else
+    return mortonSpreadBits(x) | (mortonSpreadBits(y) << 1) | (mortonSpreadBits(z) << 2);
+#endif
+}
+
+inline void mortonDecode(uint64_t code, uint32_t& x, uint32_t& y, uint32_t& z) {
+#if defined(OCTREE_MORTON_BMI2)
+    x = static_cast<uint32_t>(_pext_u64(code, MORTON_MASK_X));
+    y = static_cast<uint32_t>(_pext_u64(code, MORTON_MASK_Y));
+    z = static_cast<uint32_t>(_pext_u64(code, MORTON_MASK_Z));
+#else
+    x = mortonCompactBits(code);
+    y = mortonCompactBits(code >> 1);
+    z = mortonCompactBits(code >> 2);
+#endif
+}
+
+// Key of the cell next to the cell with the given key and level, stepped by
+// dx, dy, dz in {-1, 0, 1} along the axes. The step is done on the dilated
+// (interleaved) coordinates: filling the bits of the other axes with ones
+// lets the carry of +1 run through them, and borrows of -1 run through the
+// zeros. Returns false if the step leaves the grid of that level.
+inline bool mortonNeighborKey(uint64_t key, int level, int dx, int dy, int dz, uint64_t& neighbor) {
+    const uint64_t levelMask = (uint64_t(1) << (3 * level)) - 1;
+    const uint64_t masks[3] = {MORTON_MASK_X & levelMask, MORTON_MASK_Y & levelMask, MORTON_MASK_Z & levelMask};
+    const int steps[3] = {dx, dy, dz};
+    uint64_t result = key;
+    for (int axis = 0; axis < 3; ++axis) {
+        uint64_t mask = masks[axis];
+        uint64_t part = result & mask;
+        if (steps[axis] > 0) {
+            if (part == mask) return false;
+            part = ((part | ~mask) + 1) & mask;
+        } else if (steps[axis] < 0) {
+            if (part == 0) return false;
+            part = (part - 1) & mask;
+        }
+        result = (result & ~mask) | part;
+    }
+    neighbor = result;
+    return true;
+}
+
+// Map a coordinate in [min, max] to a 21-bit integer cell coordinate.
+// Computed in double so that cell bounds derived from the result contain v.
+inline uint32_t mortonQuantize(float v, float min, float max) {
+    double extent = static_cast<double>(max) - min;
+    if (!(extent > 0.0)) return 0;
+    double scaled = (static_cast<double>(v) - min) / extent * static_cast<double>(1u << MORTON_BITS_PER_AXIS);
+    if (!(scaled > 0.0)) return 0;
+    if (scaled >= static_cast<double>(MORTON_AXIS_MAX)) return MORTON_AXIS_MAX;
+    return static_cast<uint32_t>(scaled);
+}
+
+// 63-bit Morton code of a point relative to the root bounds
+inline uint64_t mortonEncodePoint(const Point& p, const Point& min, const Point& max) {
+    return mortonEncode(mortonQuantize(p.x, min.x, max.x),
+                        mortonQuantize(p.y, min.y, max.y),
+                        mortonQuantize(p.z, min.z, max.z));
+}
+
+// Hilbert curve of Skilling's transform ("Programming the Hilbert curve",
+// 2004), evaluated one level at a time. Skilling's loop reflects and swaps
+// the lower bits of the axes depending on the bits of each level, then Gray
+// codes the result; what it has done to the lower bits is a signed
+// permutation of the axes plus the parity of the Gray code so far, 96 states
+// in all. The tables map (state, octant) to (key digit, next state) and its
+// inverse, so a key costs one lookup per level instead of the branchy loop.
+struct HilbertTables {
+    // Entry: digit or octant in bits 0-2, next state above
+    uint16_t encode[96][8];
+    uint16_t decode[96][8];
+
+    constexpr HilbertTables() : encode(), decode() {
+        const int perms[6][3] = {{0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0}};
+        // state = 16 * permutation + 2 * flips + parity
+        for (int state = 0; state < 96; ++state) {
+            for (int octant = 0; octant < 8; ++octant) {
+                int perm[3] = {perms[state / 16][0], perms[state / 16][1], perms[state / 16][2]};
+                int flip[3] = {(state >> 1) & 1, (state >> 2) & 1, (state >> 3) & 1};
+                int parity = state & 1;
+
+                // Bits of this level after the transforms of the levels above
+                int bit[3] = {0, 0, 0};
+                for (int k = 0; k < 3; ++k) bit[k] = ((octant >> perm[k]) & 1) ^ flip[k];
+
+                // Skilling's step for this level, applied to the lower bits
+                for (int i = 0; i < 3; ++i) {
+                    if (bit[i]) {
+                        flip[0] ^= 1;
+                    } else {
+                        int p = perm[0], f = flip[0];
+                        perm[0] = perm[i]; flip[0] = flip[i];
+                        perm[i] = p; flip[i] = f;
+                    }
+                }
+
+                // Gray code; the parity of the last axis so far flips every lower bit
+                int gray0 = bit[0] ^ parity;
+                int gray1 = bit[1] ^ bit[0] ^ parity;
+                int gray2 = bit[2] ^ bit[1] ^ bit[0];
+                int digit = (gray0 << 2) | (gray1 << 1) | (gray2 ^ parity);
+
+                int permIndex = 0;
+                while (perms[permIndex][0] != perm[0] || perms[permIndex][1] != perm[1]) ++permIndex;
+                int next = 16 * permIndex + 2 * (flip[0] | (flip[1] << 1) | (flip[2] << 2)) + (parity ^ gray2);
+                encode[state][octant] = static_cast<uint16_t>(digit | (next << 3));
+                decode[state][digit] = static_cast<uint16_t>(octant | (next << 3));
+            }
+        }
+    }
+};
+
+static constexpr HilbertTables HILBERT_TABLES{};
+
+// Hilbert key of three cell coordinates of the given number of bits. The key
+// has the Morton layout: the first 3 * k bits of a key identify the cell of
+// level k, so it is the key of (x, y, z) >> (bits - k) on the k-bit curve.
+inline uint64_t hilbertEncode(uint32_t x, uint32_t y, uint32_t z, int bits = MORTON_BITS_PER_AXIS) {
+    uint64_t code = 0;
+    uint32_t state = 0;
+    for (int level = bits - 1; level >= 0; --level) {
+        uint32_t octant = ((x >> level) & 1) | (((y >> level) & 1) << 1) | (((z >> level) & 1) << 2);
+        uint32_t entry = HILBERT_TABLES.encode[state][octant];
+        code = (code << 3) | (entry & 7);
+        state = entry >> 3;
+    }
+    return code;
+}
+
+inline void hilbertDecode(uint64_t code, uint32_t& x, uint32_t& y, uint32_t& z, int bits = MORTON_BITS_PER_AXIS) {
+    x = y = z = 0;
+    uint32_t state = 0;
+    for (int level = bits - 1; level >= 0; --level) {
+        uint32_t entry = HILBERT_TABLES.decode[state][(code >> (3 * level)) & 7];
+        x = (x << 1) | (entry & 1);
+        y = (y << 1) | ((entry >> 1) & 1);
+        z = (z << 1) | ((entry >> 2) & 1);
+        state = entry >> 3;
+    }
+}
+
+// 63-bit Hilbert key of a point relative to the root bounds
+inline uint64_t hilbertEncodePoint(const Point& p, const Point& min, const Point& max) {
+    return hilbertEncode(mortonQuantize(p.x, min.x, max.x),
+                         mortonQuantize(p.y, min.y, max.y),
+                         mortonQuantize(p.z, min.z, max.z));
+}
+
+// Order in which a sorted octree lays out its points
+enum class SpaceFillingCurve : uint32_t {
+    Morton = 0,
+    Hilbert = 1
+};
+
+inline const char* curveName(SpaceFillingCurve curve) {
+    return curve == SpaceFillingCurve::Hilbert ? "Hilbert" : "Morton";
+}
+
+inline uint64_t curveEncodePoint(SpaceFillingCurve curve, const Point& p, const Point& min, const Point& max) {
+    return curve == SpaceFillingCurve::Hilbert ? hilbertEncodePoint(p, min, max) : mortonEncodePoint(p, min, max);
+}
+
+// Cell coordinates at the given level of the cell whose key prefix is key
+inline void curveDecodeCell(SpaceFillingCurve curve, uint64_t key, int level, uint32_t& x, uint32_t& y, uint32_t& z) {
+    if (curve == SpaceFillingCurve::Hilbert) {
+        hilbertDecode(key, x, y, z, level);
+    } else {
+        mortonDecode(key, x, y, z);
+    }
+}
+
+#if defined(OCTREE_MORTON_AVX2)
+// mortonQuantize on four lanes, with the same double arithmetic so the
+// results are identical. extent must be positive.
+inline __m128i mortonQuantize4(__m256d v, double min, double extent) {
+    __m256d scaled = _mm256_mul_pd(_mm256_div_pd(_mm256_sub_pd(v, _mm256_set1_pd(min)), _mm256_set1_pd(extent)),
+                                   _mm256_set1_pd(static_cast<double>(1u << MORTON_BITS_PER_AXIS)));
+    // Lanes not above 0, NaN included, quantize to 0
+    __m256d positive = _mm256_cmp_pd(scaled, _mm256_setzero_pd(), _CMP_GT_OQ);
+    scaled = _mm256_and_pd(_mm256_min_pd(scaled, _mm256_set1_pd(static_cast<double>(MORTON_AXIS_MAX))), positive);
+    return _mm256_cvttpd_epi32(scaled);
+}
+
+// mortonSpreadBits on four 64-bit lanes
+inline __m256i mortonSpreadBits4(__m256i x) {
+    x = _mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi64(x, 32)), _mm256_set1_epi64x(0x001f00000000ffffLL));
+    x = _mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi64(x, 16)), _mm256_set1_epi64x(0x001f0000ff0000ffLL));
+    x = _mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi64(x, 8)), _mm256_set1_epi64x(0x100f00f00f00f00fLL));
+    x = _mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi64(x, 4)), _mm256_set1_epi64x(0x10c30c30c30c30c3LL));
+    x = _mm256_and_si256(_mm256_or_si256(x, _mm256_slli_epi64(x, 2)), _mm256_set1_epi64x(0x1249249249249249LL));
+    return x;
+}
+#endif
+
+// Keys of n points, codes[i] = curveEncodePoint(curve, points[i], min, max).
+// With AVX2, blocks of four points are quantized and Morton-interleaved in
+// vector registers; Hilbert keys reuse the vector quantization.
+inline void curveEncodePoints(SpaceFillingCurve curve, const Point* points, size_t n,
+                              const Point& min, const Point& max, uint64_t* codes) {
+    size_t i = 0;
+#if defined(OCTREE_MORTON_AVX2)
+    const double extent[3] = {static_cast<double>(max.x) - min.x, static_cast<double>(max.y) - min.y,
+                              static_cast<double>(max.z) - min.z};
+    // A flat axis quantizes to 0; the scalar loop handles it
+    if (extent[0] > 0.0 && extent[1] > 0.0 && extent[2] > 0.0) {
+        alignas(16) uint32_t cells[3][4];
+        for (; i + 4 <= n; i += 4) {
+            const Point* p = points + i;
+            __m128i x = mortonQuantize4(_mm256_cvtps_pd(_mm_setr_ps(p[0].x, p[1].x, p[2].x, p[3].x)), min.x, extent[0]);
+            __m128i y = mortonQuantize4(_mm256_cvtps_pd(_mm_setr_ps(p[0].y, p[1].y, p[2].y, p[3].y)), min.y, extent[1]);
+            __m128i z = mortonQuantize4(_mm256_cvtps_pd(_mm_setr_ps(p[0].z, p[1].z, p[2].z, p[3].z)), min.z, extent[2]);
+            if (curve == SpaceFillingCurve::Morton) {
+                __m256i code = _mm256_or_si256(
+                    mortonSpreadBits4(_mm256_cvtepu32_epi64(x)),
+                    _mm256_or_si256(_mm256_slli_epi64(mortonSpreadBits4(_mm256_cvtepu32_epi64(y)), 1),
+                                    _mm256_slli_epi64(mortonSpreadBits4(_mm256_cvtepu32_epi64(z)), 2)));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(codes + i), code);
+            } else {
+                _mm_store_si128(reinterpret_cast<__m128i*>(cells[0]), x);
+                _mm_store_si128(reinterpret_cast<__m128i*>(cells[1]), y);
+                _mm_store_si128(reinterpret_cast<__m128i*>(cells[2]), z);
+                for (int j = 0; j < 4; ++j) {
+                    codes[i + j] = hilbertEncode(cells[0][j], cells[1][j], cells[2][j]);
+                }
+            }
+        }
+    }
+#endif
+    for (; i < n; ++i) {
+        codes[i] = curveEncodePoint(curve, points[i], min, max);
+    }
+}
+
+// Stable LSD radix sort of n Morton codes. order is permuted alongside the
+// codes, so order[i] ends up holding the original value at the position of
+// the i-th smallest code.
+inline void mortonRadixSort(uint64_t* codes, uint32_t* order, size_t n) {
+    const int RADIX_BITS = 11;
+    const size_t BUCKETS = size_t(1) << RADIX_BITS;
+
+    std::vector<uint64_t> codesTmp(n);
+    std::vector<uint32_t> orderTmp(n);
+    std::vector<size_t> histogram(BUCKETS);
+    uint64_t* codesIn = codes;
+    uint32_t* orderIn = order;
+    uint64_t* codesOut = codesTmp.data();
+    uint32_t* orderOut = orderTmp.data();
+
+    for (int shift = 0; shift < 63; shift += RADIX_BITS) {
+        std::fill(histogram.begin(), histogram.end(), 0);
+        for (size_t i = 0; i < n; ++i) {
+            histogram[(codesIn[i] >> shift) & (BUCKETS - 1)]++;
+        }
+
+        // All codes share this digit: the pass would not move anything
+        if (n == 0 || histogram[(codesIn[0] >> shift) & (BUCKETS - 1)] == n) continue;
+
+        size_t offset = 0;
+        for (size_t b = 0; b < BUCKETS; ++b) {
+            size_t count = histogram[b];
+            histogram[b] = offset;
+            offset += count;
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            size_t dst = histogram[(codesIn[i] >> shift) & (BUCKETS - 1)]++;
+            codesOut[dst] = codesIn[i];
+            orderOut[dst] = orderIn[i];
+        }
+        std::swap(codesIn, codesOut);
+        std::swap(orderIn, orderOut);
+    }
+
+    // An odd number of passes leaves the result in the scratch buffers
+    if (codesIn != codes) {
+        std::copy(codesIn, codesIn + n, codes);
+        std::copy(orderIn, orderIn + n, order);
+    }
+}
+
+inline void mortonRadixSort(std::vector<uint64_t>& codes, std::vector<uint32_t>& order) {
+    mortonRadixSort(codes.data(), order.data(), codes.size());
+}
+
+#endif // MORTON_CODE_H
@@ -0,0 +1,107 @@
+#ifndef NODE_ARENA_H
+#define NODE_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include <type_traits>
+#include <algorithm>
+#include <mutex>
+
+// Monotonic block arena. Allocations bump a cursor through large blocks and
+// are never freed individually; release() returns every block at once.
+// allocate() is serialized by a mutex so that the parallel builds can share
+// one arena across threads.
+class NodeArena {
+public:
+    explicit NodeArena(size_t blockSize = size_t(1) << 20) : blockSize(blockSize) {}
+
+    ~NodeArena() { release(); }
+
+    NodeArena(const NodeArena&) = delete;
+    NodeArena& operator=(const NodeArena&) = delete;
+
+    void* allocate(size_t bytes, size_t alignment) {
+        std::lock_guard<std::mutex> lock(mutex);
+        uintptr_t aligned = (reinterpret_cast<uintptr_t>(cursor) + alignment - 1) & ~(uintptr_t(alignment) - 1);
+        if (cursor == nullptr || aligned + bytes > reinterpret_cast<uintptr_t>(limit)) {
+            addBlock(bytes + alignment);
+            aligned = (reinterpret_cast<uintptr_t>(cursor) + alignment - 1) & ~(uintptr_t(alignment) - 1);
+        }
+        cursor = reinterpret_cast<char*>(aligned + bytes);
+        bytesUsed += bytes;
+        return reinterpret_cast<void*>(aligned);
+    }
+
+    // Free all blocks. Everything allocated from the arena becomes invalid.
+    void release() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (char* block : blocks) {
+            std::free(block);
+        }
+        blocks.clear();
+        cursor = limit = nullptr;
+        bytesUsed = bytesReserved = 0;
+    }
+
+    size_t allocatedBytes() const { return bytesUsed; }
+    size_t reservedBytes() const { return bytesReserved; }
+
+private:
+    void addBlock(size_t minBytes) {
+        size_t size = std::max(blockSize, minBytes);
+        char* block = static_cast<char*>(std::malloc(size));
+        if (block == nullptr) throw std::bad_alloc();
+        blocks.push_back(block);
+        cursor = block;
+        limit = block + size;
+        bytesReserved += size;
+    }
+
+    std::mutex mutex;
+    size_t blockSize;
+    std::vector<char*> blocks;
+    char* cursor = nullptr;
+    char* limit = nullptr;
+    size_t bytesUsed = 0;
+    size_t bytesReserved = 0;
+};
+
+// Standard allocator over a NodeArena. deallocate is a no-op: memory only
+// goes back when the arena is released, which lets the octrees skip
+// destroying their nodes one by one.
+template <typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+    using is_arena = std::true_type;
+
+    ArenaAllocator(NodeArena& arena) noexcept : arena(&arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena(other.arena) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, size_t) noexcept {}
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const noexcept { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const noexcept { return arena != other.arena; }
+
+    NodeArena* arena;
+};
+
+// True for allocators whose memory is reclaimed in bulk (see ArenaAllocator)
+template <typename Alloc, typename = void>
+struct is_arena_allocator : std::false_type {};
+
+template <typename Alloc>
+struct is_arena_allocator<Alloc, std::void_t<typename Alloc::is_arena>> : Alloc::is_arena {};
+
+#endif // NODE_ARENA_H
@@ -0,0 +1,207 @@
+#ifndef OCTREE_H
+#define OCTREE_H
+
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+#include "point.h"
+#include "octree_classic.h"
+#include "octree_hashmap.h"
+#include "octree_morton.h"
+#include "octree_linear.h"
+#include "octree_concurrent.h"
+#include "octree_out_of_core.h"
+
+// An octree of any of the default backends, chosen at runtime by name. The
+// tree sits in a std::variant and each call dispatches once through
+// std::visit, so the per-point loops of builds and queries run on the
+// concrete type with no virtual calls. The wrapper covers the operations all
+// backends share; visitTree(f) calls f with the concrete tree for the rest.
+class Octree {
+public:
+    using Backend = std::variant<std::unique_ptr<OctreeNode>, std::unique_ptr<OctreeHashMap>,
+                                 std::unique_ptr<OctreeMorton>, std::unique_ptr<OctreeLinear>,
+                                 std::unique_ptr<CompactOctreeHashMap<>>, std::unique_ptr<CompactOctreeMorton<>>,
+                                 std::unique_ptr<OctreeConcurrent>, std::unique_ptr<OctreeOutOfCore>>;
+
+    // Empty tree of the named type over [min, max]; nothing for an unknown name
+    static std::optional<Octree> create(const std::string& type, const Point& min, const Point& max,
+                                        const OctreeOptions& options = OctreeNode::defaultOptions()) {
+        if (type == "classic") return Octree(type, std::make_unique<OctreeNode>(min, max, options));
+        if (type == "hashmap") return Octree(type, std::make_unique<OctreeHashMap>(min, max, options));
+        if (type == "morton") return Octree(type, std::make_unique<OctreeMorton>(min, max, options));
+        if (type == "linear") return Octree(type, std::make_unique<OctreeLinear>(min, max, options));
+        if (type == "linear-hilbert") {
+            return Octree(type, std::make_unique<OctreeLinear>(min, max, options, SpaceFillingCurve::Hilbert));
+        }
+        if (type == "hashmap-compact") return Octree(type, std::make_unique<CompactOctreeHashMap<>>(min, max, options));
+        if (type == "morton-compact") return Octree(type, std::make_unique<CompactOctreeMorton<>>(min, max, options));
+        if (type == "concurrent") return Octree(type, std::make_unique<OctreeConcurrent>(min, max, options));
+        if (type == "outofcore") return Octree(type, std::make_unique<OctreeOutOfCore>(min, max, options));
+        return std::nullopt;
+    }
+
+    // Names create() accepts
+    static const std::vector<std::string>& types() {
+        static const std::vector<std::string> names = {"classic", "hashmap", "morton", "linear", "linear-hilbert",
+                                                       "hashmap-compact", "morton-compact", "concurrent", "outofcore"};
+        return names;
+    }
+
+    const std::string& type() const { return typeName; }
+
+    // The concrete tree if it is a Tree, else nullptr
+    template <typename Tree>
+    Tree* get() {
+        auto* tree = std::get_if<std::unique_ptr<Tree>>(&backend);
+        return tree != nullptr ? tree->get() : nullptr;
+    }
+
+    template <typename Tree>
+    const Tree* get() const {
+        auto* tree = std::get_if<std::unique_ptr<Tree>>(&backend);
+        return tree != nullptr ? tree->get() : nullptr;
+    }
+
+    // f(tree) on the concrete tree; f must return the same type for every backend
+    template <typename F>
+    decltype(auto) visitTree(F&& f) {
+        return std::visit([&](auto& tree) -> decltype(auto) { return f(*tree); }, backend);
+    }
+
+    template <typename F>
+    decltype(auto) visitTree(F&& f) const {
+        return std::visit([&](const auto& tree) -> decltype(auto) { return f(std::as_const(*tree)); }, backend);
+    }
+
+    // File the out-of-core tree writes its pages to on build()
+    void setPageFile(const std::string& filename) { pageFile = filename; }
+    const std::string& getPageFile() const { return pageFile; }
+
+    // Bulk load. threads != 1 uses a parallel build where the tree has one
+    // (0 = every hardware thread). False if the build failed.
+    bool build(const std::vector<Point>& points, size_t threads = 1) {
+        return visitTree([&](auto& tree) {
+            using Tree = std::decay_t<decltype(tree)>;
+            if constexpr (std::is_same_v<Tree, OctreeOutOfCore>) {
+                // The external sort is bound by I/O, not by threads
+                return tree.build(points, pageFile);
+            } else if constexpr (std::is_same_v<Tree, OctreeConcurrent>) {
+                // Writers are serialized; the concurrency is on the read side
+                tree.build(points);
+                return true;
+            } else {
+                if (threads == 1) {
+                    tree.build(points);
+                } else {
+                    tree.buildParallel(points, threads);
+                }
+                return true;
+            }
+        });
+    }
+
+    // Adds one point. The linear and out-of-core trees are only built in
+    // bulk, and reject it.
+    bool insert(const Point& p) {
+        return visitTree([&](auto& tree) {
+            using Tree = std::decay_t<decltype(tree)>;
+            if constexpr (std::is_same_v<Tree, OctreeLinear> || std::is_same_v<Tree, OctreeOutOfCore>) {
+                std::cerr << "The " << typeName << " octree does not support insert; use build" << std::endl;
+                return false;
+            } else {
+                tree.insert(p);
+                return true;
+            }
+        });
+    }
+
+    std::vector<Point> rangeQuery(const Point& queryMin, const Point& queryMax) const {
+        return visitTree([&](const auto& tree) { return tree.rangeQuery(queryMin, queryMax); });
+    }
+
+    template <typename Visitor>
+    bool rangeQuery(const Point& queryMin, const Point& queryMax, Visitor&& visit) const {
+        return visitTree([&](const auto& tree) { return tree.rangeQuery(queryMin, queryMax, visit); });
+    }
+
+    size_t countInRange(const Point& queryMin, const Point& queryMax) const {
+        return visitTree([&](const auto& tree) { return tree.countInRange(queryMin, queryMax); });
+    }
+
+    bool anyInRange(const Point& queryMin, const Point& queryMax) const {
+        return visitTree([&](const auto& tree) { return tree.anyInRange(queryMin, queryMax); });
+    }
+
+    std::vector<Point> radiusQuery(const Point& center, float radius) const {
+        return visitTree([&](const auto& tree) { return tree.radiusQuery(center, radius); });
+    }
+
+    template <typename Visitor>
+    bool radiusQuery(const Point& center, float radius, Visitor&& visit) const {
+        return visitTree([&](const auto& tree) { return tree.radiusQuery(center, radius, visit); });
+    }
+
+    std::vector<Point> knn(const Point& q, size_t k) const {
+        return visitTree([&](const auto& tree) { return tree.knn(q, k); });
+    }
+
+    std::optional<Point> nearest(const Point& q) const {
+        return visitTree([&](const auto& tree) { return tree.nearest(q); });
+    }
+
+    std::vector<Point> frustumQuery(const Frustum& frustum) const {
+        return visitTree([&](const auto& tree) { return tree.frustumQuery(frustum); });
+    }
+
+    template <typename Visitor>
+    bool frustumQuery(const Frustum& frustum, Visitor&& visit) const {
+        return visitTree([&](const auto& tree) { return tree.frustumQuery(frustum, visit); });
+    }
+
+    std::vector<Point> rayQuery(const Ray& ray, float radius) const {
+        return visitTree([&](const auto& tree) { return tree.rayQuery(ray, radius); });
+    }
+
+    template <typename Visitor>
+    bool rayQuery(const Ray& ray, float radius, Visitor&& visit) const {
+        return visitTree([&](const auto& tree) { return tree.rayQuery(ray, radius, visit); });
+    }
+
+    std::optional<RayHit<Point>> raycast(const Ray& ray, float radius) const {
+        return visitTree([&](const auto& tree) { return tree.raycast(ray, radius); });
+    }
+
+    template <typename Visitor>
+    bool forEachPoint(Visitor&& visit) const {
+        return visitTree([&](const auto& tree) { return tree.forEachPoint(visit); });
+    }
+
+    OctreeMemoryStats getMemoryStatistics() const {
+        return visitTree([](const auto& tree) { return tree.getMemoryStatistics(); });
+    }
+
+    void printStatistics() const {
+        visitTree([](const auto& tree) { tree.printStatistics(); });
+    }
+
+    // False if the file could not be written
+    bool exportToVTK(const std::string& filename, VtkFormat format = VtkFormat::Ascii) const {
+        return visitTree([&](const auto& tree) { return tree.exportToVTK(filename, format); });
+    }
+
+private:
+    Octree(const std::string& type, Backend tree) : backend(std::move(tree)), typeName(type) {}
+
+    Backend backend;
+    std::string typeName;
+    std::string pageFile = "octree.oct";
+};
+
+#endif // OCTREE_H
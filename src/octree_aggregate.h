@@ -0,0 +1,70 @@
+#ifndef OCTREE_AGGREGATE_H
+#define OCTREE_AGGREGATE_H
+
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+#include "point.h"
+
+// Summary of a set of points: their number, coordinate sums and tight
+// bounding box. Nodes keep one for their subtree, so a query covering a
+// whole subtree reads it instead of the points, and the tight box rejects
+// empty space inside a cell. An empty aggregate has an inverted box that
+// intersects nothing. remove() keeps the box, which then stays a valid
+// but possibly loose bound until the set is empty again.
+struct PointAggregate {
+    uint64_t count = 0;
+    // Sums in double, so that centroids of large sets keep float precision
+    double sumX = 0.0, sumY = 0.0, sumZ = 0.0;
+    Point min = Point(std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity(),
+                      std::numeric_limits<float>::infinity());
+    Point max = Point(-std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(),
+                      -std::numeric_limits<float>::infinity());
+
+    bool empty() const { return count == 0; }
+
+    void add(const Point& p) {
+        count++;
+        sumX += p.x;
+        sumY += p.y;
+        sumZ += p.z;
+        min = Point(std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z));
+        max = Point(std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z));
+    }
+
+    void remove(const Point& p) {
+        if (--count == 0) {
+            *this = PointAggregate();
+            return;
+        }
+        sumX -= p.x;
+        sumY -= p.y;
+        sumZ -= p.z;
+    }
+
+    void merge(const PointAggregate& other) {
+        count += other.count;
+        sumX += other.sumX;
+        sumY += other.sumY;
+        sumZ += other.sumZ;
+        min = Point(std::min(min.x, other.min.x), std::min(min.y, other.min.y), std::min(min.z, other.min.z));
+        max = Point(std::max(max.x, other.max.x), std::max(max.y, other.max.y), std::max(max.z, other.max.z));
+    }
+
+    // Aggregate of the points in [first, last)
+    template <typename It>
+    static PointAggregate of(It first, It last) {
+        PointAggregate aggregate;
+        for (; first != last; ++first) aggregate.add(*first);
+        return aggregate;
+    }
+
+    // Mean of the points; the origin for an empty set
+    Point centroid() const {
+        if (count == 0) return Point();
+        double n = static_cast<double>(count);
+        return Point(static_cast<float>(sumX / n), static_cast<float>(sumY / n), static_cast<float>(sumZ / n));
+    }
+};
+
+#endif // OCTREE_AGGREGATE_H
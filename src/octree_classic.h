@@ -3,30 +3,90 @@
 
 #include <iostream>
 #include <vector>
-#include <fstream>
-#include <iomanip>
 #include <string>
+#include <algorithm>
+#include <memory>
+#include <queue>
+#include <optional>
+#include <functional>
+#include <array>
 #include "point.h"
+#include "octree_query.h"
+#include "octree_options.h"
+#include "vtk_writer.h"
+#include "octree_memory.h"
+#include "octree_traversal.h"
+#include "octree_geometry.h"
+#include "octree_aggregate.h"
+#include "octree_instrumentation.h"
+#include "node_arena.h"
+#include "thread_pool.h"
 
-class OctreeNode {
+// LeafCapacity and MaxDepth are the compile-time defaults for the
+// subdivision limits; OctreeOptions can override them per tree at runtime.
+// Nodes and point buffers are allocated through Allocator, which must be
+// either stateless (like std::allocator) or an arena allocator; with an
+// ArenaAllocator the tree is torn down by releasing the arena.
+// PointType is the stored element: Point or a type derived from it that
+// carries a payload, e.g. IndexedPoint. Queries return PointType values.
+template <size_t LeafCapacity = 1, int MaxDepth = 20, typename Allocator = std::allocator<Point>,
+          typename PointType = Point>
+class BasicOctreeNode {
 public:
+    using allocator_type = Allocator;
+    using value_type = PointType;
+    using PointAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<PointType>;
+    using PointIterator = typename std::vector<PointType>::iterator;
+    using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<BasicOctreeNode>;
+    using NodeTraits = std::allocator_traits<NodeAllocator>;
+
     // Bounding box: min and max coordinates
     Point min, max;
-    // Child nodes (could be std::unique_ptr<OctreeNode>[8] or std::array)
-    OctreeNode* children[8] = {nullptr};
+    // Midpoint of the box, kept for octant selection and child bounds
+    Point center;
+    // Child nodes (could be std::unique_ptr<BasicOctreeNode>[8] or std::array)
+    BasicOctreeNode* children[8] = {nullptr};
     // Data (e.g., list of points or objects)
-    std::vector<Point> points;
+    std::vector<PointType, PointAllocator> points;
+
+    int depth;
+    // Subdivision limits, inherited by every child
+    OctreeOptions options;
+    // Count, coordinate sums and tight bounds of the points in this subtree
+    PointAggregate aggregate;
+
+    // Maximum points per leaf before subdivision
+    static constexpr size_t MAX_POINTS_PER_LEAF = LeafCapacity;
+    static constexpr int MAX_DEPTH = MaxDepth;
+
+    static constexpr OctreeOptions defaultOptions() {
+        return OctreeOptions{static_cast<uint32_t>(LeafCapacity), MaxDepth};
+    }
+
+    BasicOctreeNode(const Point& min, const Point& max, int depth = 0)
+        : BasicOctreeNode(min, max, defaultOptions(), depth) {}
+
+    BasicOctreeNode(const Point& min, const Point& max, const Allocator& alloc)
+        : BasicOctreeNode(min, max, defaultOptions(), 0, alloc) {}
+
+    BasicOctreeNode(const Point& min, const Point& max, const OctreeOptions& options, int depth = 0,
+                    const Allocator& alloc = Allocator())
+        : min(min), max(max), center(boxCenter(min, max)), points(PointAllocator(alloc)), depth(depth),
+          options(options.clampedTo(MaxDepth)) {}
 
-    OctreeNode(const Point& min, const Point& max) : min(min), max(max) {}
+    BasicOctreeNode(const BasicOctreeNode&) = delete;
+    BasicOctreeNode& operator=(const BasicOctreeNode&) = delete;
 
-    // Destructor to clean up memory
-    ~OctreeNode() {
+    // Destructor to clean up memory. Arena-backed trees skip the walk.
+    ~BasicOctreeNode() {
         for (int i = 0; i < 8; ++i) {
-            delete children[i];
+            destroyChild(children[i]);
         }
     }
 
-    void insert(const Point& p) {
+    allocator_type get_allocator() const { return allocator_type(points.get_allocator()); }
+
+    void insert(const PointType& p) {
         // Check if point is within bounds
         if (!contains(p)) {
             std::cout << "Warning: Point (" << p.x << ", " << p.y << ", " << p.z 
@@ -34,19 +94,254 @@ public:
             return;
         }
 
+        // Descend to the leaf that owns p, creating missing children on the way
+        BasicOctreeNode* node = this;
+        while (!node->isLeaf()) {
+            OCTREE_COUNT(NodesVisited, 1);
+            node->aggregate.add(p);
+            int idx = node->getOctant(p);
+            if (node->children[idx] == nullptr) {
+                node->children[idx] = node->createChild(idx);
+            }
+            node = node->children[idx];
+        }
+
+        OCTREE_COUNT(NodesVisited, 1);
+        node->aggregate.add(p);
+        node->points.push_back(p);
+        // Subdivide if too many points, unless a limit or a cluster keeps the leaf whole
+        if (options.shouldSplitAfterInsert(node->points.begin(), node->points.end(), node->depth, node->min, node->max)) {
+            node->subdivide();
+        }
+    }
+
+    // Remove all points and children
+    void clear() {
+        for (int i = 0; i < 8; ++i) {
+            destroyChild(children[i]);
+            children[i] = nullptr;
+        }
+        points.clear();
+        aggregate = PointAggregate();
+    }
+
+    // Remove one stored point equal to p; false if there is none. On the way
+    // back up, a subtree left with at most maxPointsPerLeaf points is merged
+    // into its root, undoing subdivide().
+    bool remove(const PointType& p) {
+        if (!contains(p)) {
+            return false;
+        }
+
         if (isLeaf()) {
-            points.push_back(p);
-            // Optionally subdivide if too many points
-            if (points.size() > 1) subdivide();
-        } else {
-            int idx = getOctant(p);
-            if (children[idx] == nullptr) {
-                // Create child node with new bounds
-                Point childMin, childMax;
-                calculateChildBounds(idx, childMin, childMax);
-                children[idx] = new OctreeNode(childMin, childMax);
+            auto it = std::find(points.begin(), points.end(), p);
+            if (it == points.end()) return false;
+            *it = points.back();
+            points.pop_back();
+            aggregate.remove(p);
+            return true;
+        }
+
+        BasicOctreeNode* child = children[getOctant(p)];
+        if (child == nullptr || !child->remove(p)) {
+            return false;
+        }
+        aggregate.remove(p);
+        if (aggregate.count <= options.maxPointsPerLeaf) {
+            coalesce();
+        }
+        return true;
+    }
+
+    // Move a stored point. Both positions are followed down while they share
+    // a child; in a common leaf the point is overwritten in place, otherwise
+    // it is removed and reinserted below the deepest node holding both.
+    // False if oldPoint is not stored or newPoint is outside this node.
+    bool update(const PointType& oldPoint, const PointType& newPoint) {
+        if (!contains(oldPoint) || !contains(newPoint)) {
+            return false;
+        }
+
+        if (isLeaf()) {
+            auto it = std::find(points.begin(), points.end(), oldPoint);
+            if (it == points.end()) return false;
+            *it = newPoint;
+            aggregate.remove(oldPoint);
+            aggregate.add(newPoint);
+            return true;
+        }
+
+        int oldOctant = getOctant(oldPoint);
+        if (oldOctant == getOctant(newPoint)) {
+            if (children[oldOctant] == nullptr || !children[oldOctant]->update(oldPoint, newPoint)) return false;
+            aggregate.remove(oldPoint);
+            aggregate.add(newPoint);
+            return true;
+        }
+        if (!remove(oldPoint)) {
+            return false;
+        }
+        insert(newPoint);
+        return true;
+    }
+
+    // Undo subdivide(): pull every point of the subtree into this node and free the children
+    void coalesce() {
+        std::vector<PointType> merged;
+        collectAllPoints(merged);
+        for (int i = 0; i < 8; ++i) {
+            destroyChild(children[i]);
+            children[i] = nullptr;
+        }
+        points.assign(merged.begin(), merged.end());
+    }
+
+    // Bulk load: replaces the contents of this node with the given points.
+    // Points are partitioned top-down in place and each node is allocated once.
+    void build(const std::vector<PointType>& input) {
+        build(input.begin(), input.end());
+    }
+
+    template <typename InputIt>
+    void build(InputIt first, InputIt last) {
+        OCTREE_TRACE_SCOPE("build");
+        clear();
+
+        std::vector<PointType> work;
+        size_t outside = 0;
+        for (; first != last; ++first) {
+            if (contains(*first)) {
+                work.push_back(*first);
+            } else {
+                outside++;
+            }
+        }
+        if (outside > 0) {
+            std::cout << "Warning: " << outside << " points are outside node bounds" << std::endl;
+        }
+
+        buildRecursive(work.begin(), work.end());
+    }
+
+    void buildRecursive(PointIterator first, PointIterator last) {
+        if (!options.shouldSplit(first, last, depth, min, max)) {
+            points.assign(first, last);
+            aggregate = PointAggregate::of(first, last);
+            return;
+        }
+
+        PointIterator bounds[9];
+        OCTREE_COUNT(Subdivisions, 1);
+        partitionOctants(first, last, bounds);
+
+        for (int i = 0; i < 8; ++i) {
+            children[i] = createChild(i);
+            children[i]->buildRecursive(bounds[i], bounds[i + 1]);
+        }
+        mergeChildAggregates();
+    }
+
+    // Parallel bulk load, same result as build(). The top levels are split
+    // breadth-first, partitioning the nodes of each level concurrently, until
+    // there are several subtrees per thread; the subtrees are then built on
+    // the pool. threadCount == 0 uses every hardware thread.
+    void buildParallel(const std::vector<PointType>& input, size_t threadCount = 0) {
+        ThreadPool pool(threadCount);
+        buildParallel(input, pool);
+    }
+
+    void buildParallel(const std::vector<PointType>& input, ThreadPool& pool) {
+        OCTREE_TRACE_SCOPE("buildParallel");
+        clear();
+
+        std::vector<PointType> work;
+        work.reserve(input.size());
+        size_t outside = 0;
+        for (const auto& p : input) {
+            if (contains(p)) {
+                work.push_back(p);
+            } else {
+                outside++;
+            }
+        }
+        if (outside > 0) {
+            std::cout << "Warning: " << outside << " points are outside node bounds" << std::endl;
+        }
+
+        struct Subtree {
+            BasicOctreeNode* node;
+            PointIterator first, last;
+        };
+        std::vector<Subtree> frontier = {{this, work.begin(), work.end()}};
+        const size_t targetSubtrees = pool.size() * 8;
+        // Nodes split here, parents before children
+        std::vector<BasicOctreeNode*> splitNodes;
+
+        while (pool.size() > 1 && frontier.size() < targetSubtrees) {
+            std::vector<std::array<PointIterator, 9>> bounds(frontier.size());
+            std::vector<char> split(frontier.size(), 0);
+            parallelFor(pool, frontier.size(), 1, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                    const Subtree& s = frontier[i];
+                    if (!s.node->options.shouldSplit(s.first, s.last, s.node->depth, s.node->min, s.node->max)) {
+                        continue;
+                    }
+                    OCTREE_COUNT(Subdivisions, 1);
+                    s.node->partitionOctants(s.first, s.last, bounds[i].data());
+                    split[i] = 1;
+                }
+            });
+
+            std::vector<Subtree> next;
+            bool anySplit = false;
+            for (size_t i = 0; i < frontier.size(); ++i) {
+                if (!split[i]) {
+                    next.push_back(frontier[i]);
+                    continue;
+                }
+                anySplit = true;
+                BasicOctreeNode* node = frontier[i].node;
+                splitNodes.push_back(node);
+                const auto& b = bounds[i];
+                for (int octant = 0; octant < 8; ++octant) {
+                    node->children[octant] = node->createChild(octant);
+                    next.push_back({node->children[octant], b[octant], b[octant + 1]});
+                }
+            }
+            frontier.swap(next);
+            if (!anySplit) break;
+        }
+
+        parallelFor(pool, frontier.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                frontier[i].node->buildRecursive(frontier[i].first, frontier[i].last);
+            }
+        });
+        for (size_t i = splitNodes.size(); i-- > 0;) {
+            splitNodes[i]->mergeChildAggregates();
+        }
+    }
+
+    // Recompute this node's aggregate from its children's
+    void mergeChildAggregates() {
+        aggregate = PointAggregate();
+        for (int i = 0; i < 8; ++i) {
+            if (children[i] != nullptr) aggregate.merge(children[i]->aggregate);
+        }
+    }
+
+    // Reorder [first, last) so that the points of octant i occupy
+    // [bounds[i], bounds[i + 1]). Splits on z, then y, then x.
+    void partitionOctants(PointIterator first, PointIterator last,
+                          PointIterator bounds[9]) const {
+        bounds[0] = first;
+        bounds[8] = last;
+        bounds[4] = std::partition(first, last, [&](const Point& p) { return !(p.z > center.z); });
+        for (int z = 0; z < 8; z += 4) {
+            bounds[z + 2] = std::partition(bounds[z], bounds[z + 4], [&](const Point& p) { return !(p.y > center.y); });
+            for (int y = z; y < z + 4; y += 2) {
+                bounds[y + 1] = std::partition(bounds[y], bounds[y + 2], [&](const Point& p) { return !(p.x > center.x); });
             }
-            children[idx]->insert(p);
         }
     }
 
@@ -57,12 +352,6 @@ public:
     }
 
     void calculateChildBounds(int octant, Point& childMin, Point& childMax) const {
-        Point center = {
-            (min.x + max.x) / 2.0f,
-            (min.y + max.y) / 2.0f,
-            (min.z + max.z) / 2.0f
-        };
-
         childMin.x = (octant & 1) ? center.x : min.x;
         childMin.y = (octant & 2) ? center.y : min.y;
         childMin.z = (octant & 4) ? center.z : min.z;
@@ -73,19 +362,32 @@ public:
 
     bool isLeaf() const { return children[0] == nullptr; }
 
-    void subdivide() {
-        // Calculate center of current node
-        Point center = {
-            (min.x + max.x) / 2.0f,
-            (min.y + max.y) / 2.0f,
-            (min.z + max.z) / 2.0f
-        };
+    // Allocate a child for the given octant from this node's allocator
+    BasicOctreeNode* createChild(int octant) {
+        Point childMin, childMax;
+        calculateChildBounds(octant, childMin, childMax);
+        NodeAllocator alloc(points.get_allocator());
+        BasicOctreeNode* child = NodeTraits::allocate(alloc, 1);
+        NodeTraits::construct(alloc, child, childMin, childMax, options, depth + 1, get_allocator());
+        OCTREE_COUNT(NodesAllocated, 1);
+        return child;
+    }
+
+    static void destroyChild(BasicOctreeNode* child) {
+        // Arena memory is reclaimed in bulk, so nothing has to be visited
+        if constexpr (!is_arena_allocator<Allocator>::value) {
+            if (child == nullptr) return;
+            NodeAllocator alloc;
+            NodeTraits::destroy(alloc, child);
+            NodeTraits::deallocate(alloc, child, 1);
+        }
+    }
 
+    void subdivide() {
+        OCTREE_COUNT(Subdivisions, 1);
         // Create children for each octant
         for (int i = 0; i < 8; ++i) {
-            Point childMin, childMax;
-            calculateChildBounds(i, childMin, childMax);
-            children[i] = new OctreeNode(childMin, childMax);
+            children[i] = createChild(i);
         }
 
         // Move points to appropriate child
@@ -97,16 +399,20 @@ public:
     }
 
     int getOctant(const Point& p) const {
-        Point center = {
-            (min.x + max.x) / 2.0f,
-            (min.y + max.y) / 2.0f,
-            (min.z + max.z) / 2.0f
-        };
-        int idx = 0;
-        if (p.x > center.x) idx |= 1;
-        if (p.y > center.y) idx |= 2;
-        if (p.z > center.z) idx |= 4;
-        return idx;
+        return octantOf(p, center);
+    }
+
+    // Push the children for a depth-first walk, last octant first so that
+    // octant 0 is visited next. Prefetching them overlaps the cache misses
+    // of all eight instead of taking them one pop at a time.
+    template <typename Stack>
+    void pushChildren(Stack& stack) const {
+        for (int i = 7; i >= 0; --i) {
+            if (children[i] != nullptr) {
+                prefetchRead(children[i]);
+                stack.push(children[i]);
+            }
+        }
     }
 
     // Helper function to print the octree structure
@@ -127,170 +433,444 @@ public:
     }
 
     // Collect all points in the octree
-    void collectAllPoints(std::vector<Point>& allPoints) const {
-        // Add points from this node
-        for (const auto& p : points) {
-            allPoints.push_back(p);
+    void collectAllPoints(std::vector<PointType>& allPoints) const {
+        forEachPoint([&](const PointType& p) { allPoints.push_back(p); });
+    }
+
+    // Collect all node bounding boxes for visualization
+    void collectNodeBoxes(std::vector<std::pair<Point, Point>>& boxes, std::vector<int>& levels, int currentLevel = 0) const {
+        forEachNode([&](const Point& nodeMin, const Point& nodeMax, int level) {
+            boxes.push_back({nodeMin, nodeMax});
+            levels.push_back(level);
+        }, currentLevel);
+    }
+
+    // Export octree to VTK format for ParaView visualization. Binary output is
+    // smaller and much faster to write; ASCII stays readable for debugging.
+    bool exportToVTK(const std::string& filename, VtkFormat format = VtkFormat::Ascii) const {
+        if (!writeOctreeVTK(*this, filename, "Octree Visualization", format)) {
+            std::cerr << "Error: Could not write file " << filename << std::endl;
+            return false;
         }
-        
-        // Recursively collect from children
-        if (!isLeaf()) {
-            for (int i = 0; i < 8; ++i) {
-                if (children[i] != nullptr) {
-                    children[i]->collectAllPoints(allPoints);
+        std::cout << "Octree exported to " << filename << std::endl;
+        std::cout << "Open this file in ParaView to visualize the octree structure!" << std::endl;
+        return true;
+    }
+    
+    // Query methods
+    std::vector<PointType> rangeQuery(const Point& queryMin, const Point& queryMax) const {
+        std::vector<PointType> result;
+        rangeQuery(queryMin, queryMax, [&](const PointType& p) { result.push_back(p); });
+        return result;
+    }
+
+    // Streams every point inside the box to visit(p) without allocating.
+    // A visitor returning bool can stop the query by returning false; the
+    // result is false if the query was stopped early.
+    template <typename Visitor>
+    bool rangeQuery(const Point& queryMin, const Point& queryMax, Visitor&& visit) const {
+        OCTREE_TRACE_SCOPE("rangeQuery");
+        TraversalStack<const BasicOctreeNode*, MaxDepth> stack;
+        stack.push(this);
+        while (!stack.empty()) {
+            const BasicOctreeNode* node = stack.pop();
+            OCTREE_COUNT(NodesVisited, 1);
+            // Skip subtrees whose bounding box is disjoint from the query range
+            if (!node->boxIntersects(queryMin, queryMax)) {
+                OCTREE_COUNT(NodesPruned, 1);
+                continue;
+            }
+
+            // Whole subtree lies inside the query: emit it without per-point tests
+            if (node->boxContainedIn(queryMin, queryMax)) {
+                OCTREE_COUNT(SubtreesAccepted, 1);
+                OCTREE_COUNT(PointsMatched, node->aggregate.count);
+                if (!node->forEachPoint(visit)) return false;
+                continue;
+            }
+
+            // Check points in this node
+            OCTREE_COUNT(PointsTested, node->points.size());
+            for (const auto& p : node->points) {
+                if (p.x >= queryMin.x && p.x <= queryMax.x &&
+                    p.y >= queryMin.y && p.y <= queryMax.y &&
+                    p.z >= queryMin.z && p.z <= queryMax.z) {
+                    OCTREE_COUNT(PointsMatched, 1);
+                    if (!invokeVisitor(visit, p)) return false;
                 }
             }
+            node->pushChildren(stack);
         }
+        return true;
     }
 
-    // Collect all node bounding boxes for visualization
-    void collectNodeBoxes(std::vector<std::pair<Point, Point>>& boxes, std::vector<int>& levels, int currentLevel = 0) const {
-        // Add this node's bounding box
-        boxes.push_back({min, max});
-        levels.push_back(currentLevel);
-        
-        // Recursively collect from children
-        if (!isLeaf()) {
-            for (int i = 0; i < 8; ++i) {
-                if (children[i] != nullptr) {
-                    children[i]->collectNodeBoxes(boxes, levels, currentLevel + 1);
+    // Number of points inside the box; contained subtrees are counted without per-point tests
+    size_t countInRange(const Point& queryMin, const Point& queryMax) const {
+        OCTREE_TRACE_SCOPE("countInRange");
+        size_t count = 0;
+        TraversalStack<const BasicOctreeNode*, MaxDepth> stack;
+        stack.push(this);
+        while (!stack.empty()) {
+            const BasicOctreeNode* node = stack.pop();
+            OCTREE_COUNT(NodesVisited, 1);
+            if (!node->boxIntersects(queryMin, queryMax)) {
+                OCTREE_COUNT(NodesPruned, 1);
+                continue;
+            }
+            if (node->boxContainedIn(queryMin, queryMax)) {
+                OCTREE_COUNT(SubtreesAccepted, 1);
+                OCTREE_COUNT(PointsMatched, node->aggregate.count);
+                count += node->aggregate.count;
+                continue;
+            }
+
+            OCTREE_COUNT(PointsTested, node->points.size());
+            for (const auto& p : node->points) {
+                if (p.x >= queryMin.x && p.x <= queryMax.x &&
+                    p.y >= queryMin.y && p.y <= queryMax.y &&
+                    p.z >= queryMin.z && p.z <= queryMax.z) {
+                    OCTREE_COUNT(PointsMatched, 1);
+                    count++;
                 }
             }
+            node->pushChildren(stack);
         }
+        return count;
     }
 
-    // Export octree to VTK format for ParaView visualization
-    void exportToVTK(const std::string& filename) const {
-        std::ofstream file(filename);
-        if (!file.is_open()) {
-            std::cerr << "Error: Could not open file " << filename << " for writing." << std::endl;
-            return;
+    // True if at least one point lies inside the box; stops at the first hit
+    bool anyInRange(const Point& queryMin, const Point& queryMax) const {
+        return !rangeQuery(queryMin, queryMax, [](const Point&) { return false; });
+    }
+
+    // Aggregate of the points inside the box. Subtrees whose points all lie
+    // inside contribute their stored aggregate without being descended.
+    PointAggregate aggregateInRange(const Point& queryMin, const Point& queryMax) const {
+        PointAggregate result;
+        TraversalStack<const BasicOctreeNode*, MaxDepth> stack;
+        stack.push(this);
+        while (!stack.empty()) {
+            const BasicOctreeNode* node = stack.pop();
+            if (!node->boxIntersects(queryMin, queryMax)) {
+                continue;
+            }
+            if (node->boxContainedIn(queryMin, queryMax)) {
+                result.merge(node->aggregate);
+                continue;
+            }
+
+            for (const auto& p : node->points) {
+                if (p.x >= queryMin.x && p.x <= queryMax.x &&
+                    p.y >= queryMin.y && p.y <= queryMax.y &&
+                    p.z >= queryMin.z && p.z <= queryMax.z) {
+                    result.add(p);
+                }
+            }
+            node->pushChildren(stack);
         }
+        return result;
+    }
 
-        // Collect all points and boxes
-        std::vector<Point> allPoints;
-        std::vector<std::pair<Point, Point>> boxes;
-        std::vector<int> levels;
-        
-        collectAllPoints(allPoints);
-        collectNodeBoxes(boxes, levels);
+    // Mean of the points inside the box, or nothing if there are none
+    std::optional<Point> centroidInRange(const Point& queryMin, const Point& queryMax) const {
+        PointAggregate result = aggregateInRange(queryMin, queryMax);
+        if (result.empty()) return std::nullopt;
+        return result.centroid();
+    }
 
-        // Write VTK header
-        file << "# vtk DataFile Version 3.0\n";
-        file << "Octree Visualization\n";
-        file << "ASCII\n";
-        file << "DATASET UNSTRUCTURED_GRID\n\n";
+    // Points within radius of center (sphere query)
+    std::vector<PointType> radiusQuery(const Point& center, float radius) const {
+        std::vector<PointType> result;
+        radiusQuery(center, radius, [&](const PointType& p) { result.push_back(p); });
+        return result;
+    }
 
-        // Calculate total points: original points + 8 corners per box
-        int totalPoints = allPoints.size() + boxes.size() * 8;
-        
-        file << "POINTS " << totalPoints << " float\n";
-        
-        // Write original points
-        for (const auto& p : allPoints) {
-            file << std::fixed << std::setprecision(6) << p.x << " " << p.y << " " << p.z << "\n";
+    // Visitor overload of radiusQuery, same contract as the rangeQuery one
+    template <typename Visitor>
+    bool radiusQuery(const Point& center, float radius, Visitor&& visit) const {
+        const float radiusSquared = radius * radius;
+        TraversalStack<const BasicOctreeNode*, MaxDepth> stack;
+        stack.push(this);
+        while (!stack.empty()) {
+            const BasicOctreeNode* node = stack.pop();
+            // Skip subtrees whose bounding box does not touch the sphere
+            if (node->boxDistanceSquared(center) > radiusSquared) {
+                continue;
+            }
+
+            // Whole subtree inside the sphere: emit it without per-point tests
+            if (::boxMaxDistanceSquared(center, node->aggregate.min, node->aggregate.max) <= radiusSquared) {
+                if (!node->forEachPoint(visit)) return false;
+                continue;
+            }
+
+            // Check points in this node
+            for (const auto& p : node->points) {
+                if (distanceSquared(p, center) <= radiusSquared) {
+                    if (!invokeVisitor(visit, p)) return false;
+                }
+            }
+            node->pushChildren(stack);
         }
-        
-        // Write box corner points
-        for (const auto& box : boxes) {
-            const Point& minP = box.first;
-            const Point& maxP = box.second;
-            
-            // 8 corners of the box
-            file << minP.x << " " << minP.y << " " << minP.z << "\n";  // 0
-            file << maxP.x << " " << minP.y << " " << minP.z << "\n";  // 1
-            file << maxP.x << " " << maxP.y << " " << minP.z << "\n";  // 2
-            file << minP.x << " " << maxP.y << " " << minP.z << "\n";  // 3
-            file << minP.x << " " << minP.y << " " << maxP.z << "\n";  // 4
-            file << maxP.x << " " << minP.y << " " << maxP.z << "\n";  // 5
-            file << maxP.x << " " << maxP.y << " " << maxP.z << "\n";  // 6
-            file << minP.x << " " << maxP.y << " " << maxP.z << "\n";  // 7
-        }
-
-        // Write cells (points as vertices + boxes as hexahedrons)
-        int totalCells = allPoints.size() + boxes.size();
-        int totalCellData = allPoints.size() * 2 + boxes.size() * 9; // 2 for points (1+1), 9 for hex (8+1)
-        
-        file << "\nCELLS " << totalCells << " " << totalCellData << "\n";
-        
-        // Write point cells (vertices)
-        for (int i = 0; i < allPoints.size(); ++i) {
-            file << "1 " << i << "\n";
+        return true;
+    }
+
+    // Points inside the view frustum
+    std::vector<PointType> frustumQuery(const Frustum& frustum) const {
+        std::vector<PointType> result;
+        frustumQuery(frustum, [&](const PointType& p) { result.push_back(p); });
+        return result;
+    }
+
+    // Visitor overload of frustumQuery, same contract as the rangeQuery one
+    template <typename Visitor>
+    bool frustumQuery(const Frustum& frustum, Visitor&& visit) const {
+        TraversalStack<const BasicOctreeNode*, MaxDepth> stack;
+        stack.push(this);
+        while (!stack.empty()) {
+            const BasicOctreeNode* node = stack.pop();
+            BoxRelation relation = frustum.classify(node->aggregate.min, node->aggregate.max);
+            if (relation == BoxRelation::Outside) {
+                continue;
+            }
+
+            // Whole subtree inside the frustum: emit it without per-point tests
+            if (relation == BoxRelation::Inside) {
+                if (!node->forEachPoint(visit)) return false;
+                continue;
+            }
+
+            for (const auto& p : node->points) {
+                if (frustum.contains(p)) {
+                    if (!invokeVisitor(visit, p)) return false;
+                }
+            }
+            node->pushChildren(stack);
         }
-        
-        // Write box cells (hexahedrons)
-        int baseIdx = allPoints.size();
-        for (int i = 0; i < boxes.size(); ++i) {
-            int start = baseIdx + i * 8;
-            file << "8 " << start << " " << (start+1) << " " << (start+2) << " " << (start+3)
-                 << " " << (start+4) << " " << (start+5) << " " << (start+6) << " " << (start+7) << "\n";
+        return true;
+    }
+
+    // Points within radius of the ray, cell by cell from front to back
+    std::vector<PointType> rayQuery(const Ray& ray, float radius) const {
+        std::vector<PointType> result;
+        rayQuery(ray, radius, [&](const PointType& p) { result.push_back(p); });
+        return result;
+    }
+
+    // Visitor overload of rayQuery, same contract as the rangeQuery one.
+    // Cells come in the order the ray enters them, the points of one cell
+    // in storage order.
+    template <typename Visitor>
+    bool rayQuery(const Ray& ray, float radius, Visitor&& visit) const {
+        const float cutoff = ray.maxDistance;
+        return rayTraverse(ray, radius, cutoff, [&](const BasicOctreeNode* node) {
+            float t;
+            for (const auto& p : node->points) {
+                if (ray.hits(p, radius, t) && !invokeVisitor(visit, p)) return false;
+            }
+            return true;
+        });
+    }
+
+    // First point along the ray within radius of it, or nothing. Cells the
+    // ray enters beyond the best hit so far are skipped, so the walk usually
+    // ends a few cells after the first hit.
+    std::optional<RayHit<PointType>> raycast(const Ray& ray, float radius) const {
+        std::optional<RayHit<PointType>> best;
+        float cutoff = ray.maxDistance;
+        rayTraverse(ray, radius, cutoff, [&](const BasicOctreeNode* node) {
+            float t;
+            for (const auto& p : node->points) {
+                if (ray.hits(p, radius, t) && (!best || t < best->distance)) {
+                    best = RayHit<PointType>{p, t};
+                    cutoff = t;
+                }
+            }
+            return true;
+        });
+        return best;
+    }
+
+    // Front-to-back walk over the cells near the ray, see ::rayTraverse
+    template <typename VisitNode>
+    bool rayTraverse(const Ray& ray, float radius, const float& cutoff, VisitNode&& visitNode) const {
+        return ::rayTraverse<MaxDepth>(
+            ray, radius, cutoff, static_cast<const BasicOctreeNode*>(this),
+            [](const BasicOctreeNode* node) -> const BasicOctreeNode& { return *node; },
+            [](const BasicOctreeNode* node, RayChildOrder<const BasicOctreeNode*>& children) { node->pushChildren(children); },
+            visitNode);
+    }
+
+    // Calls visit(p) for every point in this subtree, same contract as rangeQuery
+    template <typename Visitor>
+    bool forEachPoint(Visitor&& visit) const {
+        TraversalStack<const BasicOctreeNode*, MaxDepth> stack;
+        stack.push(this);
+        while (!stack.empty()) {
+            const BasicOctreeNode* node = stack.pop();
+            for (const auto& p : node->points) {
+                if (!invokeVisitor(visit, p)) return false;
+            }
+            node->pushChildren(stack);
         }
+        return true;
+    }
 
-        // Write cell types
-        file << "\nCELL_TYPES " << totalCells << "\n";
-        
-        // Point cells (VTK_VERTEX = 1)
-        for (int i = 0; i < allPoints.size(); ++i) {
-            file << "1\n";
+    // Calls visit(min, max, level) for every node in this subtree, parents
+    // before children; level counts from this node
+    template <typename Visitor>
+    void forEachNode(Visitor&& visit, int level = 0) const {
+        TraversalStack<const BasicOctreeNode*, MaxDepth> stack;
+        stack.push(this);
+        while (!stack.empty()) {
+            const BasicOctreeNode* node = stack.pop();
+            visit(node->min, node->max, level + node->depth - depth);
+            node->pushChildren(stack);
         }
-        
-        // Hexahedron cells (VTK_HEXAHEDRON = 12)
-        for (int i = 0; i < boxes.size(); ++i) {
-            file << "12\n";
+    }
+
+    // Number of points stored in this subtree
+    size_t pointCount() const {
+        return aggregate.count;
+    }
+
+    // The box tests of the queries use the tight bounds of the subtree's
+    // points, which reject empty parts of a cell and empty subtrees
+    bool boxIntersects(const Point& queryMin, const Point& queryMax) const {
+        const Point& lo = aggregate.min;
+        const Point& hi = aggregate.max;
+        return !(hi.x < queryMin.x || lo.x > queryMax.x ||
+                 hi.y < queryMin.y || lo.y > queryMax.y ||
+                 hi.z < queryMin.z || lo.z > queryMax.z);
+    }
+
+    bool boxContainedIn(const Point& queryMin, const Point& queryMax) const {
+        const Point& lo = aggregate.min;
+        const Point& hi = aggregate.max;
+        return lo.x >= queryMin.x && hi.x <= queryMax.x &&
+               lo.y >= queryMin.y && hi.y <= queryMax.y &&
+               lo.z >= queryMin.z && hi.z <= queryMax.z;
+    }
+
+    // Squared distance from q to the tight bounds of this subtree (0 if
+    // inside, infinite if the subtree is empty)
+    float boxDistanceSquared(const Point& q) const {
+        return ::boxDistanceSquared(q, aggregate.min, aggregate.max);
+    }
+
+    // The k points closest to q, closest first. Nodes are visited best-first
+    // in order of their box distance to q; the search stops once the next
+    // node is farther away than the current k-th neighbor.
+    std::vector<PointType> knn(const Point& q, size_t k) const {
+        if (k == 0) return {};
+        OCTREE_TRACE_SCOPE("knn");
+        KnnCollector<PointType> collector(k);
+
+        using Entry = std::pair<float, const BasicOctreeNode*>;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+        queue.push({boxDistanceSquared(q), this});
+
+        while (!queue.empty()) {
+            auto [dist, node] = queue.top();
+            queue.pop();
+            if (dist > collector.worstDistanceSquared()) break;
+            OCTREE_COUNT(NodesVisited, 1);
+
+            OCTREE_COUNT(PointsTested, node->points.size());
+            for (const auto& p : node->points) {
+                collector.offer(p, distanceSquared(p, q));
+            }
+            if (!node->isLeaf()) {
+                for (int i = 0; i < 8; ++i) {
+                    const BasicOctreeNode* child = node->children[i];
+                    if (child == nullptr) continue;
+                    float childDist = child->boxDistanceSquared(q);
+                    if (childDist <= collector.worstDistanceSquared()) {
+                        queue.push({childDist, child});
+                    }
+                }
+            }
         }
+        return collector.sortedPoints();
+    }
 
-        // Write cell data (octree levels for coloring)
-        file << "\nCELL_DATA " << totalCells << "\n";
-        file << "SCALARS OctreeLevel int 1\n";
-        file << "LOOKUP_TABLE default\n";
-        
-        // Points are at level -1 (to distinguish from boxes)
-        for (int i = 0; i < allPoints.size(); ++i) {
-            file << "-1\n";
+    // Closest point to q, or nothing if the tree is empty
+    std::optional<PointType> nearest(const Point& q) const {
+        std::vector<PointType> result = knn(q, 1);
+        if (result.empty()) return std::nullopt;
+        return result.front();
+    }
+
+    // Batched rangeQuery: result[i] holds the points inside
+    // [queryMins[i], queryMaxs[i]]. Queries run in Morton order of their
+    // box centers so that neighbouring queries share cached nodes.
+    std::vector<std::vector<PointType>> rangeQueryBatch(const std::vector<Point>& queryMins,
+                                                        const std::vector<Point>& queryMaxs) const {
+        size_t count = std::min(queryMins.size(), queryMaxs.size());
+        std::vector<Point> centers(count);
+        for (size_t i = 0; i < count; ++i) {
+            centers[i] = Point((queryMins[i].x + queryMaxs[i].x) * 0.5f,
+                               (queryMins[i].y + queryMaxs[i].y) * 0.5f,
+                               (queryMins[i].z + queryMaxs[i].z) * 0.5f);
         }
-        
-        // Box levels
-        for (int level : levels) {
-            file << level << "\n";
+
+        std::vector<std::vector<PointType>> results(count);
+        for (uint32_t i : mortonQueryOrder(centers, min, max)) {
+            std::vector<PointType>& result = results[i];
+            rangeQuery(queryMins[i], queryMaxs[i], [&](const PointType& p) { result.push_back(p); });
         }
+        return results;
+    }
 
-        file.close();
-        std::cout << "Octree exported to " << filename << std::endl;
-        std::cout << "Open this file in ParaView to visualize the octree structure!" << std::endl;
+    // Batched knn: result[i] holds the k points closest to queries[i], run in Morton order
+    std::vector<std::vector<PointType>> knnBatch(const std::vector<Point>& queries, size_t k) const {
+        std::vector<std::vector<PointType>> results(queries.size());
+        for (uint32_t i : mortonQueryOrder(queries, min, max)) {
+            results[i] = knn(queries[i], k);
+        }
+        return results;
     }
     
-    // Add missing methods for benchmark compatibility
-    std::vector<Point> rangeQuery(const Point& queryMin, const Point& queryMax) const {
-        std::vector<Point> result;
-        std::vector<Point> allPoints;
-        collectAllPoints(allPoints);
-        
-        for (const auto& p : allPoints) {
-            if (p.x >= queryMin.x && p.x <= queryMax.x &&
-                p.y >= queryMin.y && p.y <= queryMax.y &&
-                p.z >= queryMin.z && p.z <= queryMax.z) {
-                result.push_back(p);
+    void getStatistics(int& totalNodes, int& leafNodes, int& totalPoints, int& maxDepth, int currentDepth = 0) const {
+        TraversalStack<const BasicOctreeNode*, MaxDepth> stack;
+        stack.push(this);
+        while (!stack.empty()) {
+            const BasicOctreeNode* node = stack.pop();
+            totalNodes++;
+            totalPoints += node->points.size();
+            maxDepth = std::max(maxDepth, currentDepth + node->depth - depth);
+            if (node->isLeaf()) {
+                leafNodes++;
             }
+            node->pushChildren(stack);
         }
-        return result;
     }
     
-    void getStatistics(int& totalNodes, int& leafNodes, int& totalPoints, int& maxDepth, int currentDepth = 0) const {
-        totalNodes++;
-        totalPoints += points.size();
-        maxDepth = std::max(maxDepth, currentDepth);
-        
-        if (isLeaf()) {
-            leafNodes++;
-        } else {
-            for (int i = 0; i < 8; ++i) {
-                if (children[i] != nullptr) {
-                    children[i]->getStatistics(totalNodes, leafNodes, totalPoints, maxDepth, currentDepth + 1);
-                }
+    // Heap footprint of this subtree. The node itself is counted, but not as
+    // an allocation: its owner allocated it.
+    OctreeMemoryStats getMemoryStatistics() const {
+        OctreeMemoryStats stats;
+        stats.nodeStructBytes = sizeof(BasicOctreeNode);
+        getMemoryStatistics(stats);
+        return stats;
+    }
+
+    void getMemoryStatistics(OctreeMemoryStats& stats) const {
+        TraversalStack<const BasicOctreeNode*, MaxDepth> stack;
+        stack.push(this);
+        while (!stack.empty()) {
+            const BasicOctreeNode* node = stack.pop();
+            stats.nodes++;
+            stats.nodeBytes += sizeof(BasicOctreeNode);
+            stats.points += node->points.size();
+            addPointVector<Allocator>(stats, node->points);
+            if (node != this) {
+                addAllocation<Allocator>(stats, sizeof(BasicOctreeNode));
             }
+            node->pushChildren(stack);
         }
     }
-    
+
     void printStatistics() const {
         int totalNodes = 0, leafNodes = 0, totalPoints = 0, maxDepth = 0;
         getStatistics(totalNodes, leafNodes, totalPoints, maxDepth);
@@ -302,7 +882,20 @@ public:
         std::cout << "Total points: " << totalPoints << std::endl;
         std::cout << "Maximum depth: " << maxDepth << std::endl;
         std::cout << "Average points per leaf: " << (leafNodes > 0 ? (float)totalPoints / leafNodes : 0) << std::endl;
+        printMemoryStatistics(getMemoryStatistics());
+        printInstrumentationStatistics();
     }
 };
 
+// Convenience typedef for the classic octree with default limits
+using OctreeNode = BasicOctreeNode<>;
+
+// Classic octree whose nodes live in a NodeArena
+template <size_t LeafCapacity = 1, int MaxDepth = 20>
+using ArenaOctreeNode = BasicOctreeNode<LeafCapacity, MaxDepth, ArenaAllocator<Point>>;
+
+// Classic octree storing IndexedPoint, so queries return object indices directly
+template <size_t LeafCapacity = 1, int MaxDepth = 20>
+using IndexedOctreeNode = BasicOctreeNode<LeafCapacity, MaxDepth, std::allocator<Point>, IndexedPoint>;
+
 #endif // OCTREE_CLASSIC_H
\ No newline at end of file
@@ -0,0 +1,691 @@
+#ifndef OCTREE_CONCURRENT_H
+#define OCTREE_CONCURRENT_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <queue>
+#include <optional>
+#include <functional>
+#include "point.h"
+#include "octree_query.h"
+#include "octree_options.h"
+#include "vtk_writer.h"
+#include "octree_memory.h"
+#include "octree_traversal.h"
+#include "octree_geometry.h"
+#include "octree_instrumentation.h"
+
+// Octree that one writer can insert into while any number of threads query
+// it. Readers never lock and never wait for the writer:
+//  - leaves store points in fixed-capacity buckets; a point slot is written
+//    before the bucket count is published with a release store, so readers
+//    only ever see fully written points,
+//  - a node is split by building its eight children off to the side and then
+//    publishing the whole child block with a single atomic pointer store,
+//  - a full leaf at the depth limit, or holding a cluster, links an overflow
+//    bucket instead; a cluster leaf is split from all of its buckets once
+//    a point outside the cluster arrives.
+// Nothing reachable by a reader is modified or freed before clear() or the
+// destructor, which must not run concurrently with queries. Writers are
+// serialized by a mutex.
+template <size_t LeafCapacity = 16, int MaxDepth = 20>
+class BasicOctreeConcurrent {
+public:
+    struct Bucket {
+        Point points[LeafCapacity];
+        std::atomic<uint32_t> count{0};
+        std::atomic<Bucket*> next{nullptr};
+    };
+
+    // Frees an overflow chain in a loop, so long chains need no deep stack
+    static void deleteChain(Bucket* bucket) {
+        while (bucket != nullptr) {
+            Bucket* next = bucket->next.load(std::memory_order_relaxed);
+            delete bucket;
+            bucket = next;
+        }
+    }
+
+    struct ChildBlock;
+
+    struct Node {
+        Point min, max;
+        // Midpoint of the box, set together with the bounds
+        Point center;
+        int depth = 0;
+        // Points of a leaf. Once the node is split its bucket is frozen and
+        // only read by queries that loaded the child block before it was set.
+        Bucket bucket;
+        // Last bucket of the chain, where inserts append. Only the writer
+        // uses it, under writeMutex.
+        Bucket* tail = &bucket;
+        std::atomic<ChildBlock*> children{nullptr};
+
+        ~Node() {
+            deleteChain(bucket.next.load(std::memory_order_relaxed));
+            delete children.load(std::memory_order_relaxed);
+        }
+
+        bool contains(const Point& p) const {
+            return p.x >= min.x && p.x <= max.x &&
+                   p.y >= min.y && p.y <= max.y &&
+                   p.z >= min.z && p.z <= max.z;
+        }
+
+        bool boxIntersects(const Point& queryMin, const Point& queryMax) const {
+            return !(max.x < queryMin.x || min.x > queryMax.x ||
+                     max.y < queryMin.y || min.y > queryMax.y ||
+                     max.z < queryMin.z || min.z > queryMax.z);
+        }
+
+        bool boxContainedIn(const Point& queryMin, const Point& queryMax) const {
+            return min.x >= queryMin.x && max.x <= queryMax.x &&
+                   min.y >= queryMin.y && max.y <= queryMax.y &&
+                   min.z >= queryMin.z && max.z <= queryMax.z;
+        }
+
+        float boxDistanceSquared(const Point& q) const {
+            return ::boxDistanceSquared(q, min, max);
+        }
+    };
+
+    // The eight children of a split node, allocated and published together
+    struct ChildBlock {
+        Node nodes[8];
+    };
+
+    // Maximum points per leaf before subdivision
+    static constexpr size_t MAX_POINTS_PER_LEAF = LeafCapacity;
+    static constexpr int MAX_DEPTH = MaxDepth;
+
+    static constexpr OctreeOptions defaultOptions() {
+        return OctreeOptions{static_cast<uint32_t>(LeafCapacity), MaxDepth};
+    }
+
+    BasicOctreeConcurrent(const Point& min, const Point& max)
+        : BasicOctreeConcurrent(min, max, defaultOptions()) {}
+
+    // The bucket size is fixed at compile time, so maxPointsPerLeaf can only
+    // lower LeafCapacity
+    BasicOctreeConcurrent(const Point& min, const Point& max, const OctreeOptions& options)
+        : options(options.clampedTo(MaxDepth)) {
+        this->options.maxPointsPerLeaf = std::min<uint32_t>(this->options.maxPointsPerLeaf,
+                                                            static_cast<uint32_t>(LeafCapacity));
+        root.min = min;
+        root.max = max;
+        root.center = boxCenter(min, max);
+    }
+
+    BasicOctreeConcurrent(const BasicOctreeConcurrent&) = delete;
+    BasicOctreeConcurrent& operator=(const BasicOctreeConcurrent&) = delete;
+
+    // Safe to call while other threads query the tree
+    void insert(const Point& p) {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        if (!root.contains(p)) {
+            std::cout << "Warning: Point (" << p.x << ", " << p.y << ", " << p.z
+                      << ") is outside node bounds" << std::endl;
+            return;
+        }
+        insertLocked(root, p);
+    }
+
+    // Inserts every point under one acquisition of the writer lock
+    void build(const std::vector<Point>& input) {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        size_t outside = 0;
+        for (const auto& p : input) {
+            if (root.contains(p)) {
+                insertLocked(root, p);
+            } else {
+                outside++;
+            }
+        }
+        if (outside > 0) {
+            std::cout << "Warning: " << outside << " points are outside node bounds" << std::endl;
+        }
+    }
+
+    // Remove all points and children. Not safe while other threads query the tree.
+    void clear() {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        delete root.children.exchange(nullptr, std::memory_order_relaxed);
+        deleteChain(root.bucket.next.exchange(nullptr, std::memory_order_relaxed));
+        root.bucket.count.store(0, std::memory_order_relaxed);
+        root.tail = &root.bucket;
+        pointTotal.store(0, std::memory_order_relaxed);
+    }
+
+    // Number of points inserted so far
+    size_t size() const { return pointTotal.load(std::memory_order_acquire); }
+
+    bool contains(const Point& p) const { return root.contains(p); }
+
+    // Collect all points in the octree
+    void collectAllPoints(std::vector<Point>& allPoints) const {
+        forEachPoint([&](const Point& p) { allPoints.push_back(p); });
+    }
+
+    // Collect all node bounding boxes for visualization
+    void collectNodeBoxes(std::vector<std::pair<Point, Point>>& boxes, std::vector<int>& levels) const {
+        collectNodeBoxes(root, boxes, levels);
+    }
+
+    // Export octree to VTK format for ParaView visualization. Binary output is
+    // smaller and much faster to write; ASCII stays readable for debugging.
+    bool exportToVTK(const std::string& filename, VtkFormat format = VtkFormat::Ascii) const {
+        // The writer traverses the tree several times; hold inserts off so
+        // every pass sees the same nodes and points
+        std::lock_guard<std::mutex> lock(writeMutex);
+        if (!writeOctreeVTK(*this, filename, "Concurrent Octree Visualization", format)) {
+            std::cerr << "Error: Could not write file " << filename << std::endl;
+            return false;
+        }
+        std::cout << "Concurrent Octree exported to " << filename << std::endl;
+        std::cout << "Open this file in ParaView to visualize the octree structure!" << std::endl;
+        return true;
+    }
+
+    // Query methods. All of them may run concurrently with insert().
+    std::vector<Point> rangeQuery(const Point& queryMin, const Point& queryMax) const {
+        std::vector<Point> result;
+        rangeQuery(queryMin, queryMax, [&](const Point& p) { result.push_back(p); });
+        return result;
+    }
+
+    // Streams every point inside the box to visit(p), same contract as the other octrees
+    template <typename Visitor>
+    bool rangeQuery(const Point& queryMin, const Point& queryMax, Visitor&& visit) const {
+        return rangeQuery(root, queryMin, queryMax, visit);
+    }
+
+    size_t countInRange(const Point& queryMin, const Point& queryMax) const {
+        size_t count = 0;
+        rangeQuery(queryMin, queryMax, [&](const Point&) { count++; });
+        return count;
+    }
+
+    bool anyInRange(const Point& queryMin, const Point& queryMax) const {
+        return !rangeQuery(queryMin, queryMax, [](const Point&) { return false; });
+    }
+
+    std::vector<Point> radiusQuery(const Point& center, float radius) const {
+        std::vector<Point> result;
+        radiusQuery(center, radius, [&](const Point& p) { result.push_back(p); });
+        return result;
+    }
+
+    template <typename Visitor>
+    bool radiusQuery(const Point& center, float radius, Visitor&& visit) const {
+        return radiusQuery(root, center, radius * radius, visit);
+    }
+
+    std::vector<Point> frustumQuery(const Frustum& frustum) const {
+        std::vector<Point> result;
+        frustumQuery(frustum, [&](const Point& p) { result.push_back(p); });
+        return result;
+    }
+
+    // Points inside the view frustum; subtrees fully inside are emitted whole
+    template <typename Visitor>
+    bool frustumQuery(const Frustum& frustum, Visitor&& visit) const {
+        return frustumQuery(root, frustum, visit);
+    }
+
+    std::vector<Point> rayQuery(const Ray& ray, float radius) const {
+        std::vector<Point> result;
+        rayQuery(ray, radius, [&](const Point& p) { result.push_back(p); });
+        return result;
+    }
+
+    // Points within radius of the ray, cells in the order the ray enters them
+    template <typename Visitor>
+    bool rayQuery(const Ray& ray, float radius, Visitor&& visit) const {
+        const float cutoff = ray.maxDistance;
+        return rayTraverse(root, ray, radius, cutoff, [&](const Node& node) {
+            float t;
+            return visitBuckets(node, [&](const Point& p) {
+                return !ray.hits(p, radius, t) || invokeVisitor(visit, p);
+            });
+        });
+    }
+
+    // First point along the ray within radius of it, or nothing; cells
+    // entered beyond the best hit so far are skipped
+    std::optional<RayHit<Point>> raycast(const Ray& ray, float radius) const {
+        std::optional<RayHit<Point>> best;
+        float cutoff = ray.maxDistance;
+        rayTraverse(root, ray, radius, cutoff, [&](const Node& node) {
+            float t;
+            return visitBuckets(node, [&](const Point& p) {
+                if (ray.hits(p, radius, t) && (!best || t < best->distance)) {
+                    best = RayHit<Point>{p, t};
+                    cutoff = t;
+                }
+                return true;
+            });
+        });
+        return best;
+    }
+
+    template <typename Visitor>
+    bool forEachPoint(Visitor&& visit) const {
+        return forEachPoint(root, visit);
+    }
+
+    // Calls visit(min, max, depth) for every node, parents before children
+    template <typename Visitor>
+    void forEachNode(Visitor&& visit) const {
+        forEachNode(root, visit);
+    }
+
+    // The k points closest to q, closest first, best-first over node bounds
+    std::vector<Point> knn(const Point& q, size_t k) const {
+        if (k == 0) return {};
+        OCTREE_TRACE_SCOPE("knn");
+        KnnCollector<> collector(k);
+
+        using Entry = std::pair<float, const Node*>;
+        auto farther = [](const Entry& a, const Entry& b) { return a.first > b.first; };
+        std::priority_queue<Entry, std::vector<Entry>, decltype(farther)> queue(farther);
+        queue.push({root.boxDistanceSquared(q), &root});
+
+        while (!queue.empty()) {
+            auto [dist, node] = queue.top();
+            queue.pop();
+            if (dist > collector.worstDistanceSquared()) break;
+
+            OCTREE_COUNT(NodesVisited, 1);
+            const ChildBlock* block = node->children.load(std::memory_order_acquire);
+            if (block == nullptr) {
+                visitBuckets(*node, [&](const Point& p) {
+                    OCTREE_COUNT(PointsTested, 1);
+                    collector.offer(p, distanceSquared(p, q));
+                });
+                continue;
+            }
+            for (const Node& child : block->nodes) {
+                float childDist = child.boxDistanceSquared(q);
+                if (childDist <= collector.worstDistanceSquared()) {
+                    queue.push({childDist, &child});
+                }
+            }
+        }
+        return collector.sortedPoints();
+    }
+
+    // Closest point to q, or nothing if the tree is empty
+    std::optional<Point> nearest(const Point& q) const {
+        std::vector<Point> result = knn(q, 1);
+        if (result.empty()) return std::nullopt;
+        return result.front();
+    }
+
+    // Get statistics about the octree
+    void getStatistics(int& totalNodes, int& leafNodes, int& totalPoints, int& maxDepth) const {
+        getStatistics(root, totalNodes, leafNodes, totalPoints, maxDepth);
+    }
+
+    // Heap footprint of the tree. Leaf buckets count as point storage;
+    // the frozen buckets of a split node count entirely as unused capacity.
+    OctreeMemoryStats getMemoryStatistics() const {
+        OctreeMemoryStats stats;
+        stats.nodeStructBytes = sizeof(Node);
+        getMemoryStatistics(root, stats);
+        return stats;
+    }
+
+    void printStatistics() const {
+        int totalNodes = 0, leafNodes = 0, totalPoints = 0, maxDepth = 0;
+        getStatistics(totalNodes, leafNodes, totalPoints, maxDepth);
+
+        std::cout << "=== Concurrent Octree Statistics ===" << std::endl;
+        std::cout << "Total nodes: " << totalNodes << std::endl;
+        std::cout << "Leaf nodes: " << leafNodes << std::endl;
+        std::cout << "Internal nodes: " << (totalNodes - leafNodes) << std::endl;
+        std::cout << "Total points: " << totalPoints << std::endl;
+        std::cout << "Maximum depth: " << maxDepth << std::endl;
+        std::cout << "Average points per leaf: " << (leafNodes > 0 ? (float)totalPoints / leafNodes : 0) << std::endl;
+        printMemoryStatistics(getMemoryStatistics());
+        printInstrumentationStatistics();
+    }
+
+private:
+    // Caller holds writeMutex
+    void insertLocked(Node& start, const Point& p) {
+        placePoint(start, p);
+        pointTotal.fetch_add(1, std::memory_order_release);
+    }
+
+    // Stores p in the subtree of start, splitting full leaves on the way.
+    // Also fills the children subdivide() builds before they are published.
+    void placePoint(Node& start, const Point& p) {
+        Node* node = &start;
+        for (;;) {
+            ChildBlock* block = node->children.load(std::memory_order_relaxed);
+            if (block != nullptr) {
+                node = &block->nodes[getOctant(*node, p)];
+                continue;
+            }
+
+            Bucket* bucket = node->tail;
+            uint32_t count = bucket->count.load(std::memory_order_relaxed);
+            // An overflowed leaf is split as soon as p may break it up, even
+            // with room left in its last bucket
+            const bool overflowed = bucket != &node->bucket;
+            if ((overflowed || count >= options.maxPointsPerLeaf) && splittable(*node, p)) {
+                subdivide(*node);
+                continue;
+            }
+
+            if (count < options.maxPointsPerLeaf) {
+                bucket->points[count] = p;
+                bucket->count.store(count + 1, std::memory_order_release);
+                return;
+            }
+
+            // Depth or size limit, or a cluster: chain another bucket onto the leaf
+            Bucket* overflow = new Bucket();
+            overflow->points[0] = p;
+            overflow->count.store(1, std::memory_order_relaxed);
+            bucket->next.store(overflow, std::memory_order_release);
+            node->tail = overflow;
+            return;
+        }
+    }
+
+    // True if the full or overflowed leaf may be split to make room for p.
+    // A leaf above the limits only overflows while it holds a cluster, so
+    // once it has an overflow bucket only p needs checking, which keeps
+    // inserting into a cluster O(1).
+    bool splittable(const Node& node, const Point& p) const {
+        if (node.depth >= options.maxDepth || !options.allowsSplit(node.min, node.max)) {
+            return false;
+        }
+        const Point& anchor = node.bucket.points[0];
+        if (!options.inCluster(anchor, p)) return true;
+        if (node.tail != &node.bucket) return false;
+        uint32_t count = node.bucket.count.load(std::memory_order_relaxed);
+        for (uint32_t i = 1; i < count; ++i) {
+            if (!options.inCluster(anchor, node.bucket.points[i])) return true;
+        }
+        return false;
+    }
+
+    // Build the children of a full leaf privately from every bucket of its
+    // chain, then publish them at once. The buckets stay as they are for
+    // readers that loaded the leaf before the store.
+    void subdivide(Node& node) {
+        ChildBlock* block = new ChildBlock();
+        for (int octant = 0; octant < 8; ++octant) {
+            Node& child = block->nodes[octant];
+            calculateChildBounds(node, octant, child.min, child.max);
+            child.center = boxCenter(child.min, child.max);
+            child.depth = node.depth + 1;
+        }
+
+        for (const Bucket* bucket = &node.bucket; bucket != nullptr;
+             bucket = bucket->next.load(std::memory_order_relaxed)) {
+            uint32_t count = bucket->count.load(std::memory_order_relaxed);
+            for (uint32_t i = 0; i < count; ++i) {
+                const Point& p = bucket->points[i];
+                placePoint(block->nodes[getOctant(node, p)], p);
+            }
+        }
+
+        node.children.store(block, std::memory_order_release);
+    }
+
+    static int getOctant(const Node& node, const Point& p) {
+        return octantOf(p, node.center);
+    }
+
+    static void calculateChildBounds(const Node& node, int octant, Point& childMin, Point& childMax) {
+        const Point& center = node.center;
+        childMin.x = (octant & 1) ? center.x : node.min.x;
+        childMin.y = (octant & 2) ? center.y : node.min.y;
+        childMin.z = (octant & 4) ? center.z : node.min.z;
+        childMax.x = (octant & 1) ? node.max.x : center.x;
+        childMax.y = (octant & 2) ? node.max.y : center.y;
+        childMax.z = (octant & 4) ? node.max.z : center.z;
+    }
+
+    // Calls visit(p) for every point in the buckets of a leaf
+    template <typename Visitor>
+    static bool visitBuckets(const Node& node, Visitor&& visit) {
+        for (const Bucket* bucket = &node.bucket; bucket != nullptr;
+             bucket = bucket->next.load(std::memory_order_acquire)) {
+            uint32_t count = bucket->count.load(std::memory_order_acquire);
+            for (uint32_t i = 0; i < count; ++i) {
+                if (!invokeVisitor(visit, bucket->points[i])) return false;
+            }
+        }
+        return true;
+    }
+
+    template <typename Visitor>
+    static bool forEachPoint(const Node& start, Visitor& visit) {
+        TraversalStack<const Node*, MaxDepth> stack;
+        stack.push(&start);
+        while (!stack.empty()) {
+            const Node& node = *stack.pop();
+            const ChildBlock* block = node.children.load(std::memory_order_acquire);
+            if (block == nullptr) {
+                if (!visitBuckets(node, visit)) return false;
+                continue;
+            }
+            pushChildren(*block, stack);
+        }
+        return true;
+    }
+
+    template <typename Visitor>
+    static void forEachNode(const Node& start, Visitor& visit) {
+        TraversalStack<const Node*, MaxDepth> stack;
+        stack.push(&start);
+        while (!stack.empty()) {
+            const Node& node = *stack.pop();
+            visit(node.min, node.max, node.depth);
+            const ChildBlock* block = node.children.load(std::memory_order_acquire);
+            if (block != nullptr) {
+                pushChildren(*block, stack);
+            }
+        }
+    }
+
+    template <typename Visitor>
+    static bool rangeQuery(const Node& start, const Point& queryMin, const Point& queryMax, Visitor& visit) {
+        OCTREE_TRACE_SCOPE("rangeQuery");
+        TraversalStack<const Node*, MaxDepth> stack;
+        stack.push(&start);
+        while (!stack.empty()) {
+            const Node& node = *stack.pop();
+            OCTREE_COUNT(NodesVisited, 1);
+            if (!node.boxIntersects(queryMin, queryMax)) {
+                OCTREE_COUNT(NodesPruned, 1);
+                continue;
+            }
+            if (node.boxContainedIn(queryMin, queryMax)) {
+                OCTREE_COUNT(SubtreesAccepted, 1);
+                auto matched = [&](const Point& p) {
+                    OCTREE_COUNT(PointsMatched, 1);
+                    return invokeVisitor(visit, p);
+                };
+                if (!forEachPoint(node, matched)) return false;
+                continue;
+            }
+
+            const ChildBlock* block = node.children.load(std::memory_order_acquire);
+            if (block == nullptr) {
+                bool more = visitBuckets(node, [&](const Point& p) {
+                    OCTREE_COUNT(PointsTested, 1);
+                    if (p.x >= queryMin.x && p.x <= queryMax.x &&
+                        p.y >= queryMin.y && p.y <= queryMax.y &&
+                        p.z >= queryMin.z && p.z <= queryMax.z) {
+                        OCTREE_COUNT(PointsMatched, 1);
+                        return invokeVisitor(visit, p);
+                    }
+                    return true;
+                });
+                if (!more) return false;
+                continue;
+            }
+            pushChildren(*block, stack);
+        }
+        return true;
+    }
+
+    template <typename Visitor>
+    static bool radiusQuery(const Node& start, const Point& center, float radiusSquared, Visitor& visit) {
+        TraversalStack<const Node*, MaxDepth> stack;
+        stack.push(&start);
+        while (!stack.empty()) {
+            const Node& node = *stack.pop();
+            if (node.boxDistanceSquared(center) > radiusSquared) {
+                continue;
+            }
+            if (::boxMaxDistanceSquared(center, node.min, node.max) <= radiusSquared) {
+                if (!forEachPoint(node, visit)) return false;
+                continue;
+            }
+
+            const ChildBlock* block = node.children.load(std::memory_order_acquire);
+            if (block == nullptr) {
+                bool more = visitBuckets(node, [&](const Point& p) {
+                    if (distanceSquared(p, center) <= radiusSquared) {
+                        return invokeVisitor(visit, p);
+                    }
+                    return true;
+                });
+                if (!more) return false;
+                continue;
+            }
+            pushChildren(*block, stack);
+        }
+        return true;
+    }
+
+    template <typename Visitor>
+    static bool frustumQuery(const Node& start, const Frustum& frustum, Visitor& visit) {
+        TraversalStack<const Node*, MaxDepth> stack;
+        stack.push(&start);
+        while (!stack.empty()) {
+            const Node& node = *stack.pop();
+            BoxRelation relation = frustum.classify(node.min, node.max);
+            if (relation == BoxRelation::Outside) {
+                continue;
+            }
+            if (relation == BoxRelation::Inside) {
+                if (!forEachPoint(node, visit)) return false;
+                continue;
+            }
+
+            const ChildBlock* block = node.children.load(std::memory_order_acquire);
+            if (block == nullptr) {
+                bool more = visitBuckets(node, [&](const Point& p) {
+                    if (frustum.contains(p)) {
+                        return invokeVisitor(visit, p);
+                    }
+                    return true;
+                });
+                if (!more) return false;
+                continue;
+            }
+            pushChildren(*block, stack);
+        }
+        return true;
+    }
+
+    // Front-to-back walk over the cells near the ray, see ::rayTraverse;
+    // visitLeaf(node) is called for the leaves only
+    template <typename VisitLeaf>
+    static bool rayTraverse(const Node& start, const Ray& ray, float radius, const float& cutoff, VisitLeaf&& visitLeaf) {
+        return ::rayTraverse<MaxDepth>(
+            ray, radius, cutoff, &start,
+            [](const Node* node) -> const Node& { return *node; },
+            [](const Node* node, RayChildOrder<const Node*>& children) {
+                const ChildBlock* block = node->children.load(std::memory_order_acquire);
+                if (block != nullptr) pushChildren(*block, children);
+            },
+            [&](const Node* node) {
+                if (node->children.load(std::memory_order_acquire) != nullptr) return true;
+                return visitLeaf(*node);
+            });
+    }
+
+    static void collectNodeBoxes(const Node& start, std::vector<std::pair<Point, Point>>& boxes, std::vector<int>& levels) {
+        auto visit = [&](const Point& nodeMin, const Point& nodeMax, int level) {
+            boxes.push_back({nodeMin, nodeMax});
+            levels.push_back(level);
+        };
+        forEachNode(start, visit);
+    }
+
+    static void getStatistics(const Node& start, int& totalNodes, int& leafNodes, int& totalPoints, int& maxDepth) {
+        TraversalStack<const Node*, MaxDepth> stack;
+        stack.push(&start);
+        while (!stack.empty()) {
+            const Node& node = *stack.pop();
+            totalNodes++;
+            maxDepth = std::max(maxDepth, node.depth);
+            const ChildBlock* block = node.children.load(std::memory_order_acquire);
+            if (block == nullptr) {
+                leafNodes++;
+                visitBuckets(node, [&](const Point&) { totalPoints++; });
+                continue;
+            }
+            pushChildren(*block, stack);
+        }
+    }
+
+    static void getMemoryStatistics(const Node& start, OctreeMemoryStats& stats) {
+        const size_t slotBytes = sizeof(Bucket::points);
+        TraversalStack<const Node*, MaxDepth> stack;
+        stack.push(&start);
+        while (!stack.empty()) {
+            const Node& node = *stack.pop();
+            const ChildBlock* block = node.children.load(std::memory_order_acquire);
+            stats.nodes++;
+            stats.nodeBytes += sizeof(Node) - slotBytes;
+            for (const Bucket* bucket = &node.bucket; bucket != nullptr;
+                 bucket = bucket->next.load(std::memory_order_acquire)) {
+                if (bucket != &node.bucket) {
+                    stats.nodeBytes += sizeof(Bucket) - slotBytes;
+                    addAllocation(stats, sizeof(Bucket));
+                }
+                size_t used = block == nullptr ? bucket->count.load(std::memory_order_acquire) * sizeof(Point) : 0;
+                stats.pointBytes += used;
+                stats.pointSlackBytes += slotBytes - used;
+                if (block == nullptr) stats.points += bucket->count.load(std::memory_order_acquire);
+            }
+            if (block == nullptr) continue;
+            addAllocation(stats, sizeof(ChildBlock));
+            pushChildren(*block, stack);
+        }
+    }
+
+    // Push the eight children of a block for a depth-first walk, last octant
+    // first so that octant 0 pops next. Each node spans several cache lines
+    // because of its bucket, so the box at the start of each is prefetched.
+    template <typename Stack>
+    static void pushChildren(const ChildBlock& block, Stack& stack) {
+        for (int octant = 7; octant >= 0; --octant) {
+            prefetchRead(&block.nodes[octant]);
+            stack.push(&block.nodes[octant]);
+        }
+    }
+
+    Node root;
+    OctreeOptions options;
+    std::atomic<size_t> pointTotal{0};
+    mutable std::mutex writeMutex;
+};
+
+// Convenience typedef for the concurrent octree with default limits
+using OctreeConcurrent = BasicOctreeConcurrent<>;
+
+#endif // OCTREE_CONCURRENT_H
@@ -0,0 +1,306 @@
+#ifndef OCTREE_DUAL_H
+#define OCTREE_DUAL_H
+
+#include <cstddef>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+#include "point.h"
+#include "octree_traversal.h"
+#include "thread_pool.h"
+
+// Dual-tree joins between pointer octrees (BasicOctreeNode,
+// BasicOctreeHashMapNode, BasicOctreeMortonNode, mixed freely). Instead of
+// one radius query per point, the walk descends both trees at once over
+// pairs of nodes. A pair whose tight bounds are farther apart than the
+// radius is dropped with every point pair under it, and a pair whose bounds
+// lie entirely within the radius emits all its point pairs untested; only
+// the pairs in between are split, down to leaf pairs compared point by point.
+
+// Squared distance between the closest points of two boxes (0 if they overlap)
+inline float boxBoxDistanceSquared(const Point& aMin, const Point& aMax, const Point& bMin, const Point& bMax) {
+    float dx = std::max({0.0f, aMin.x - bMax.x, bMin.x - aMax.x});
+    float dy = std::max({0.0f, aMin.y - bMax.y, bMin.y - aMax.y});
+    float dz = std::max({0.0f, aMin.z - bMax.z, bMin.z - aMax.z});
+    return dx * dx + dy * dy + dz * dz;
+}
+
+// Squared distance between the farthest points of two boxes
+inline float boxBoxMaxDistanceSquared(const Point& aMin, const Point& aMax, const Point& bMin, const Point& bMax) {
+    float dx = std::max(aMax.x - bMin.x, bMax.x - aMin.x);
+    float dy = std::max(aMax.y - bMin.y, bMax.y - aMin.y);
+    float dz = std::max(aMax.z - bMin.z, bMax.z - aMin.z);
+    return dx * dx + dy * dy + dz * dz;
+}
+
+// Pair walk behind radiusJoin and selfJoin. In a self-join both sides are
+// the same tree and a pair of a node with itself stands for the unordered
+// pairs of distinct points under it, so every pair is reported once.
+template <typename TreeA, typename TreeB>
+class DualTreeWalk {
+public:
+    using PointA = typename TreeA::value_type;
+    using PointB = typename TreeB::value_type;
+    using Result = std::vector<std::pair<PointA, PointB>>;
+
+    struct Pair {
+        const TreeA* a;
+        const TreeB* b;
+    };
+
+    DualTreeWalk(float radius, bool self) : radiusSquared(radius * radius), self(self) {}
+
+    // Calls visit(pa, pb) for the point pairs under pair within the radius,
+    // depth-first. A visitor returning bool can stop the walk; the result is
+    // false if it did.
+    template <typename Visitor>
+    bool run(const Pair& root, Visitor& visit) const {
+        TraversalStack<Pair, STACK_DEPTH> stack;
+        stack.push(root);
+        Pair children[MAX_SPLIT];
+        while (!stack.empty()) {
+            Pair pair = stack.pop();
+            Step step = classify(pair);
+            if (step == Step::Prune) continue;
+            if (step == Step::Emit) {
+                if (!emit(pair, visit)) return false;
+                continue;
+            }
+            // Reversed, so that the pairs pop in split order
+            for (int i = split(pair, children); i-- > 0;) {
+                stack.push(children[i]);
+            }
+        }
+        return true;
+    }
+
+    // run() collecting the pairs, with the work spread over the pool: the
+    // top pairs are split breadth-first, in walk order, until there are
+    // several per thread, and each is then walked as one task. The result
+    // is the same, in the same order, as a sequential walk.
+    Result runParallel(const Pair& root, ThreadPool& pool) const {
+        std::vector<Pair> frontier = {root};
+        const size_t targetPairs = pool.size() * 8;
+        Pair children[MAX_SPLIT];
+        while (pool.size() > 1 && frontier.size() < targetPairs) {
+            std::vector<Pair> next;
+            bool changed = false;
+            for (const Pair& pair : frontier) {
+                Step step = classify(pair);
+                if (step == Step::Emit) {
+                    next.push_back(pair);
+                    continue;
+                }
+                changed = true;
+                if (step == Step::Split) {
+                    int count = split(pair, children);
+                    next.insert(next.end(), children, children + count);
+                }
+            }
+            frontier.swap(next);
+            if (!changed) break;
+        }
+
+        std::vector<Result> parts(frontier.size());
+        parallelFor(pool, frontier.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                Result& part = parts[i];
+                auto collect = [&](const PointA& p, const PointB& q) { part.emplace_back(p, q); };
+                run(frontier[i], collect);
+            }
+        });
+
+        size_t total = 0;
+        for (const Result& part : parts) total += part.size();
+        Result result;
+        result.reserve(total);
+        for (const Result& part : parts) result.insert(result.end(), part.begin(), part.end());
+        return result;
+    }
+
+private:
+    // A self pair splits into the 36 unordered pairs of its children
+    static constexpr int MAX_SPLIT = 36;
+    // A split leaves at most 7 waiting pairs per level of either tree, or
+    // 35 when a self pair splits both at once: 7 * STACK_DEPTH + 8 covers both
+    static constexpr int STACK_DEPTH = 5 * (TreeA::MAX_DEPTH + TreeB::MAX_DEPTH) + 4;
+
+    enum class Step {
+        Prune,
+        Emit,
+        Split
+    };
+
+    // Stand-in stack for pushChildren, which pushes the last child first
+    template <typename Tree>
+    struct ChildList {
+        const Tree* nodes[8];
+        int count = 0;
+        void push(const Tree* node) { nodes[count++] = node; }
+        const Tree* operator[](int i) const { return nodes[count - 1 - i]; }
+    };
+
+    bool isSelf(const Pair& pair) const {
+        return self && static_cast<const void*>(pair.a) == static_cast<const void*>(pair.b);
+    }
+
+    Step classify(const Pair& pair) const {
+        const auto& a = pair.a->aggregate;
+        const auto& b = pair.b->aggregate;
+        if (a.empty() || b.empty()) return Step::Prune;
+        if (boxBoxDistanceSquared(a.min, a.max, b.min, b.max) > radiusSquared) return Step::Prune;
+        if (pair.a->isLeaf() && pair.b->isLeaf()) return Step::Emit;
+        if (!isSelf(pair) && boxBoxMaxDistanceSquared(a.min, a.max, b.min, b.max) <= radiusSquared) {
+            return Step::Emit;
+        }
+        return Step::Split;
+    }
+
+    // Point pairs of an emitted pair: all of them when its bounds are within
+    // the radius, otherwise those of two leaves that pass the distance test
+    template <typename Visitor>
+    bool emit(const Pair& pair, Visitor& visit) const {
+        if constexpr (std::is_same_v<TreeA, TreeB>) {
+            if (isSelf(pair)) {
+                const auto& points = pair.a->points;
+                for (size_t i = 0; i < points.size(); ++i) {
+                    for (size_t j = i + 1; j < points.size(); ++j) {
+                        if (distanceSquared(points[i], points[j]) <= radiusSquared &&
+                            !invokePair(visit, points[i], points[j])) {
+                            return false;
+                        }
+                    }
+                }
+                return true;
+            }
+        }
+        const auto& a = pair.a->aggregate;
+        const auto& b = pair.b->aggregate;
+        const bool all = boxBoxMaxDistanceSquared(a.min, a.max, b.min, b.max) <= radiusSquared;
+        if (pair.a->isLeaf() && pair.b->isLeaf()) {
+            for (const PointA& p : pair.a->points) {
+                for (const PointB& q : pair.b->points) {
+                    if ((all || distanceSquared(p, q) <= radiusSquared) && !invokePair(visit, p, q)) return false;
+                }
+            }
+            return true;
+        }
+        return pair.a->forEachPoint([&](const PointA& p) {
+            return pair.b->forEachPoint([&](const PointB& q) {
+                if (!all && distanceSquared(p, q) > radiusSquared) return true;
+                return invokePair(visit, p, q);
+            });
+        });
+    }
+
+    // Children of a split pair, in walk order; returns their number. The
+    // side with the larger cell is split, so both descend at a similar scale.
+    int split(const Pair& pair, Pair* out) const {
+        int count = 0;
+        if constexpr (std::is_same_v<TreeA, TreeB>) {
+            if (isSelf(pair)) {
+                ChildList<TreeA> children;
+                pair.a->pushChildren(children);
+                for (int i = 0; i < children.count; ++i) {
+                    for (int j = i; j < children.count; ++j) out[count++] = Pair{children[i], children[j]};
+                }
+                return count;
+            }
+        }
+        if (!pair.a->isLeaf() && (pair.b->isLeaf() || longestSide(*pair.a) >= longestSide(*pair.b))) {
+            ChildList<TreeA> children;
+            pair.a->pushChildren(children);
+            for (int i = 0; i < children.count; ++i) out[count++] = Pair{children[i], pair.b};
+        } else {
+            ChildList<TreeB> children;
+            pair.b->pushChildren(children);
+            for (int i = 0; i < children.count; ++i) out[count++] = Pair{pair.a, children[i]};
+        }
+        return count;
+    }
+
+    template <typename Tree>
+    static float longestSide(const Tree& node) {
+        return std::max({node.max.x - node.min.x, node.max.y - node.min.y, node.max.z - node.min.z});
+    }
+
+    // invokeVisitor for a visitor of two points
+    template <typename Visitor>
+    static bool invokePair(Visitor& visit, const PointA& p, const PointB& q) {
+        if constexpr (std::is_same_v<std::invoke_result_t<Visitor&, const PointA&, const PointB&>, bool>) {
+            return visit(p, q);
+        } else {
+            visit(p, q);
+            return true;
+        }
+    }
+
+    float radiusSquared;
+    bool self;
+};
+
+// Calls visit(pa, pb) for every point pa of a and pb of b within radius of
+// each other. A visitor returning bool stops the join by returning false.
+template <typename TreeA, typename TreeB, typename Visitor>
+bool radiusJoin(const TreeA& a, const TreeB& b, float radius, Visitor&& visit) {
+    if (!(radius >= 0.0f)) return true;
+    DualTreeWalk<TreeA, TreeB> walk(radius, false);
+    return walk.run({&a, &b}, visit);
+}
+
+template <typename TreeA, typename TreeB>
+typename DualTreeWalk<TreeA, TreeB>::Result radiusJoin(const TreeA& a, const TreeB& b, float radius) {
+    typename DualTreeWalk<TreeA, TreeB>::Result result;
+    radiusJoin(a, b, radius, [&](const auto& p, const auto& q) { result.emplace_back(p, q); });
+    return result;
+}
+
+// radiusJoin over node-pair tasks on a pool; same pairs in the same order.
+// threadCount == 0 uses every hardware thread.
+template <typename TreeA, typename TreeB>
+typename DualTreeWalk<TreeA, TreeB>::Result radiusJoinParallel(const TreeA& a, const TreeB& b, float radius,
+                                                               ThreadPool& pool) {
+    if (!(radius >= 0.0f)) return {};
+    DualTreeWalk<TreeA, TreeB> walk(radius, false);
+    return walk.runParallel({&a, &b}, pool);
+}
+
+template <typename TreeA, typename TreeB>
+typename DualTreeWalk<TreeA, TreeB>::Result radiusJoinParallel(const TreeA& a, const TreeB& b, float radius,
+                                                               size_t threadCount = 0) {
+    ThreadPool pool(threadCount);
+    return radiusJoinParallel(a, b, radius, pool);
+}
+
+// Calls visit(p, q) once for every unordered pair of distinct stored points
+// of tree within radius of each other. Coincident points stored twice are
+// two points, and pair up.
+template <typename Tree, typename Visitor>
+bool selfJoin(const Tree& tree, float radius, Visitor&& visit) {
+    if (!(radius >= 0.0f)) return true;
+    DualTreeWalk<Tree, Tree> walk(radius, true);
+    return walk.run({&tree, &tree}, visit);
+}
+
+template <typename Tree>
+typename DualTreeWalk<Tree, Tree>::Result selfJoin(const Tree& tree, float radius) {
+    typename DualTreeWalk<Tree, Tree>::Result result;
+    selfJoin(tree, radius, [&](const auto& p, const auto& q) { result.emplace_back(p, q); });
+    return result;
+}
+
+template <typename Tree>
+typename DualTreeWalk<Tree, Tree>::Result selfJoinParallel(const Tree& tree, float radius, ThreadPool& pool) {
+    if (!(radius >= 0.0f)) return {};
+    DualTreeWalk<Tree, Tree> walk(radius, true);
+    return walk.runParallel({&tree, &tree}, pool);
+}
+
+template <typename Tree>
+typename DualTreeWalk<Tree, Tree>::Result selfJoinParallel(const Tree& tree, float radius, size_t threadCount = 0) {
+    ThreadPool pool(threadCount);
+    return selfJoinParallel(tree, radius, pool);
+}
+
+#endif // OCTREE_DUAL_H
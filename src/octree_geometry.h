@@ -0,0 +1,268 @@
+#ifndef OCTREE_GEOMETRY_H
+#define OCTREE_GEOMETRY_H
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include "point.h"
+#include "octree_traversal.h"
+
+// Geometry of the rendering queries: view frustums tested against node boxes
+// and rays walked through the cells they pass. Both work on the min/max
+// bounds every octree node keeps.
+
+inline float dotProduct(const Point& a, const Point& b) {
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+inline Point crossProduct(const Point& a, const Point& b) {
+    return Point(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+// v scaled to unit length; a zero vector stays zero
+inline Point normalized(const Point& v) {
+    float length = std::sqrt(dotProduct(v, v));
+    if (!(length > 0.0f)) return v;
+    return Point(v.x / length, v.y / length, v.z / length);
+}
+
+// Plane of the points p with dot(normal, p) + d == 0. Points with a
+// non-negative signed distance are on the inner side.
+struct Plane {
+    Point normal;
+    float d;
+
+    Plane() : normal(), d(0.0f) {}
+    Plane(const Point& normal, float d) : normal(normal), d(d) {}
+
+    // Plane through point with the given inward normal
+    static Plane through(const Point& point, const Point& inwardNormal) {
+        Point n = normalized(inwardNormal);
+        return Plane(n, -dotProduct(n, point));
+    }
+
+    float signedDistance(const Point& p) const { return dotProduct(normal, p) + d; }
+};
+
+// Where a box lies relative to a frustum
+enum class BoxRelation {
+    Outside,
+    Intersecting,
+    Inside
+};
+
+// Convex volume bounded by six planes facing inwards (left, right, bottom,
+// top, near, far). A point on a plane counts as inside.
+struct Frustum {
+    Plane planes[6];
+
+    // Frustum of a column-major 4x4 view-projection matrix with clip space
+    // z in [-w, w] (the OpenGL convention): each plane is the sum or
+    // difference of the fourth row and one of the others (Gribb-Hartmann).
+    static Frustum fromMatrix(const float m[16]) {
+        auto row = [&](int r, float& x, float& y, float& z, float& w) {
+            x = m[r];
+            y = m[4 + r];
+            z = m[8 + r];
+            w = m[12 + r];
+        };
+        float x3, y3, z3, w3;
+        row(3, x3, y3, z3, w3);
+        Frustum frustum;
+        for (int axis = 0; axis < 3; ++axis) {
+            float x, y, z, w;
+            row(axis, x, y, z, w);
+            frustum.planes[2 * axis] = normalizedPlane(x3 + x, y3 + y, z3 + z, w3 + w);
+            frustum.planes[2 * axis + 1] = normalizedPlane(x3 - x, y3 - y, z3 - z, w3 - w);
+        }
+        return frustum;
+    }
+
+    // Perspective frustum of a camera at eye looking along forward, with a
+    // vertical field of view in radians and aspect = width / height
+    static Frustum perspective(const Point& eye, const Point& forward, const Point& up,
+                               float fovY, float aspect, float nearDistance, float farDistance) {
+        Point f = normalized(forward);
+        Point r = normalized(crossProduct(f, up));
+        Point u = crossProduct(r, f);
+        float halfHeight = std::tan(fovY * 0.5f);
+        float halfWidth = halfHeight * aspect;
+        auto combine = [](const Point& a, float sa, const Point& b, float sb) {
+            return Point(a.x * sa + b.x * sb, a.y * sa + b.y * sb, a.z * sa + b.z * sb);
+        };
+
+        Frustum frustum;
+        frustum.planes[0] = Plane::through(eye, combine(r, 1.0f, f, halfWidth));
+        frustum.planes[1] = Plane::through(eye, combine(r, -1.0f, f, halfWidth));
+        frustum.planes[2] = Plane::through(eye, combine(u, 1.0f, f, halfHeight));
+        frustum.planes[3] = Plane::through(eye, combine(u, -1.0f, f, halfHeight));
+        frustum.planes[4] = Plane::through(combine(eye, 1.0f, f, nearDistance), f);
+        frustum.planes[5] = Plane::through(combine(eye, 1.0f, f, farDistance), Point(-f.x, -f.y, -f.z));
+        return frustum;
+    }
+
+    bool contains(const Point& p) const {
+        for (const Plane& plane : planes) {
+            if (plane.signedDistance(p) < 0.0f) return false;
+        }
+        return true;
+    }
+
+    // Classify the box [min, max]: per plane, the corner farthest along the
+    // normal decides whether the box is outside it and the nearest corner
+    // whether the box is entirely on its inner side. Boxes near a frustum
+    // corner may be reported Intersecting while lying outside; the per-point
+    // test settles those.
+    BoxRelation classify(const Point& min, const Point& max) const {
+        BoxRelation relation = BoxRelation::Inside;
+        for (const Plane& plane : planes) {
+            const Point& n = plane.normal;
+            Point farCorner(n.x >= 0.0f ? max.x : min.x, n.y >= 0.0f ? max.y : min.y, n.z >= 0.0f ? max.z : min.z);
+            if (plane.signedDistance(farCorner) < 0.0f) return BoxRelation::Outside;
+            Point nearCorner(n.x >= 0.0f ? min.x : max.x, n.y >= 0.0f ? min.y : max.y, n.z >= 0.0f ? min.z : max.z);
+            if (plane.signedDistance(nearCorner) < 0.0f) relation = BoxRelation::Intersecting;
+        }
+        return relation;
+    }
+
+private:
+    static Plane normalizedPlane(float x, float y, float z, float w) {
+        float length = std::sqrt(x * x + y * y + z * z);
+        if (!(length > 0.0f)) return Plane(Point(x, y, z), w);
+        return Plane(Point(x / length, y / length, z / length), w / length);
+    }
+};
+
+// The points origin + t * direction for t in [0, maxDistance], with the
+// direction normalized on construction so that t is a distance. An infinite
+// maxDistance makes it a ray, a finite one a segment.
+struct Ray {
+    Point origin;
+    Point direction;
+    float maxDistance;
+
+    Ray(const Point& origin, const Point& direction, float maxDistance = std::numeric_limits<float>::infinity())
+        : origin(origin), direction(normalized(direction)), maxDistance(maxDistance) {}
+
+    // Segment from a to b
+    static Ray segment(const Point& a, const Point& b) {
+        Point delta(b.x - a.x, b.y - a.y, b.z - a.z);
+        return Ray(a, delta, std::sqrt(dotProduct(delta, delta)));
+    }
+
+    Point at(float t) const {
+        return Point(origin.x + direction.x * t, origin.y + direction.y * t, origin.z + direction.z * t);
+    }
+
+    // Slab test against the box [min, max] grown by margin on every side:
+    // the range [enter, exit] of t inside it, clipped to [0, maxDistance].
+    // False if the ray misses the box.
+    bool intersectBox(const Point& min, const Point& max, float margin, float& enter, float& exit) const {
+        const float lo[3] = {min.x - margin, min.y - margin, min.z - margin};
+        const float hi[3] = {max.x + margin, max.y + margin, max.z + margin};
+        const float o[3] = {origin.x, origin.y, origin.z};
+        const float d[3] = {direction.x, direction.y, direction.z};
+        enter = 0.0f;
+        exit = maxDistance;
+        for (int axis = 0; axis < 3; ++axis) {
+            if (d[axis] == 0.0f) {
+                // Parallel to the slab: inside it everywhere or nowhere
+                if (o[axis] < lo[axis] || o[axis] > hi[axis]) return false;
+                continue;
+            }
+            float inverse = 1.0f / d[axis];
+            float t0 = (lo[axis] - o[axis]) * inverse;
+            float t1 = (hi[axis] - o[axis]) * inverse;
+            if (t0 > t1) std::swap(t0, t1);
+            enter = std::max(enter, t0);
+            exit = std::min(exit, t1);
+            if (enter > exit) return false;
+        }
+        return true;
+    }
+
+    // True if p lies within radius of the ray; t is then the distance along
+    // the ray of the ray point closest to p
+    bool hits(const Point& p, float radius, float& t) const {
+        Point offset(p.x - origin.x, p.y - origin.y, p.z - origin.z);
+        t = std::min(std::max(dotProduct(offset, direction), 0.0f), maxDistance);
+        return distanceSquared(p, at(t)) <= radius * radius;
+    }
+};
+
+// Nearest point a raycast found and its distance along the ray
+template <typename PointType = Point>
+struct RayHit {
+    PointType point;
+    float distance;
+};
+
+// Pending cell of a ray walk and the distance at which the ray enters it
+template <typename NodeRef>
+struct RayEntry {
+    NodeRef node;
+    float enter;
+};
+
+// Stand-in stack handed to a tree's pushChildren: it collects the children
+// and pushes the ones the ray passes within margin of onto the walk's stack,
+// farthest first so that they pop front to back.
+template <typename NodeRef>
+class RayChildOrder {
+public:
+    void push(const NodeRef& node) { pending[count++] = node; }
+
+    template <typename Resolve, typename Stack>
+    void pushOrdered(const Ray& ray, float margin, Resolve& resolve, Stack& stack) {
+        RayEntry<NodeRef> hit[8];
+        int hitCount = 0;
+        for (int i = 0; i < count; ++i) {
+            const auto& node = resolve(pending[i]);
+            float enter, exit;
+            if (!ray.intersectBox(node.min, node.max, margin, enter, exit)) continue;
+            // Insertion sort, nearest first
+            int j = hitCount++;
+            while (j > 0 && hit[j - 1].enter > enter) {
+                hit[j] = hit[j - 1];
+                --j;
+            }
+            hit[j] = RayEntry<NodeRef>{pending[i], enter};
+        }
+        while (hitCount > 0) {
+            stack.push(hit[--hitCount]);
+        }
+    }
+
+private:
+    NodeRef pending[8];
+    int count = 0;
+};
+
+// Depth-first walk over the cells the ray passes within margin of, children
+// front to back by the distance at which the ray enters them. For plain
+// boxes that is the octant order along the ray. resolve(ref) gives the node
+// of a reference (anything with min and max), pushChildren(ref, stack) pushes
+// its children and visitNode(ref) handles one cell, returning false to stop
+// the walk. Cells the ray enters beyond cutoff are skipped; visitNode may
+// lower cutoff as it goes. Returns false if the walk was stopped.
+template <int MaxDepth, typename NodeRef, typename Resolve, typename PushChildren, typename VisitNode>
+bool rayTraverse(const Ray& ray, float margin, const float& cutoff, NodeRef root,
+                 Resolve&& resolve, PushChildren&& pushChildren, VisitNode&& visitNode) {
+    float enter, exit;
+    const auto& rootNode = resolve(root);
+    if (!ray.intersectBox(rootNode.min, rootNode.max, margin, enter, exit)) return true;
+
+    TraversalStack<RayEntry<NodeRef>, MaxDepth> stack;
+    stack.push(RayEntry<NodeRef>{root, enter});
+    while (!stack.empty()) {
+        RayEntry<NodeRef> entry = stack.pop();
+        if (entry.enter > cutoff) continue;
+        if (!visitNode(entry.node)) return false;
+        RayChildOrder<NodeRef> children;
+        pushChildren(entry.node, children);
+        children.pushOrdered(ray, margin, resolve, stack);
+    }
+    return true;
+}
+
+#endif // OCTREE_GEOMETRY_H
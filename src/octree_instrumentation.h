@@ -0,0 +1,236 @@
+#ifndef OCTREE_INSTRUMENTATION_H
+#define OCTREE_INSTRUMENTATION_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+// Hot-path counters and trace scopes for the trees. They are compiled in with
+// OCTREE_INSTRUMENTATION defined (the CMake option of the same name); without
+// it OCTREE_COUNT and OCTREE_TRACE_SCOPE expand to nothing and their
+// arguments are never evaluated. With it each thread counts into a block of
+// its own, so a count is one relaxed add on a cache line no other thread
+// writes, and a snapshot sums the blocks of every thread that has counted.
+// Trace scopes cost one flag test until tracing is switched on at runtime.
+
+enum class OctreeCounter : int {
+    // Nodes a descent or query reached
+    NodesVisited,
+    // Nodes a query skipped by their bounds, with their subtrees
+    NodesPruned,
+    // Subtrees a query took whole because their bounds lie inside it
+    SubtreesAccepted,
+    // Points compared against a query
+    PointsTested,
+    // Points a range query matched, tested or taken with a whole subtree
+    PointsMatched,
+    // Leaves split into children
+    Subdivisions,
+    // Nodes allocated
+    NodesAllocated,
+    // Child lookups in the hash map and packed child containers
+    ChildLookups,
+    Count
+};
+
+constexpr int OCTREE_COUNTER_COUNT = static_cast<int>(OctreeCounter::Count);
+
+inline const char* counterName(OctreeCounter counter) {
+    static const char* const names[OCTREE_COUNTER_COUNT] = {
+        "nodes_visited", "nodes_pruned", "subtrees_accepted", "points_tested",
+        "points_matched", "subdivisions", "nodes_allocated", "child_lookups"};
+    return names[static_cast<int>(counter)];
+}
+
+// Totals of every counter at one moment; the difference of two snapshots
+// measures the work in between
+struct OctreeCounters {
+    uint64_t values[OCTREE_COUNTER_COUNT] = {};
+
+    uint64_t operator[](OctreeCounter counter) const { return values[static_cast<int>(counter)]; }
+
+    OctreeCounters operator-(const OctreeCounters& before) const {
+        OctreeCounters delta;
+        for (int i = 0; i < OCTREE_COUNTER_COUNT; ++i) delta.values[i] = values[i] - before.values[i];
+        return delta;
+    }
+
+    // Share of the tested points that matched: how well the bounds pruned
+    double matchRatio() const {
+        uint64_t tested = (*this)[OctreeCounter::PointsTested];
+        return tested > 0 ? static_cast<double>((*this)[OctreeCounter::PointsMatched]) / tested : 0.0;
+    }
+
+    void writeJson(std::ostream& out) const {
+        out << "{";
+        for (int i = 0; i < OCTREE_COUNTER_COUNT; ++i) {
+            out << (i > 0 ? ", " : "") << "\"" << counterName(static_cast<OctreeCounter>(i)) << "\": " << values[i];
+        }
+        out << "}";
+    }
+
+    void print(std::ostream& out) const {
+        for (int i = 0; i < OCTREE_COUNTER_COUNT; ++i) {
+            out << "  " << counterName(static_cast<OctreeCounter>(i)) << ": " << values[i] << "\n";
+        }
+    }
+};
+
+// Process-wide registry of the per-thread counter blocks and trace events
+class OctreeInstrumentation {
+public:
+#ifdef OCTREE_INSTRUMENTATION
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+
+    static void add(OctreeCounter counter, uint64_t n) {
+        std::atomic<uint64_t>& value = local().values[static_cast<int>(counter)];
+        // Only the owning thread writes, so load + store is enough
+        value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    // Sum over every thread's block
+    static OctreeCounters snapshot() {
+        Registry& registry = instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        OctreeCounters totals;
+        for (const auto& block : registry.blocks) {
+            for (int i = 0; i < OCTREE_COUNTER_COUNT; ++i) {
+                totals.values[i] += block->values[i].load(std::memory_order_relaxed);
+            }
+        }
+        return totals;
+    }
+
+    // Zero the counters and drop the trace events. Counts made meanwhile by
+    // other threads may be lost; take differences of snapshots instead when
+    // queries are running.
+    static void reset() {
+        Registry& registry = instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        for (const auto& block : registry.blocks) {
+            for (auto& value : block->values) value.store(0, std::memory_order_relaxed);
+            std::lock_guard<std::mutex> eventLock(block->eventMutex);
+            block->events.clear();
+        }
+    }
+
+    // Record trace scopes from now on
+    static void setTracing(bool on) { instance().tracing.store(on, std::memory_order_relaxed); }
+    static bool tracing() { return instance().tracing.load(std::memory_order_relaxed); }
+
+    // Microseconds since the first use of the instrumentation
+    static double nowMicros() {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - instance().epoch).count();
+    }
+
+    static void addEvent(const char* name, double begin, double duration) {
+        ThreadBlock& block = local();
+        std::lock_guard<std::mutex> lock(block.eventMutex);
+        block.events.push_back(TraceEvent{name, begin, duration});
+    }
+
+    // The recorded scopes in the Chrome trace event format, for
+    // chrome://tracing or Perfetto: one complete ("X") event per scope
+    static void writeChromeTrace(std::ostream& out) {
+        Registry& registry = instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        out << "{\"traceEvents\": [";
+        bool first = true;
+        for (const auto& block : registry.blocks) {
+            std::lock_guard<std::mutex> eventLock(block->eventMutex);
+            for (const TraceEvent& event : block->events) {
+                out << (first ? "\n" : ",\n") << "  {\"name\": \"" << event.name
+                    << "\", \"cat\": \"octree\", \"ph\": \"X\", \"ts\": " << event.begin
+                    << ", \"dur\": " << event.duration << ", \"pid\": 1, \"tid\": " << block->threadId << "}";
+                first = false;
+            }
+        }
+        out << "\n], \"displayTimeUnit\": \"ms\"}\n";
+    }
+
+private:
+    struct TraceEvent {
+        const char* name;
+        double begin;
+        double duration;
+    };
+
+    struct ThreadBlock {
+        std::atomic<uint64_t> values[OCTREE_COUNTER_COUNT] = {};
+        uint32_t threadId = 0;
+        std::mutex eventMutex;
+        std::vector<TraceEvent> events;
+    };
+
+    // Blocks outlive their threads, so pool workers' counts stay in the totals
+    struct Registry {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<ThreadBlock>> blocks;
+        std::atomic<bool> tracing{false};
+        std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    };
+
+    static Registry& instance() {
+        static Registry registry;
+        return registry;
+    }
+
+    static ThreadBlock& local() {
+        thread_local ThreadBlock* block = registerThread();
+        return *block;
+    }
+
+    static ThreadBlock* registerThread() {
+        Registry& registry = instance();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.blocks.push_back(std::make_unique<ThreadBlock>());
+        registry.blocks.back()->threadId = static_cast<uint32_t>(registry.blocks.size());
+        return registry.blocks.back().get();
+    }
+};
+
+// Records the time from its construction to the end of its scope as one
+// trace event, if tracing was on when the scope began
+class OctreeTraceScope {
+public:
+    explicit OctreeTraceScope(const char* name)
+        : name(name), begin(OctreeInstrumentation::tracing() ? OctreeInstrumentation::nowMicros() : -1.0) {}
+
+    ~OctreeTraceScope() {
+        if (begin >= 0.0) OctreeInstrumentation::addEvent(name, begin, OctreeInstrumentation::nowMicros() - begin);
+    }
+
+    OctreeTraceScope(const OctreeTraceScope&) = delete;
+    OctreeTraceScope& operator=(const OctreeTraceScope&) = delete;
+
+private:
+    const char* name;
+    double begin;
+};
+
+// Counter totals for the trees' printStatistics; nothing when compiled out
+inline void printInstrumentationStatistics() {
+    if constexpr (OctreeInstrumentation::enabled) {
+        std::cout << "Instrumentation counters (all threads):" << std::endl;
+        OctreeInstrumentation::snapshot().print(std::cout);
+    }
+}
+
+#ifdef OCTREE_INSTRUMENTATION
+#define OCTREE_COUNT(counter, n) OctreeInstrumentation::add(OctreeCounter::counter, static_cast<uint64_t>(n))
+#define OCTREE_TRACE_SCOPE(name) OctreeTraceScope octreeTraceScope(name)
+#else
+#define OCTREE_COUNT(counter, n) ((void)0)
+#define OCTREE_TRACE_SCOPE(name) ((void)0)
+#endif
+
+#endif // OCTREE_INSTRUMENTATION_H
@@ -0,0 +1,497 @@
+#ifndef OCTREE_IO_H
+#define OCTREE_IO_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "point.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only memory mapping of a whole file. Pages are loaded lazily by the
+// OS, so opening is instant regardless of the file size.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& filename) {
+#ifdef _WIN32
+        HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return;
+        LARGE_INTEGER fileSize;
+        if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0) {
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping != nullptr) {
+                void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                if (view != nullptr) {
+                    bytes = static_cast<const unsigned char*>(view);
+                    length = static_cast<size_t>(fileSize.QuadPart);
+                }
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+#else
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat info;
+        if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* view = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+            if (view != MAP_FAILED) {
+                bytes = static_cast<const unsigned char*>(view);
+                length = static_cast<size_t>(info.st_size);
+            }
+        }
+        // The mapping stays valid after the descriptor is closed
+        ::close(fd);
+#endif
+    }
+
+    ~MappedFile() {
+        if (bytes == nullptr) return;
+#ifdef _WIN32
+        UnmapViewOfFile(bytes);
+#else
+        ::munmap(const_cast<unsigned char*>(bytes), length);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool isOpen() const { return bytes != nullptr; }
+    const unsigned char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const unsigned char* bytes = nullptr;
+    size_t length = 0;
+};
+
+// Sequential binary writer that can pad the output so the next section
+// starts at an aligned file offset. Any failed write makes ok() false.
+class AlignedFileWriter {
+public:
+    explicit AlignedFileWriter(const std::string& filename) : file(std::fopen(filename.c_str(), "wb")) {}
+
+    ~AlignedFileWriter() { close(); }
+
+    AlignedFileWriter(const AlignedFileWriter&) = delete;
+    AlignedFileWriter& operator=(const AlignedFileWriter&) = delete;
+
+    bool isOpen() const { return file != nullptr; }
+    bool ok() const { return file != nullptr && good; }
+    uint64_t offset() const { return position; }
+
+    void write(const void* data, size_t size) {
+        if (!ok() || size == 0) return;
+        good = std::fwrite(data, 1, size, file) == size;
+        position += size;
+    }
+
+    // Zero-fill up to the next multiple of alignment
+    void pad(size_t alignment) {
+        static const char zeros[64] = {};
+        size_t remainder = static_cast<size_t>(position % alignment);
+        for (size_t gap = remainder == 0 ? 0 : alignment - remainder; gap > 0;) {
+            size_t chunk = gap < sizeof(zeros) ? gap : sizeof(zeros);
+            write(zeros, chunk);
+            gap -= chunk;
+        }
+    }
+
+    // Overwrite bytes already written, e.g. a header filled in last
+    void writeAt(uint64_t at, const void* data, size_t size) {
+        if (!ok()) return;
+        good = std::fseek(file, static_cast<long>(at), SEEK_SET) == 0 &&
+               std::fwrite(data, 1, size, file) == size &&
+               std::fseek(file, 0, SEEK_END) == 0;
+    }
+
+    // Flush and close; false if anything failed
+    bool close() {
+        if (file == nullptr) return false;
+        good = (std::fclose(file) == 0) && good;
+        file = nullptr;
+        return good;
+    }
+
+private:
+    std::FILE* file;
+    uint64_t position = 0;
+    bool good = true;
+};
+
+// Sections of the on-disk files start on cache-line boundaries, so arrays
+// viewed straight from a page-aligned mapping keep the SIMD kernels' alignment
+static const size_t OCTREE_FILE_ALIGNMENT = 64;
+
+// Header of a saved linear octree. All sections are raw arrays in host byte
+// order; the endian tag and the recorded struct sizes make a file written by
+// an incompatible build fail to open instead of being misread.
+struct LinearOctreeFileHeader {
+    static constexpr char MAGIC[8] = {'O', 'C', 'T', 'L', 'I', 'N', 'E', 'R'};
+    static const uint32_t VERSION = 2;
+    static const uint32_t ENDIAN_TAG = 0x01020304;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t endianTag;
+    uint32_t headerSize;
+    uint32_t nodeSize;
+    uint32_t pointSize;
+    uint32_t maxPointsPerLeaf;
+    int32_t maxDepth;
+    // SpaceFillingCurve of the codes (0 is Morton)
+    uint32_t curve;
+    float min[3];
+    float max[3];
+    uint64_t nodeCount;
+    uint64_t pointCount;
+    // File offsets of the sections
+    uint64_t nodesOffset;
+    uint64_t pointsOffset;
+    uint64_t codesOffset;
+    uint64_t soaOffset[3];
+    uint64_t indicesOffset;
+    uint64_t fileSize;
+
+    bool hasValidSection(uint64_t offset, uint64_t count, uint64_t elementSize) const {
+        return offset % OCTREE_FILE_ALIGNMENT == 0 && offset <= fileSize &&
+               count <= (fileSize - offset) / elementSize;
+    }
+};
+
+// Read-only file supporting concurrent reads at arbitrary offsets
+class PositionalFile {
+public:
+    explicit PositionalFile(const std::string& filename) {
+#ifdef _WIN32
+        file = std::fopen(filename.c_str(), "rb");
+#else
+        fd = ::open(filename.c_str(), O_RDONLY);
+#endif
+    }
+
+    ~PositionalFile() {
+#ifdef _WIN32
+        if (file != nullptr) std::fclose(file);
+#else
+        if (fd >= 0) ::close(fd);
+#endif
+    }
+
+    PositionalFile(const PositionalFile&) = delete;
+    PositionalFile& operator=(const PositionalFile&) = delete;
+
+#ifdef _WIN32
+    bool isOpen() const { return file != nullptr; }
+#else
+    bool isOpen() const { return fd >= 0; }
+#endif
+
+    // Size of the file in bytes, 0 if unknown
+    uint64_t size() const {
+#ifdef _WIN32
+        std::lock_guard<std::mutex> lock(mutex);
+        if (_fseeki64(file, 0, SEEK_END) != 0) return 0;
+        long long bytes = _ftelli64(file);
+        return bytes > 0 ? static_cast<uint64_t>(bytes) : 0;
+#else
+        struct stat info;
+        return ::fstat(fd, &info) == 0 && info.st_size > 0 ? static_cast<uint64_t>(info.st_size) : 0;
+#endif
+    }
+
+    // Read exactly bytes at offset; false on error or end of file
+    bool readAt(uint64_t offset, void* dst, size_t bytes) const {
+#ifdef _WIN32
+        std::lock_guard<std::mutex> lock(mutex);
+        return _fseeki64(file, static_cast<long long>(offset), SEEK_SET) == 0 &&
+               std::fread(dst, 1, bytes, file) == bytes;
+#else
+        char* out = static_cast<char*>(dst);
+        while (bytes > 0) {
+            ssize_t n = ::pread(fd, out, bytes, static_cast<off_t>(offset));
+            if (n <= 0) return false;
+            out += n;
+            offset += static_cast<uint64_t>(n);
+            bytes -= static_cast<size_t>(n);
+        }
+        return true;
+#endif
+    }
+
+private:
+#ifdef _WIN32
+    std::FILE* file = nullptr;
+    mutable std::mutex mutex;
+#else
+    int fd = -1;
+#endif
+};
+
+// Streams points from a file in chunks, for inputs larger than memory.
+// Supported formats:
+//  - PLY (ascii, binary_little_endian or binary_big_endian) whose first
+//    element is vertex; x, y and z may be any scalar type, other vertex
+//    properties are skipped,
+//  - anything else is read as raw float x, y, z triples in host byte order.
+class PointFileReader {
+public:
+    explicit PointFileReader(const std::string& filename) : file(std::fopen(filename.c_str(), "rb")) {
+        if (file == nullptr) return;
+        char magic[4] = {};
+        if (std::fread(magic, 1, 4, file) == 4 && std::memcmp(magic, "ply", 3) == 0 &&
+            (magic[3] == '\n' || magic[3] == '\r')) {
+            valid = parsePlyHeader();
+        } else {
+            std::fseek(file, 0, SEEK_END);
+            long long bytes = ftell64(file);
+            std::fseek(file, 0, SEEK_SET);
+            format = Format::Raw;
+            stride = 3 * sizeof(float);
+            total = bytes > 0 ? static_cast<uint64_t>(bytes) / stride : 0;
+            valid = true;
+        }
+    }
+
+    ~PointFileReader() {
+        if (file != nullptr) std::fclose(file);
+    }
+
+    PointFileReader(const PointFileReader&) = delete;
+    PointFileReader& operator=(const PointFileReader&) = delete;
+
+    bool isOpen() const { return file != nullptr && valid; }
+
+    // Number of points in the file
+    uint64_t pointCount() const { return total; }
+
+    // Read up to maxCount points into out; returns how many were read, 0 at the end
+    size_t read(Point* out, size_t maxCount) {
+        if (!isOpen()) return 0;
+        size_t count = static_cast<size_t>(std::min<uint64_t>(maxCount, total - consumed));
+        if (format == Format::Ascii) {
+            for (size_t i = 0; i < count; ++i) {
+                if (!readAsciiVertex(out[i])) {
+                    count = i;
+                    break;
+                }
+            }
+        } else {
+            buffer.resize(count * stride);
+            count = std::fread(buffer.data(), stride, count, file);
+            for (size_t i = 0; i < count; ++i) {
+                const unsigned char* record = buffer.data() + i * stride;
+                out[i] = Point(scalar(record, 0), scalar(record, 1), scalar(record, 2));
+            }
+        }
+        consumed += count;
+        return count;
+    }
+
+private:
+    enum class Format { Raw, Ascii, BinaryLittle, BinaryBig };
+
+    // Scalar property types of PLY
+    enum class Scalar { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64 };
+
+    static long long ftell64(std::FILE* f) {
+#ifdef _WIN32
+        return _ftelli64(f);
+#else
+        return static_cast<long long>(ftello(f));
+#endif
+    }
+
+    static bool parseScalar(const std::string& name, Scalar& type, size_t& size) {
+        static const struct { const char* name; Scalar type; size_t size; } types[] = {
+            {"char", Scalar::Int8, 1}, {"int8", Scalar::Int8, 1},
+            {"uchar", Scalar::UInt8, 1}, {"uint8", Scalar::UInt8, 1},
+            {"short", Scalar::Int16, 2}, {"int16", Scalar::Int16, 2},
+            {"ushort", Scalar::UInt16, 2}, {"uint16", Scalar::UInt16, 2},
+            {"int", Scalar::Int32, 4}, {"int32", Scalar::Int32, 4},
+            {"uint", Scalar::UInt32, 4}, {"uint32", Scalar::UInt32, 4},
+            {"float", Scalar::Float32, 4}, {"float32", Scalar::Float32, 4},
+            {"double", Scalar::Float64, 8}, {"float64", Scalar::Float64, 8},
+        };
+        for (const auto& t : types) {
+            if (name == t.name) {
+                type = t.type;
+                size = t.size;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool readLine(std::string& line) {
+        line.clear();
+        for (int c = std::fgetc(file); c != EOF; c = std::fgetc(file)) {
+            if (c == '\n') return true;
+            if (c != '\r') line.push_back(static_cast<char>(c));
+        }
+        return !line.empty();
+    }
+
+    bool parsePlyHeader() {
+        std::string line;
+        bool inVertex = false, seenElement = false;
+        size_t offset = 0, property = 0;
+        while (readLine(line)) {
+            char word[64] = {}, arg1[64] = {}, arg2[64] = {};
+            int fields = std::sscanf(line.c_str(), "%63s %63s %63s", word, arg1, arg2);
+            std::string keyword = fields > 0 ? word : "";
+            if (keyword == "format") {
+                std::string name = arg1;
+                format = name == "ascii" ? Format::Ascii
+                       : name == "binary_little_endian" ? Format::BinaryLittle
+                       : name == "binary_big_endian" ? Format::BinaryBig : Format::Raw;
+                if (format == Format::Raw) return false;
+            } else if (keyword == "element") {
+                // Only a leading vertex element can be streamed without parsing the others
+                inVertex = !seenElement && std::string(arg1) == "vertex";
+                if (inVertex) total = std::strtoull(arg2, nullptr, 10);
+                seenElement = true;
+            } else if (keyword == "property" && inVertex) {
+                if (std::string(arg1) == "list") return false;
+                Scalar type;
+                size_t size;
+                if (!parseScalar(arg1, type, size)) return false;
+                std::string name = arg2;
+                int axis = name == "x" ? 0 : name == "y" ? 1 : name == "z" ? 2 : -1;
+                if (axis >= 0) {
+                    axisType[axis] = type;
+                    axisOffset[axis] = offset;
+                    axisColumn[axis] = property;
+                    axisFound[axis] = true;
+                }
+                offset += size;
+                property++;
+            } else if (keyword == "end_header") {
+                stride = offset;
+                columns = property;
+                return axisFound[0] && axisFound[1] && axisFound[2];
+            }
+        }
+        return false;
+    }
+
+    float scalar(const unsigned char* record, int axis) const {
+        const unsigned char* src = record + axisOffset[axis];
+        unsigned char bytes[8];
+        size_t size = format == Format::Raw ? 4 : scalarSize(axisType[axis]);
+        std::memcpy(bytes, src, size);
+        if (swapBytes()) {
+            for (size_t i = 0; i < size / 2; ++i) std::swap(bytes[i], bytes[size - 1 - i]);
+        }
+        switch (format == Format::Raw ? Scalar::Float32 : axisType[axis]) {
+            case Scalar::Int8: { int8_t v; std::memcpy(&v, bytes, 1); return v; }
+            case Scalar::UInt8: return bytes[0];
+            case Scalar::Int16: { int16_t v; std::memcpy(&v, bytes, 2); return v; }
+            case Scalar::UInt16: { uint16_t v; std::memcpy(&v, bytes, 2); return v; }
+            case Scalar::Int32: { int32_t v; std::memcpy(&v, bytes, 4); return static_cast<float>(v); }
+            case Scalar::UInt32: { uint32_t v; std::memcpy(&v, bytes, 4); return static_cast<float>(v); }
+            case Scalar::Float32: { float v; std::memcpy(&v, bytes, 4); return v; }
+            case Scalar::Float64: { double v; std::memcpy(&v, bytes, 8); return static_cast<float>(v); }
+        }
+        return 0.0f;
+    }
+
+    static size_t scalarSize(Scalar type) {
+        switch (type) {
+            case Scalar::Int8: case Scalar::UInt8: return 1;
+            case Scalar::Int16: case Scalar::UInt16: return 2;
+            case Scalar::Int32: case Scalar::UInt32: case Scalar::Float32: return 4;
+            case Scalar::Float64: return 8;
+        }
+        return 0;
+    }
+
+    bool swapBytes() const {
+        const uint16_t one = 1;
+        bool hostLittle = *reinterpret_cast<const unsigned char*>(&one) == 1;
+        return (format == Format::BinaryLittle && !hostLittle) || (format == Format::BinaryBig && hostLittle);
+    }
+
+    bool readAsciiVertex(Point& p) {
+        std::string line;
+        if (!readLine(line)) return false;
+        float values[3] = {0.0f, 0.0f, 0.0f};
+        const char* cursor = line.c_str();
+        for (size_t column = 0; column < columns; ++column) {
+            char* next;
+            double v = std::strtod(cursor, &next);
+            if (next == cursor) return false;
+            for (int axis = 0; axis < 3; ++axis) {
+                if (axisColumn[axis] == column) values[axis] = static_cast<float>(v);
+            }
+            cursor = next;
+        }
+        p = Point(values[0], values[1], values[2]);
+        return true;
+    }
+
+    std::FILE* file;
+    bool valid = false;
+    Format format = Format::Raw;
+    uint64_t total = 0;
+    uint64_t consumed = 0;
+    // Bytes per binary vertex record and number of vertex properties
+    size_t stride = 0;
+    size_t columns = 0;
+    Scalar axisType[3] = {Scalar::Float32, Scalar::Float32, Scalar::Float32};
+    size_t axisOffset[3] = {0, 4, 8};
+    size_t axisColumn[3] = {0, 1, 2};
+    bool axisFound[3] = {false, false, false};
+    std::vector<unsigned char> buffer;
+};
+
+// Header of an out-of-core octree file: the header, the leaf points in
+// Morton order (each leaf is one page) and the node array at the end.
+struct OutOfCoreFileHeader {
+    static constexpr char MAGIC[8] = {'O', 'C', 'T', 'P', 'A', 'G', 'E', 'D'};
+    static const uint32_t VERSION = 2;
+    static const uint32_t ENDIAN_TAG = 0x01020304;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t endianTag;
+    uint32_t headerSize;
+    uint32_t nodeSize;
+    uint32_t pointSize;
+    uint32_t maxPointsPerLeaf;
+    int32_t maxDepth;
+    uint32_t reserved;
+    float min[3];
+    float max[3];
+    uint64_t nodeCount;
+    uint64_t pointCount;
+    uint64_t pointsOffset;
+    uint64_t nodesOffset;
+    uint64_t fileSize;
+
+    bool hasValidSection(uint64_t offset, uint64_t count, uint64_t elementSize) const {
+        return offset % OCTREE_FILE_ALIGNMENT == 0 && offset <= fileSize &&
+               count <= (fileSize - offset) / elementSize;
+    }
+};
+
+#endif // OCTREE_IO_H
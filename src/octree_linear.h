@@ -0,0 +1,1033 @@
+#ifndef OCTREE_LINEAR_H
+#define OCTREE_LINEAR_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <optional>
+#include <functional>
+#include <memory>
+#include <cstring>
+#include "point.h"
+#include "octree_query.h"
+#include "morton_code.h"
+#include "octree_options.h"
+#include "vtk_writer.h"
+#include "octree_memory.h"
+#include "octree_traversal.h"
+#include "octree_geometry.h"
+#include "octree_aggregate.h"
+#include "octree_instrumentation.h"
+#include "thread_pool.h"
+#include "point_soa.h"
+#include "simd_kernels.h"
+#include "array_view.h"
+#include "octree_io.h"
+
+// Pointerless octree: points are sorted by their 63-bit Morton (or Hilbert)
+// key and every node is a contiguous range of the sorted array. Nodes live
+// in one flat vector and the children of a node are stored next to each other.
+// LeafCapacity and MaxDepth are the compile-time defaults for the
+// subdivision limits; OctreeOptions can override them per tree at runtime.
+template <size_t LeafCapacity = 1, int MaxDepth = MORTON_BITS_PER_AXIS>
+class BasicOctreeLinear {
+public:
+    struct Node {
+        // Bounding box of the cell
+        Point min, max;
+        // Key prefix of the cell on the tree's curve (3 bits per level)
+        uint64_t key;
+        // Range [begin, end) in the sorted point array
+        uint32_t begin, end;
+        // Index of the first child in nodes; children are contiguous
+        uint32_t firstChild;
+        uint8_t level;
+        uint8_t childCount;
+        // Bit i is set if octant i has a child
+        uint8_t childMask;
+        // Count, coordinate sums and tight bounds of the cell's points
+        PointAggregate aggregate;
+
+        bool isLeaf() const { return childCount == 0; }
+
+        bool contains(const Point& p) const {
+            return p.x >= min.x && p.x <= max.x &&
+                   p.y >= min.y && p.y <= max.y &&
+                   p.z >= min.z && p.z <= max.z;
+        }
+
+        // The box tests of the queries use the tight bounds of the cell's
+        // points, which reject its empty parts
+        bool boxIntersects(const Point& queryMin, const Point& queryMax) const {
+            const Point& lo = aggregate.min;
+            const Point& hi = aggregate.max;
+            return !(hi.x < queryMin.x || lo.x > queryMax.x ||
+                     hi.y < queryMin.y || lo.y > queryMax.y ||
+                     hi.z < queryMin.z || lo.z > queryMax.z);
+        }
+
+        bool boxContainedIn(const Point& queryMin, const Point& queryMax) const {
+            const Point& lo = aggregate.min;
+            const Point& hi = aggregate.max;
+            return lo.x >= queryMin.x && hi.x <= queryMax.x &&
+                   lo.y >= queryMin.y && hi.y <= queryMax.y &&
+                   lo.z >= queryMin.z && hi.z <= queryMax.z;
+        }
+
+        // Squared distance from q to the tight bounds (0 if inside)
+        float boxDistanceSquared(const Point& q) const {
+            return ::boxDistanceSquared(q, aggregate.min, aggregate.max);
+        }
+    };
+
+    // Root bounding box used to quantize the keys
+    Point min, max;
+
+    // The arrays below are read-only views of either the storage filled by
+    // build() or the sections of a file opened with openMapped()
+
+    // Flat node array, nodes[0] is the root
+    ArrayView<Node> nodes;
+
+    // Points sorted by key, together with their keys
+    ArrayView<Point> points;
+    ArrayView<uint64_t> codes;
+    // The same points as aligned x/y/z arrays, scanned by the SIMD leaf kernels
+    PointSoAView soa;
+    // indices[i] is the position in the build input that points[i] came from
+    ArrayView<uint32_t> indices;
+
+    // Subdivision limits
+    OctreeOptions options;
+    // Curve the points are sorted along. Hilbert keys cost more to compute,
+    // but consecutive cells of a level always share a face, so a query's
+    // leaves are spread over fewer separate runs of the point arrays.
+    SpaceFillingCurve curve;
+
+    // Maximum points per leaf before subdivision
+    static constexpr size_t MAX_POINTS_PER_LEAF = LeafCapacity;
+    static constexpr int MAX_DEPTH = MaxDepth;
+    static_assert(MaxDepth <= MORTON_BITS_PER_AXIS, "One level per bit of each axis");
+
+    static constexpr OctreeOptions defaultOptions() {
+        return OctreeOptions{static_cast<uint32_t>(LeafCapacity), MaxDepth};
+    }
+
+    BasicOctreeLinear(const Point& min, const Point& max)
+        : BasicOctreeLinear(min, max, defaultOptions()) {}
+
+    BasicOctreeLinear(const Point& min, const Point& max, const OctreeOptions& options,
+                      SpaceFillingCurve curve = SpaceFillingCurve::Morton)
+        : min(min), max(max), options(options.clampedTo(MaxDepth)), curve(curve) {
+        storage.nodes.push_back(makeNode(0, 0, 0, 0));
+        bindStorage();
+    }
+
+    // Copies share a mapped file; owned storage is copied and the views rebound
+    BasicOctreeLinear(const BasicOctreeLinear& other)
+        : min(other.min), max(other.max), nodes(other.nodes), points(other.points), codes(other.codes),
+          soa(other.soa), indices(other.indices), options(other.options), curve(other.curve), storage(other.storage),
+          mapping(other.mapping) {
+        if (!mapping) bindStorage();
+    }
+
+    BasicOctreeLinear& operator=(const BasicOctreeLinear& other) {
+        if (this != &other) {
+            BasicOctreeLinear copy(other);
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+
+    // Moving a vector keeps its buffer, so the views stay valid
+    BasicOctreeLinear(BasicOctreeLinear&&) = default;
+    BasicOctreeLinear& operator=(BasicOctreeLinear&&) = default;
+
+    // Build the tree from scratch: one key per point, one radix sort, then a
+    // breadth-first split of the sorted array into cells.
+    void build(const std::vector<Point>& input) {
+        OCTREE_TRACE_SCOPE("build");
+        std::vector<uint64_t> unsortedCodes(input.size());
+        std::vector<uint32_t> order;
+        order.reserve(input.size());
+        curveEncodePoints(curve, input.data(), input.size(), min, max, unsortedCodes.data());
+
+        // Drop the keys of points outside the bounds, keeping the rest in input order
+        size_t outside = 0;
+        for (size_t i = 0; i < input.size(); ++i) {
+            if (!contains(input[i])) {
+                outside++;
+                continue;
+            }
+            unsortedCodes[order.size()] = unsortedCodes[i];
+            order.push_back(static_cast<uint32_t>(i));
+        }
+        unsortedCodes.resize(order.size());
+        if (outside > 0) {
+            std::cout << "Warning: " << outside << " points are outside node bounds" << std::endl;
+        }
+
+        mortonRadixSort(unsortedCodes, order);
+
+        storage.codes.swap(unsortedCodes);
+        storage.points.resize(order.size());
+        storage.soa.resize(order.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            storage.points[i] = input[order[i]];
+            storage.soa.set(i, storage.points[i]);
+        }
+        storage.indices.swap(order);
+
+        buildNodes();
+    }
+
+    // Parallel build, same result as build(). Keys are computed on the pool,
+    // scattered into buckets by their top 3 * PARALLEL_SORT_LEVELS bits and the
+    // buckets are radix sorted concurrently. threadCount == 0 uses every
+    // hardware thread.
+    void buildParallel(const std::vector<Point>& input, size_t threadCount = 0) {
+        ThreadPool pool(threadCount);
+        buildParallel(input, pool);
+    }
+
+    void buildParallel(const std::vector<Point>& input, ThreadPool& pool) {
+        OCTREE_TRACE_SCOPE("buildParallel");
+        static const int PARALLEL_SORT_LEVELS = 3;
+        static const int BUCKET_SHIFT = 3 * (MORTON_BITS_PER_AXIS - PARALLEL_SORT_LEVELS);
+        static const size_t BUCKETS = size_t(1) << (3 * PARALLEL_SORT_LEVELS);
+
+        const size_t chunkCount = std::max<size_t>(1, std::min(input.size() / 4096, pool.size() * 4));
+        const size_t chunkSize = (input.size() + chunkCount - 1) / chunkCount;
+
+        // Pass 1: per chunk, encode the points and histogram the buckets of those inside
+        std::vector<uint64_t> inputCodes(input.size());
+        std::vector<std::vector<size_t>> histograms(chunkCount, std::vector<size_t>(BUCKETS, 0));
+        std::vector<size_t> outsideCounts(chunkCount, 0);
+        parallelFor(pool, chunkCount, 1, [&](size_t begin, size_t end) {
+            for (size_t c = begin; c < end; ++c) {
+                size_t first = std::min(input.size(), c * chunkSize);
+                size_t last = std::min(input.size(), (c + 1) * chunkSize);
+                curveEncodePoints(curve, input.data() + first, last - first, min, max, inputCodes.data() + first);
+                for (size_t i = first; i < last; ++i) {
+                    if (!contains(input[i])) {
+                        outsideCounts[c]++;
+                        continue;
+                    }
+                    histograms[c][inputCodes[i] >> BUCKET_SHIFT]++;
+                }
+            }
+        });
+
+        size_t outside = 0;
+        for (size_t count : outsideCounts) outside += count;
+        if (outside > 0) {
+            std::cout << "Warning: " << outside << " points are outside node bounds" << std::endl;
+        }
+
+        // Bucket-major, chunk-minor offsets keep the scatter stable
+        std::vector<size_t> bucketStart(BUCKETS + 1, 0);
+        size_t offset = 0;
+        for (size_t b = 0; b < BUCKETS; ++b) {
+            bucketStart[b] = offset;
+            for (size_t c = 0; c < chunkCount; ++c) {
+                size_t count = histograms[c][b];
+                histograms[c][b] = offset;
+                offset += count;
+            }
+        }
+        bucketStart[BUCKETS] = offset;
+
+        // Pass 2: scatter codes and input indices into their buckets
+        std::vector<uint64_t> sortedCodes(offset);
+        std::vector<uint32_t> order(offset);
+        parallelFor(pool, chunkCount, 1, [&](size_t begin, size_t end) {
+            for (size_t c = begin; c < end; ++c) {
+                size_t last = std::min(input.size(), (c + 1) * chunkSize);
+                for (size_t i = c * chunkSize; i < last; ++i) {
+                    if (!contains(input[i])) continue;
+                    size_t dst = histograms[c][inputCodes[i] >> BUCKET_SHIFT]++;
+                    sortedCodes[dst] = inputCodes[i];
+                    order[dst] = static_cast<uint32_t>(i);
+                }
+            }
+        });
+
+        // Buckets are disjoint ranges of the final order
+        parallelFor(pool, BUCKETS, 1, [&](size_t begin, size_t end) {
+            for (size_t b = begin; b < end; ++b) {
+                mortonRadixSort(sortedCodes.data() + bucketStart[b], order.data() + bucketStart[b],
+                                bucketStart[b + 1] - bucketStart[b]);
+            }
+        });
+
+        storage.codes.swap(sortedCodes);
+        storage.points.resize(offset);
+        storage.soa.resize(offset);
+        parallelFor(pool, offset, size_t(1) << 16, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                storage.points[i] = input[order[i]];
+                storage.soa.set(i, storage.points[i]);
+            }
+        });
+        storage.indices.swap(order);
+
+        buildNodes();
+    }
+
+    // Write the tree to filename in the versioned format of octree_io.h: a
+    // header followed by the node, point, code, x/y/z and index arrays
+    bool save(const std::string& filename) const {
+        AlignedFileWriter out(filename);
+        if (!out.isOpen()) {
+            std::cerr << "Error: Could not open file " << filename << " for writing." << std::endl;
+            return false;
+        }
+
+        LinearOctreeFileHeader header = {};
+        std::memcpy(header.magic, LinearOctreeFileHeader::MAGIC, sizeof(header.magic));
+        header.version = LinearOctreeFileHeader::VERSION;
+        header.endianTag = LinearOctreeFileHeader::ENDIAN_TAG;
+        header.headerSize = sizeof(LinearOctreeFileHeader);
+        header.nodeSize = sizeof(Node);
+        header.pointSize = sizeof(Point);
+        header.maxPointsPerLeaf = options.maxPointsPerLeaf;
+        header.maxDepth = options.maxDepth;
+        header.curve = static_cast<uint32_t>(curve);
+        header.min[0] = min.x; header.min[1] = min.y; header.min[2] = min.z;
+        header.max[0] = max.x; header.max[1] = max.y; header.max[2] = max.z;
+        header.nodeCount = nodes.size();
+        header.pointCount = points.size();
+
+        // Header placeholder, filled in once the section offsets are known
+        out.write(&header, sizeof(header));
+        auto section = [&](uint64_t& offset, const void* data, size_t bytes) {
+            out.pad(OCTREE_FILE_ALIGNMENT);
+            offset = out.offset();
+            out.write(data, bytes);
+        };
+        section(header.nodesOffset, nodes.data(), nodes.size() * sizeof(Node));
+        section(header.pointsOffset, points.data(), points.size() * sizeof(Point));
+        section(header.codesOffset, codes.data(), codes.size() * sizeof(uint64_t));
+        section(header.soaOffset[0], soa.x.data(), soa.size() * sizeof(float));
+        section(header.soaOffset[1], soa.y.data(), soa.size() * sizeof(float));
+        section(header.soaOffset[2], soa.z.data(), soa.size() * sizeof(float));
+        section(header.indicesOffset, indices.data(), indices.size() * sizeof(uint32_t));
+        header.fileSize = out.offset();
+        out.writeAt(0, &header, sizeof(header));
+
+        if (!out.close()) {
+            std::cerr << "Error: Failed writing octree to " << filename << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Replace the tree with one saved by save(). The file is memory-mapped and
+    // queried in place: nothing is copied or rebuilt, and pages are only read
+    // when a query touches them. The mapping lives until the tree is rebuilt
+    // or destroyed. Returns false, leaving the tree unchanged, if the file is
+    // missing, truncated or was written by an incompatible build. The array
+    // contents themselves are trusted.
+    bool openMapped(const std::string& filename) {
+        auto file = std::make_shared<const MappedFile>(filename);
+        if (!file->isOpen()) {
+            std::cerr << "Error: Could not map file " << filename << std::endl;
+            return false;
+        }
+
+        LinearOctreeFileHeader header;
+        bool valid = file->size() >= sizeof(header);
+        if (valid) {
+            std::memcpy(&header, file->data(), sizeof(header));
+            valid = std::memcmp(header.magic, LinearOctreeFileHeader::MAGIC, sizeof(header.magic)) == 0 &&
+                    header.version == LinearOctreeFileHeader::VERSION &&
+                    header.endianTag == LinearOctreeFileHeader::ENDIAN_TAG &&
+                    header.headerSize == sizeof(LinearOctreeFileHeader) &&
+                    header.nodeSize == sizeof(Node) && header.pointSize == sizeof(Point) &&
+                    header.curve <= static_cast<uint32_t>(SpaceFillingCurve::Hilbert) &&
+                    header.fileSize == file->size() && header.nodeCount > 0 &&
+                    header.pointCount <= UINT32_MAX &&
+                    header.hasValidSection(header.nodesOffset, header.nodeCount, sizeof(Node)) &&
+                    header.hasValidSection(header.pointsOffset, header.pointCount, sizeof(Point)) &&
+                    header.hasValidSection(header.codesOffset, header.pointCount, sizeof(uint64_t)) &&
+                    header.hasValidSection(header.soaOffset[0], header.pointCount, sizeof(float)) &&
+                    header.hasValidSection(header.soaOffset[1], header.pointCount, sizeof(float)) &&
+                    header.hasValidSection(header.soaOffset[2], header.pointCount, sizeof(float)) &&
+                    header.hasValidSection(header.indicesOffset, header.pointCount, sizeof(uint32_t));
+        }
+        if (!valid) {
+            std::cerr << "Error: " << filename << " is not a compatible linear octree file" << std::endl;
+            return false;
+        }
+
+        const unsigned char* base = file->data();
+        size_t nodeCount = static_cast<size_t>(header.nodeCount);
+        size_t pointCount = static_cast<size_t>(header.pointCount);
+        min = Point(header.min[0], header.min[1], header.min[2]);
+        max = Point(header.max[0], header.max[1], header.max[2]);
+        options = OctreeOptions{header.maxPointsPerLeaf, header.maxDepth};
+        curve = static_cast<SpaceFillingCurve>(header.curve);
+        storage = Storage();
+        nodes = ArrayView<Node>(reinterpret_cast<const Node*>(base + header.nodesOffset), nodeCount);
+        points = ArrayView<Point>(reinterpret_cast<const Point*>(base + header.pointsOffset), pointCount);
+        codes = ArrayView<uint64_t>(reinterpret_cast<const uint64_t*>(base + header.codesOffset), pointCount);
+        soa.x = ArrayView<float>(reinterpret_cast<const float*>(base + header.soaOffset[0]), pointCount);
+        soa.y = ArrayView<float>(reinterpret_cast<const float*>(base + header.soaOffset[1]), pointCount);
+        soa.z = ArrayView<float>(reinterpret_cast<const float*>(base + header.soaOffset[2]), pointCount);
+        indices = ArrayView<uint32_t>(reinterpret_cast<const uint32_t*>(base + header.indicesOffset), pointCount);
+        mapping = std::move(file);
+        return true;
+    }
+
+    // True while the tree reads from a file opened with openMapped()
+    bool isMapped() const { return mapping != nullptr; }
+
+    bool contains(const Point& p) const {
+        return p.x >= min.x && p.x <= max.x &&
+               p.y >= min.y && p.y <= max.y &&
+               p.z >= min.z && p.z <= max.z;
+    }
+
+    const Node& root() const { return nodes[0]; }
+
+    // Helper function to print the octree structure
+    void print() const {
+        printNode(0, 0);
+    }
+
+    // Collect all points in the octree
+    void collectAllPoints(std::vector<Point>& allPoints) const {
+        allPoints.insert(allPoints.end(), points.begin(), points.end());
+    }
+
+    // Collect all node bounding boxes for visualization
+    void collectNodeBoxes(std::vector<std::pair<Point, Point>>& boxes, std::vector<int>& levels) const {
+        for (const auto& node : nodes) {
+            boxes.push_back({node.min, node.max});
+            levels.push_back(node.level);
+        }
+    }
+
+    // Export octree to VTK format for ParaView visualization. Binary output is
+    // smaller and much faster to write; ASCII stays readable for debugging.
+    bool exportToVTK(const std::string& filename, VtkFormat format = VtkFormat::Ascii) const {
+        if (!writeOctreeVTK(*this, filename, "Linear Octree Visualization", format)) {
+            std::cerr << "Error: Could not write file " << filename << std::endl;
+            return false;
+        }
+        std::cout << "Linear Octree exported to " << filename << std::endl;
+        std::cout << "Open this file in ParaView to visualize the octree structure!" << std::endl;
+        return true;
+    }
+
+    // Query methods
+    std::vector<Point> rangeQuery(const Point& queryMin, const Point& queryMax) const {
+        std::vector<Point> result;
+        rangeQuery(queryMin, queryMax, [&](const Point& p) { result.push_back(p); });
+        return result;
+    }
+
+    // Streams every point inside the box to visit(p) without allocating.
+    // A visitor returning bool can stop the query by returning false; the
+    // result is false if the query was stopped early.
+    template <typename Visitor>
+    bool rangeQuery(const Point& queryMin, const Point& queryMax, Visitor&& visit) const {
+        OCTREE_TRACE_SCOPE("rangeQuery");
+        TraversalStack<uint32_t, MaxDepth> stack;
+        stack.push(0);
+        while (!stack.empty()) {
+            uint32_t nodeIndex = stack.pop();
+            const Node& node = nodes[nodeIndex];
+            OCTREE_COUNT(NodesVisited, 1);
+
+            // Check if this node's bounding box intersects with query range
+            if (!node.boxIntersects(queryMin, queryMax)) {
+                OCTREE_COUNT(NodesPruned, 1);
+                continue;
+            }
+
+            // Whole cell inside the query: its points are one contiguous run
+            if (node.boxContainedIn(queryMin, queryMax)) {
+                OCTREE_COUNT(SubtreesAccepted, 1);
+                OCTREE_COUNT(PointsMatched, node.end - node.begin);
+                if (!visitRange(node.begin, node.end, visit)) return false;
+                continue;
+            }
+
+            if (node.isLeaf()) {
+                OCTREE_COUNT(PointsTested, node.end - node.begin);
+                if (!simdScanBox(soa.x.data(), soa.y.data(), soa.z.data(), node.begin, node.end, queryMin, queryMax,
+                                 [&](size_t i) {
+                                     OCTREE_COUNT(PointsMatched, 1);
+                                     return invokeVisitor(visit, points[i]);
+                                 })) {
+                    return false;
+                }
+                continue;
+            }
+            pushChildren(node, stack);
+        }
+        return true;
+    }
+
+    // Number of points inside the box; contained cells are counted from their range
+    size_t countInRange(const Point& queryMin, const Point& queryMax) const {
+        OCTREE_TRACE_SCOPE("countInRange");
+        size_t count = 0;
+        TraversalStack<uint32_t, MaxDepth> stack;
+        stack.push(0);
+        while (!stack.empty()) {
+            uint32_t nodeIndex = stack.pop();
+            const Node& node = nodes[nodeIndex];
+            OCTREE_COUNT(NodesVisited, 1);
+            if (!node.boxIntersects(queryMin, queryMax)) {
+                OCTREE_COUNT(NodesPruned, 1);
+                continue;
+            }
+            if (node.boxContainedIn(queryMin, queryMax)) {
+                OCTREE_COUNT(SubtreesAccepted, 1);
+                OCTREE_COUNT(PointsMatched, node.end - node.begin);
+                count += node.end - node.begin;
+                continue;
+            }
+
+            if (node.isLeaf()) {
+                size_t matched = simdCountBox(soa.x.data(), soa.y.data(), soa.z.data(), node.begin, node.end, queryMin,
+                                              queryMax);
+                OCTREE_COUNT(PointsTested, node.end - node.begin);
+                OCTREE_COUNT(PointsMatched, matched);
+                count += matched;
+                continue;
+            }
+            pushChildren(node, stack);
+        }
+        return count;
+    }
+
+    // True if at least one point lies inside the box; stops at the first hit
+    bool anyInRange(const Point& queryMin, const Point& queryMax) const {
+        return !rangeQuery(queryMin, queryMax, [](const Point&) { return false; });
+    }
+
+    // Aggregate of the points inside the box. Cells whose points all lie
+    // inside contribute their stored aggregate without being descended.
+    PointAggregate aggregateInRange(const Point& queryMin, const Point& queryMax) const {
+        PointAggregate result;
+        TraversalStack<uint32_t, MaxDepth> stack;
+        stack.push(0);
+        while (!stack.empty()) {
+            uint32_t nodeIndex = stack.pop();
+            const Node& node = nodes[nodeIndex];
+            if (!node.boxIntersects(queryMin, queryMax)) {
+                continue;
+            }
+            if (node.boxContainedIn(queryMin, queryMax)) {
+                result.merge(node.aggregate);
+                continue;
+            }
+
+            if (node.isLeaf()) {
+                simdScanBox(soa.x.data(), soa.y.data(), soa.z.data(), node.begin, node.end, queryMin, queryMax,
+                            [&](size_t i) {
+                                result.add(points[i]);
+                                return true;
+                            });
+                continue;
+            }
+            pushChildren(node, stack);
+        }
+        return result;
+    }
+
+    // Mean of the points inside the box, or nothing if there are none
+    std::optional<Point> centroidInRange(const Point& queryMin, const Point& queryMax) const {
+        PointAggregate result = aggregateInRange(queryMin, queryMax);
+        if (result.empty()) return std::nullopt;
+        return result.centroid();
+    }
+
+    // Build-input indices of the points inside the box. Visitors receive
+    // references into points, so the position is recovered from the address.
+    std::vector<uint32_t> rangeQueryIndices(const Point& queryMin, const Point& queryMax) const {
+        std::vector<uint32_t> result;
+        rangeQuery(queryMin, queryMax, [&](const Point& p) { result.push_back(indices[&p - points.data()]); });
+        return result;
+    }
+
+    // Points within radius of center (sphere query)
+    std::vector<Point> radiusQuery(const Point& center, float radius) const {
+        std::vector<Point> result;
+        radiusQuery(center, radius, [&](const Point& p) { result.push_back(p); });
+        return result;
+    }
+
+    // Build-input indices of the points within radius of center
+    std::vector<uint32_t> radiusQueryIndices(const Point& center, float radius) const {
+        std::vector<uint32_t> result;
+        radiusQuery(center, radius, [&](const Point& p) { result.push_back(indices[&p - points.data()]); });
+        return result;
+    }
+
+    // Visitor overload of radiusQuery, same contract as the rangeQuery one
+    template <typename Visitor>
+    bool radiusQuery(const Point& center, float radius, Visitor&& visit) const {
+        const float radiusSquared = radius * radius;
+        TraversalStack<uint32_t, MaxDepth> stack;
+        stack.push(0);
+        while (!stack.empty()) {
+            uint32_t nodeIndex = stack.pop();
+            const Node& node = nodes[nodeIndex];
+
+            // Skip cells that do not touch the sphere
+            if (node.boxDistanceSquared(center) > radiusSquared) {
+                continue;
+            }
+
+            // Whole cell inside the sphere: its points are one contiguous run
+            if (::boxMaxDistanceSquared(center, node.aggregate.min, node.aggregate.max) <= radiusSquared) {
+                if (!visitRange(node.begin, node.end, visit)) return false;
+                continue;
+            }
+
+            if (node.isLeaf()) {
+                if (!simdScanSphere(soa.x.data(), soa.y.data(), soa.z.data(), node.begin, node.end, center, radiusSquared,
+                                    [&](size_t i) { return invokeVisitor(visit, points[i]); })) {
+                    return false;
+                }
+                continue;
+            }
+            pushChildren(node, stack);
+        }
+        return true;
+    }
+
+    // Points inside the view frustum
+    std::vector<Point> frustumQuery(const Frustum& frustum) const {
+        std::vector<Point> result;
+        frustumQuery(frustum, [&](const Point& p) { result.push_back(p); });
+        return result;
+    }
+
+    // Visitor overload of frustumQuery, same contract as the rangeQuery one
+    template <typename Visitor>
+    bool frustumQuery(const Frustum& frustum, Visitor&& visit) const {
+        TraversalStack<uint32_t, MaxDepth> stack;
+        stack.push(0);
+        while (!stack.empty()) {
+            uint32_t nodeIndex = stack.pop();
+            const Node& node = nodes[nodeIndex];
+            BoxRelation relation = frustum.classify(node.aggregate.min, node.aggregate.max);
+            if (relation == BoxRelation::Outside) {
+                continue;
+            }
+
+            // Whole cell inside the frustum: its points are one contiguous run
+            if (relation == BoxRelation::Inside) {
+                if (!visitRange(node.begin, node.end, visit)) return false;
+                continue;
+            }
+
+            if (node.isLeaf()) {
+                for (uint32_t i = node.begin; i < node.end; ++i) {
+                    const Point& p = points[i];
+                    if (frustum.contains(p)) {
+                        if (!invokeVisitor(visit, p)) return false;
+                    }
+                }
+                continue;
+            }
+            pushChildren(node, stack);
+        }
+        return true;
+    }
+
+    // Points within radius of the ray, cell by cell from front to back
+    std::vector<Point> rayQuery(const Ray& ray, float radius) const {
+        std::vector<Point> result;
+        rayQuery(ray, radius, [&](const Point& p) { result.push_back(p); });
+        return result;
+    }
+
+    // Visitor overload of rayQuery, same contract as the rangeQuery one.
+    // Cells come in the order the ray enters them, the points of one cell
+    // in curve order.
+    template <typename Visitor>
+    bool rayQuery(const Ray& ray, float radius, Visitor&& visit) const {
+        const float cutoff = ray.maxDistance;
+        return rayTraverse(ray, radius, cutoff, [&](uint32_t nodeIndex) {
+            const Node& node = nodes[nodeIndex];
+            if (!node.isLeaf()) return true;
+            float t;
+            for (uint32_t i = node.begin; i < node.end; ++i) {
+                const Point& p = points[i];
+                if (ray.hits(p, radius, t) && !invokeVisitor(visit, p)) return false;
+            }
+            return true;
+        });
+    }
+
+    // First point along the ray within radius of it, or nothing. Cells the
+    // ray enters beyond the best hit so far are skipped, so the walk usually
+    // ends a few cells after the first hit.
+    std::optional<RayHit<Point>> raycast(const Ray& ray, float radius) const {
+        std::optional<RayHit<Point>> best;
+        float cutoff = ray.maxDistance;
+        rayTraverse(ray, radius, cutoff, [&](uint32_t nodeIndex) {
+            const Node& node = nodes[nodeIndex];
+            if (!node.isLeaf()) return true;
+            float t;
+            for (uint32_t i = node.begin; i < node.end; ++i) {
+                const Point& p = points[i];
+                if (ray.hits(p, radius, t) && (!best || t < best->distance)) {
+                    best = RayHit<Point>{p, t};
+                    cutoff = t;
+                }
+            }
+            return true;
+        });
+        return best;
+    }
+
+    // Calls visit(p) for every point, same contract as rangeQuery
+    template <typename Visitor>
+    bool forEachPoint(Visitor&& visit) const {
+        return visitRange(0, static_cast<uint32_t>(points.size()), visit);
+    }
+
+    // Calls visit(min, max, level) for every node, parents before children
+    template <typename Visitor>
+    void forEachNode(Visitor&& visit) const {
+        for (const auto& node : nodes) {
+            visit(node.min, node.max, node.level);
+        }
+    }
+
+    size_t pointCount() const { return points.size(); }
+
+    // The k points closest to q, closest first. Cells are visited best-first
+    // in order of their box distance to q; the search stops once the next
+    // cell is farther away than the current k-th neighbor.
+    std::vector<Point> knn(const Point& q, size_t k) const {
+        std::vector<Point> result;
+        for (uint32_t i : knnPositions(q, k)) {
+            result.push_back(points[i]);
+        }
+        return result;
+    }
+
+    // Build-input indices of the k points closest to q, closest first
+    std::vector<uint32_t> knnIndices(const Point& q, size_t k) const {
+        std::vector<uint32_t> result;
+        for (uint32_t i : knnPositions(q, k)) {
+            result.push_back(indices[i]);
+        }
+        return result;
+    }
+
+    // Closest point to q, or nothing if the tree is empty
+    std::optional<Point> nearest(const Point& q) const {
+        std::vector<Point> result = knn(q, 1);
+        if (result.empty()) return std::nullopt;
+        return result.front();
+    }
+
+    // Batched rangeQuery: result[i] holds the points inside
+    // [queryMins[i], queryMaxs[i]]. Queries run in Morton order of their
+    // box centers so that neighbouring queries share cached nodes.
+    std::vector<std::vector<Point>> rangeQueryBatch(const std::vector<Point>& queryMins,
+                                                    const std::vector<Point>& queryMaxs) const {
+        size_t count = std::min(queryMins.size(), queryMaxs.size());
+        std::vector<Point> centers(count);
+        for (size_t i = 0; i < count; ++i) {
+            centers[i] = Point((queryMins[i].x + queryMaxs[i].x) * 0.5f,
+                               (queryMins[i].y + queryMaxs[i].y) * 0.5f,
+                               (queryMins[i].z + queryMaxs[i].z) * 0.5f);
+        }
+
+        std::vector<std::vector<Point>> results(count);
+        for (uint32_t i : mortonQueryOrder(centers, min, max)) {
+            std::vector<Point>& result = results[i];
+            rangeQuery(queryMins[i], queryMaxs[i], [&](const Point& p) { result.push_back(p); });
+        }
+        return results;
+    }
+
+    // Batched knn: result[i] holds the k points closest to queries[i], run in Morton order
+    std::vector<std::vector<Point>> knnBatch(const std::vector<Point>& queries, size_t k) const {
+        std::vector<std::vector<Point>> results(queries.size());
+        for (uint32_t i : mortonQueryOrder(queries, min, max)) {
+            results[i] = knn(queries[i], k);
+        }
+        return results;
+    }
+
+    // Get statistics about the octree
+    void getStatistics(int& totalNodes, int& leafNodes, int& totalPoints, int& maxDepth) const {
+        totalNodes = static_cast<int>(nodes.size());
+        totalPoints = static_cast<int>(points.size());
+        for (const auto& node : nodes) {
+            if (node.isLeaf()) leafNodes++;
+            maxDepth = std::max(maxDepth, static_cast<int>(node.level));
+        }
+    }
+
+    // Memory footprint of the arrays. A mapped tree allocates none of them;
+    // its file is reported as mappedBytes instead.
+    OctreeMemoryStats getMemoryStatistics() const {
+        OctreeMemoryStats stats;
+        stats.nodes = nodes.size();
+        stats.nodeStructBytes = sizeof(Node);
+        stats.points = points.size();
+        if (mapping) {
+            stats.mappedBytes = mapping->size();
+            return stats;
+        }
+        stats.nodeBytes = storage.nodes.capacity() * sizeof(Node);
+        addAllocation(stats, stats.nodeBytes);
+        addPointVector<std::allocator<Point>>(stats, storage.points);
+        addAuxiliaryVector(stats, storage.codes);
+        addAuxiliaryVector(stats, storage.soa.x);
+        addAuxiliaryVector(stats, storage.soa.y);
+        addAuxiliaryVector(stats, storage.soa.z);
+        addAuxiliaryVector(stats, storage.indices);
+        return stats;
+    }
+
+    void printStatistics() const {
+        int totalNodes = 0, leafNodes = 0, totalPoints = 0, maxDepth = 0;
+        getStatistics(totalNodes, leafNodes, totalPoints, maxDepth);
+
+        std::cout << "=== Linear Octree Statistics ===" << std::endl;
+        std::cout << "Total nodes: " << totalNodes << std::endl;
+        std::cout << "Leaf nodes: " << leafNodes << std::endl;
+        std::cout << "Internal nodes: " << (totalNodes - leafNodes) << std::endl;
+        std::cout << "Total points: " << totalPoints << std::endl;
+        std::cout << "Maximum depth: " << maxDepth << std::endl;
+        std::cout << "Average points per leaf: " << (leafNodes > 0 ? (float)totalPoints / leafNodes : 0) << std::endl;
+        std::cout << "Curve: " << curveName(curve) << std::endl;
+        printMemoryStatistics(getMemoryStatistics());
+        printInstrumentationStatistics();
+    }
+
+private:
+    // Front-to-back walk over the cells near the ray, see ::rayTraverse
+    template <typename VisitNode>
+    bool rayTraverse(const Ray& ray, float radius, const float& cutoff, VisitNode&& visitNode) const {
+        return ::rayTraverse<MaxDepth>(
+            ray, radius, cutoff, uint32_t(0),
+            [this](uint32_t nodeIndex) -> const Node& { return nodes[nodeIndex]; },
+            [this](uint32_t nodeIndex, RayChildOrder<uint32_t>& children) { pushChildren(nodes[nodeIndex], children); },
+            visitNode);
+    }
+
+    // Arrays owned by a built tree; empty while the tree is mapped from a file
+    struct Storage {
+        std::vector<Node> nodes;
+        std::vector<Point> points;
+        std::vector<uint64_t> codes;
+        PointSoA soa;
+        std::vector<uint32_t> indices;
+    };
+
+    Storage storage;
+    std::shared_ptr<const MappedFile> mapping;
+
+    // Sorted-array positions of the k points closest to q, closest first
+    std::vector<uint32_t> knnPositions(const Point& q, size_t k) const {
+        if (k == 0) return {};
+        OCTREE_TRACE_SCOPE("knn");
+        KnnCollector<uint32_t> collector(k);
+
+        using Entry = std::pair<float, uint32_t>;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+        queue.push({nodes[0].boxDistanceSquared(q), 0});
+
+        while (!queue.empty()) {
+            auto [dist, nodeIndex] = queue.top();
+            queue.pop();
+            if (dist > collector.worstDistanceSquared()) break;
+
+            const Node& node = nodes[nodeIndex];
+            OCTREE_COUNT(NodesVisited, 1);
+            if (node.isLeaf()) {
+                OCTREE_COUNT(PointsTested, node.end - node.begin);
+                simdScanDistances(soa.x.data(), soa.y.data(), soa.z.data(), node.begin, node.end, q,
+                                  [&](size_t i, float d2) { collector.offer(static_cast<uint32_t>(i), d2); });
+                continue;
+            }
+
+            for (uint32_t c = 0; c < node.childCount; ++c) {
+                float childDist = nodes[node.firstChild + c].boxDistanceSquared(q);
+                if (childDist <= collector.worstDistanceSquared()) {
+                    queue.push({childDist, node.firstChild + c});
+                }
+            }
+        }
+        return collector.sortedPoints();
+    }
+
+    template <typename Visitor>
+    bool visitRange(uint32_t begin, uint32_t end, Visitor& visit) const {
+        for (uint32_t i = begin; i < end; ++i) {
+            if (!invokeVisitor(visit, points[i])) return false;
+        }
+        return true;
+    }
+
+    // Push the children of node for a depth-first walk, last child first so
+    // that they pop in storage order. Siblings are contiguous, so the
+    // prefetch covers the whole block at once.
+    template <typename Stack>
+    void pushChildren(const Node& node, Stack& stack) const {
+        if (node.childCount == 0) return;
+        prefetchRead(&nodes[node.firstChild]);
+        prefetchRead(&nodes[node.firstChild + node.childCount - 1]);
+        for (uint32_t c = node.childCount; c > 0; --c) {
+            stack.push(node.firstChild + c - 1);
+        }
+    }
+
+    Node makeNode(uint64_t key, int level, uint32_t begin, uint32_t end) const {
+        Node node;
+        node.key = key;
+        node.level = static_cast<uint8_t>(level);
+        node.begin = begin;
+        node.end = end;
+        node.firstChild = 0;
+        node.childCount = 0;
+        node.childMask = 0;
+        calculateCellBounds(key, level, node.min, node.max);
+        return node;
+    }
+
+    // Derive the cell bounds from its key prefix and level. The bounds are
+    // rounded outwards so they always contain the points quantized into them.
+    void calculateCellBounds(uint64_t key, int level, Point& cellMin, Point& cellMax) const {
+        uint32_t cell[3];
+        curveDecodeCell(curve, key, level, cell[0], cell[1], cell[2]);
+        const float rootMin[3] = {min.x, min.y, min.z};
+        const float rootMax[3] = {max.x, max.y, max.z};
+        float lo[3], hi[3];
+        uint32_t last = (1u << level) - 1;
+
+        for (int axis = 0; axis < 3; ++axis) {
+            double size = (static_cast<double>(rootMax[axis]) - rootMin[axis]) / static_cast<double>(1u << level);
+            double cellLo = rootMin[axis] + cell[axis] * size;
+            lo[axis] = (cell[axis] == 0) ? rootMin[axis] : roundDown(cellLo);
+            hi[axis] = (cell[axis] == last) ? rootMax[axis] : roundUp(cellLo + size);
+        }
+
+        cellMin = {lo[0], lo[1], lo[2]};
+        cellMax = {hi[0], hi[1], hi[2]};
+    }
+
+    static float roundDown(double v) {
+        float f = static_cast<float>(v);
+        return (f > v) ? std::nextafter(f, -HUGE_VALF) : f;
+    }
+
+    static float roundUp(double v) {
+        float f = static_cast<float>(v);
+        return (f < v) ? std::nextafter(f, HUGE_VALF) : f;
+    }
+
+    // Split the sorted key array into cells level by level. Points sharing
+    // the first 3 * level bits of their key belong to the same cell.
+    void buildNodes() {
+        std::vector<Node>& nodes = storage.nodes;
+        nodes.clear();
+        nodes.push_back(makeNode(0, 0, 0, static_cast<uint32_t>(storage.points.size())));
+
+        for (size_t current = 0; current < nodes.size(); ++current) {
+            Node node = nodes[current];
+            // Points that share one key cannot be told apart at any depth
+            if (!options.shouldSplit(storage.points.begin() + node.begin, storage.points.begin() + node.end,
+                                     node.level, node.min, node.max) ||
+                storage.codes[node.begin] == storage.codes[node.end - 1]) {
+                continue;
+            }
+
+            OCTREE_COUNT(Subdivisions, 1);
+            int childShift = 3 * (MORTON_BITS_PER_AXIS - node.level - 1);
+            uint32_t firstChild = static_cast<uint32_t>(nodes.size());
+            uint8_t childCount = 0;
+            uint8_t childMask = 0;
+
+            uint32_t begin = node.begin;
+            while (begin < node.end) {
+                uint64_t childKey = (node.key << 3) | ((storage.codes[begin] >> childShift) & 7);
+                // First code past this child's range
+                uint64_t limit = (childKey + 1) << childShift;
+                uint32_t end = static_cast<uint32_t>(
+                    std::lower_bound(storage.codes.begin() + begin, storage.codes.begin() + node.end, limit) -
+                    storage.codes.begin());
+
+                nodes.push_back(makeNode(childKey, node.level + 1, begin, end));
+                OCTREE_COUNT(NodesAllocated, 1);
+                childMask |= static_cast<uint8_t>(1u << childOctant(childKey, node.level + 1));
+                childCount++;
+                begin = end;
+            }
+
+            nodes[current].firstChild = firstChild;
+            nodes[current].childCount = childCount;
+            nodes[current].childMask = childMask;
+        }
+
+        // Children follow their parent, so a backward pass sees them first
+        for (size_t i = nodes.size(); i-- > 0;) {
+            Node& node = nodes[i];
+            if (node.isLeaf()) {
+                node.aggregate = PointAggregate::of(storage.points.begin() + node.begin, storage.points.begin() + node.end);
+                continue;
+            }
+            for (uint32_t c = 0; c < node.childCount; ++c) {
+                node.aggregate.merge(nodes[node.firstChild + c].aggregate);
+            }
+        }
+        bindStorage();
+    }
+
+    // Octant of a cell within its parent, numbered like getOctant. On the
+    // Morton curve it is the last key triple; Hilbert keys permute the octants.
+    int childOctant(uint64_t key, int level) const {
+        if (curve == SpaceFillingCurve::Morton) return static_cast<int>(key & 7);
+        uint32_t cell[3];
+        curveDecodeCell(curve, key, level, cell[0], cell[1], cell[2]);
+        return static_cast<int>((cell[0] & 1) | ((cell[1] & 1) << 1) | ((cell[2] & 1) << 2));
+    }
+
+    // Point the public views at the owned storage and drop any mapped file
+    void bindStorage() {
+        mapping.reset();
+        nodes = ArrayView<Node>(storage.nodes);
+        points = ArrayView<Point>(storage.points);
+        codes = ArrayView<uint64_t>(storage.codes);
+        soa = PointSoAView(storage.soa);
+        indices = ArrayView<uint32_t>(storage.indices);
+    }
+
+    void printNode(uint32_t nodeIndex, int depth) const {
+        const Node& node = nodes[nodeIndex];
+        std::string indent(depth * 2, ' ');
+        std::cout << indent << "Node bounds: (" << node.min.x << "," << node.min.y << "," << node.min.z
+                  << ") to (" << node.max.x << "," << node.max.y << "," << node.max.z << ")" << std::endl;
+        std::cout << indent << "Points: " << (node.isLeaf() ? node.end - node.begin : 0) << std::endl;
+        std::cout << indent << "Active children: " << static_cast<int>(node.childCount) << std::endl;
+        std::cout << indent << curveName(curve) << " key: 0x" << std::hex << node.key << std::dec
+                  << ", Depth: " << static_cast<int>(node.level) << std::endl;
+
+        for (uint32_t c = 0; c < node.childCount; ++c) {
+            printNode(node.firstChild + c, depth + 1);
+        }
+    }
+};
+
+// Convenience typedef for the linear octree with default limits
+using OctreeLinear = BasicOctreeLinear<>;
+
+#endif // OCTREE_LINEAR_H
@@ -0,0 +1,293 @@
+#ifndef OCTREE_LOD_H
+#define OCTREE_LOD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <climits>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include "point.h"
+#include "octree_query.h"
+#include "octree_traversal.h"
+#include "octree_geometry.h"
+
+// Where lodQuery stops refining. A node is replaced by its children while
+// its level is below maxLevel and its sample spacing, projected to the
+// screen at its distance from eye, exceeds maxError pixels; a maxError of 0
+// refines every node down to maxLevel. Nodes outside the optional frustum
+// are culled with their subtrees.
+struct LodView {
+    Point eye;
+    // Pixels per world unit at distance 1: viewportHeight / (2 * tan(fovY / 2))
+    float projectionScale = 1.0f;
+    float maxError = 0.0f;
+    int maxLevel = INT_MAX;
+    const Frustum* frustum = nullptr;
+
+    // Every node refined down to level, the depth budget
+    static LodView toLevel(int level) {
+        LodView view;
+        view.maxLevel = level;
+        return view;
+    }
+
+    // Screen-space error budget for a camera at eye
+    static LodView screenError(const Point& eye, float projectionScale, float maxError,
+                               const Frustum* frustum = nullptr) {
+        LodView view;
+        view.eye = eye;
+        view.projectionScale = projectionScale;
+        view.maxError = maxError;
+        view.frustum = frustum;
+        return view;
+    }
+};
+
+// Level-of-detail summaries for a pointer octree (BasicOctreeNode,
+// BasicOctreeHashMapNode, BasicOctreeMortonNode), for streaming coarse
+// levels first. Every internal node gets the count and centroid of its
+// subtree and a representative subsample: the node box is cut into
+// samplesPerAxis^3 cells and each cell keeps the candidate closest to its
+// center, drawn from the children's samples (or points, for leaf children).
+// The summaries are a snapshot stored in the tree's depth-first order, so
+// a query is a forward scan that skips whole subtrees; rebuild after the
+// tree is modified.
+template <typename Tree>
+class OctreeLOD {
+public:
+    using PointType = typename Tree::value_type;
+
+    // Summary of one node. A complete node holds no more points than its
+    // grid keeps, so it stores no samples and stands for all its points:
+    // every leaf is complete, and so is a sparse subtree.
+    struct Node {
+        const Tree* node;
+        Point centroid;
+        uint64_t count;
+        uint32_t sampleBegin, sampleEnd;
+        // Summaries in this node's subtree, itself included
+        uint32_t subtreeSize;
+        int level;
+        bool complete;
+
+        bool isLeaf() const { return node->isLeaf(); }
+    };
+
+    OctreeLOD() = default;
+
+    explicit OctreeLOD(const Tree& root, int samplesPerAxis = 8) { build(root, samplesPerAxis); }
+
+    void build(const Tree& root, int samplesPerAxis = 8) {
+        gridSize = std::max(1, samplesPerAxis);
+        nodes.clear();
+        samples.clear();
+
+        // Depth-first preorder, so every subtree is one contiguous run
+        std::vector<uint32_t> parents;
+        TraversalStack<std::pair<const Tree*, uint32_t>, Tree::MAX_DEPTH> stack;
+        stack.push({&root, UINT32_MAX});
+        ChildCollector children;
+        while (!stack.empty()) {
+            auto [node, parent] = stack.pop();
+            uint32_t index = static_cast<uint32_t>(nodes.size());
+            int level = parent == UINT32_MAX ? 0 : nodes[parent].level + 1;
+            nodes.push_back(Node{node, Point(), 0, 0, 0, 1, level, node->isLeaf()});
+            parents.push_back(parent);
+            children.count = 0;
+            node->pushChildren(children);
+            for (int i = 0; i < children.count; ++i) {
+                stack.push({children.nodes[i], index});
+            }
+        }
+
+        // Children before parents: counts, sums and subtree sizes accumulate upwards
+        std::vector<double> sums(3 * nodes.size(), 0.0);
+        for (size_t i = nodes.size(); i-- > 0;) {
+            Node& entry = nodes[i];
+            if (entry.isLeaf()) {
+                for (const auto& p : entry.node->points) {
+                    sums[3 * i] += p.x;
+                    sums[3 * i + 1] += p.y;
+                    sums[3 * i + 2] += p.z;
+                }
+                entry.count = entry.node->points.size();
+            }
+            if (entry.count > 0) {
+                entry.centroid = Point(static_cast<float>(sums[3 * i] / entry.count),
+                                       static_cast<float>(sums[3 * i + 1] / entry.count),
+                                       static_cast<float>(sums[3 * i + 2] / entry.count));
+            }
+            uint32_t parent = parents[i];
+            if (parent != UINT32_MAX) {
+                nodes[parent].count += entry.count;
+                nodes[parent].subtreeSize += entry.subtreeSize;
+                for (int axis = 0; axis < 3; ++axis) sums[3 * parent + axis] += sums[3 * i + axis];
+            }
+        }
+
+        // Samples, again children first, so that a node draws from its children's sets
+        std::vector<std::vector<PointType>> pending(nodes.size());
+        std::vector<const PointType*> candidates;
+        const size_t cells = static_cast<size_t>(gridSize) * gridSize * gridSize;
+        for (size_t i = nodes.size(); i-- > 0;) {
+            Node& entry = nodes[i];
+            if (entry.isLeaf()) continue;
+            candidates.clear();
+            bool childrenComplete = true;
+            for (size_t c = i + 1; c < i + entry.subtreeSize; c += nodes[c].subtreeSize) {
+                childrenComplete = childrenComplete && nodes[c].complete;
+                if (nodes[c].isLeaf()) {
+                    for (const auto& p : nodes[c].node->points) candidates.push_back(&p);
+                } else {
+                    for (const auto& p : pending[c]) candidates.push_back(&p);
+                }
+            }
+            entry.complete = childrenComplete && candidates.size() <= cells;
+            select(*entry.node, candidates, pending[i]);
+        }
+
+        // Flatten in preorder, so the samples of a query's nodes are read in order
+        size_t total = 0;
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            if (!nodes[i].complete) total += pending[i].size();
+        }
+        samples.reserve(total);
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            nodes[i].sampleBegin = static_cast<uint32_t>(samples.size());
+            if (!nodes[i].complete) samples.insert(samples.end(), pending[i].begin(), pending[i].end());
+            nodes[i].sampleEnd = static_cast<uint32_t>(samples.size());
+        }
+    }
+
+    // Calls visit(summary) for the nodes that represent the tree under the
+    // view: a node where refinement stops, or a complete node reached by
+    // refining.
+    // Together they cover every point once (less the culled ones), in
+    // depth-first order.
+    template <typename Visitor>
+    void forEachSelected(const LodView& view, Visitor&& visit) const {
+        size_t i = 0;
+        while (i < nodes.size()) {
+            const Node& entry = nodes[i];
+            const Tree& node = *entry.node;
+            if (entry.count == 0 ||
+                (view.frustum != nullptr && view.frustum->classify(node.min, node.max) == BoxRelation::Outside)) {
+                i += entry.subtreeSize;
+                continue;
+            }
+            if (entry.complete || !refines(entry, view)) {
+                if (!invokeVisitor(visit, entry)) return;
+                i += entry.subtreeSize;
+                continue;
+            }
+            ++i;
+        }
+    }
+
+    // Points of the selected nodes: the samples where refinement stopped and
+    // every point of the complete nodes it reached. A visitor returning bool
+    // can stop the query.
+    template <typename Visitor>
+    bool lodQuery(const LodView& view, Visitor&& visit) const {
+        bool more = true;
+        forEachSelected(view, [&](const Node& entry) {
+            if (entry.complete) {
+                more = entry.node->forEachPoint(visit);
+                return more;
+            }
+            for (const PointType* p = samplesBegin(entry); p != samplesEnd(entry); ++p) {
+                if (!invokeVisitor(visit, *p)) {
+                    more = false;
+                    break;
+                }
+            }
+            return more;
+        });
+        return more;
+    }
+
+    std::vector<PointType> lodQuery(const LodView& view) const {
+        std::vector<PointType> result;
+        lodQuery(view, [&](const PointType& p) { result.push_back(p); });
+        return result;
+    }
+
+    // Samples of a summary; empty for complete nodes
+    const PointType* samplesBegin(const Node& entry) const { return samples.data() + entry.sampleBegin; }
+    const PointType* samplesEnd(const Node& entry) const { return samples.data() + entry.sampleEnd; }
+
+    // Summaries in depth-first order; the first is the root
+    const std::vector<Node>& summaries() const { return nodes; }
+
+    size_t sampleCount() const { return samples.size(); }
+
+    // Bytes of the summaries and samples
+    size_t memoryBytes() const { return nodes.capacity() * sizeof(Node) + samples.capacity() * sizeof(PointType); }
+
+private:
+    // Stand-in stack for pushChildren, which pushes children in reverse
+    // order: collected here and pushed again so that they pop the same way
+    struct ChildCollector {
+        const Tree* nodes[8];
+        int count = 0;
+        void push(const Tree* node) { nodes[count++] = node; }
+    };
+
+    // Sample spacing of an entry projected at its distance from the eye
+    bool refines(const Node& entry, const LodView& view) const {
+        if (entry.level >= view.maxLevel) return false;
+        if (!(view.maxError > 0.0f)) return true;
+        const Tree& node = *entry.node;
+        float longest = std::max({node.max.x - node.min.x, node.max.y - node.min.y, node.max.z - node.min.z});
+        float distance = std::sqrt(::boxDistanceSquared(view.eye, node.min, node.max));
+        if (!(distance > 0.0f)) return true;
+        return longest / gridSize * view.projectionScale / distance > view.maxError;
+    }
+
+    // Grid-stratified subsample: per cell of the node's grid, the candidate
+    // closest to the cell center
+    void select(const Tree& node, const std::vector<const PointType*>& candidates, std::vector<PointType>& out) {
+        const size_t cells = static_cast<size_t>(gridSize) * gridSize * gridSize;
+        // Nothing to thin: the grid would keep every candidate
+        if (candidates.size() <= cells) {
+            out.reserve(candidates.size());
+            for (const PointType* p : candidates) out.push_back(*p);
+            return;
+        }
+        best.assign(cells, nullptr);
+        bestDistance.assign(cells, std::numeric_limits<float>::infinity());
+        const Point extent(node.max.x - node.min.x, node.max.y - node.min.y, node.max.z - node.min.z);
+        auto cellOf = [&](float v, float lo, float size, int& cell, float& cellCenter) {
+            float scaled = size > 0.0f ? (v - lo) / size * gridSize : 0.0f;
+            cell = std::min(std::max(static_cast<int>(scaled), 0), gridSize - 1);
+            cellCenter = lo + (cell + 0.5f) * size / gridSize;
+        };
+        for (const PointType* p : candidates) {
+            int cx, cy, cz;
+            Point cellCenter;
+            cellOf(p->x, node.min.x, extent.x, cx, cellCenter.x);
+            cellOf(p->y, node.min.y, extent.y, cy, cellCenter.y);
+            cellOf(p->z, node.min.z, extent.z, cz, cellCenter.z);
+            size_t cell = (static_cast<size_t>(cz) * gridSize + cy) * gridSize + cx;
+            float d = distanceSquared(*p, cellCenter);
+            if (d < bestDistance[cell]) {
+                bestDistance[cell] = d;
+                best[cell] = p;
+            }
+        }
+        for (const PointType* p : best) {
+            if (p != nullptr) out.push_back(*p);
+        }
+    }
+
+    std::vector<Node> nodes;
+    std::vector<PointType> samples;
+    int gridSize = 8;
+    // Scratch of select()
+    std::vector<const PointType*> best;
+    std::vector<float> bestDistance;
+};
+
+#endif // OCTREE_LOD_H
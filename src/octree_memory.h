@@ -0,0 +1,115 @@
+#ifndef OCTREE_MEMORY_H
+#define OCTREE_MEMORY_H
+
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include "node_arena.h"
+
+// Memory footprint of an octree, filled by getMemoryStatistics(). Byte
+// counts are what the tree asked for; allocatorOverheadBytes estimates what
+// the heap adds on top: a malloc chunk header plus rounding to 16 bytes per
+// block, as glibc does. Arena allocations carry no per-block overhead (the
+// arena's own unused tail is NodeArena::reservedBytes() - allocatedBytes()).
+struct OctreeMemoryStats {
+    // Node structs, including the fields embedded in them
+    size_t nodeBytes = 0;
+    size_t nodes = 0;
+    size_t nodeStructBytes = 0;
+    // Child containers allocated outside the nodes: hash map buckets and
+    // entries, packed child slot arrays
+    size_t childIndexBytes = 0;
+    // Point storage holding points, and capacity reserved but unused
+    size_t pointBytes = 0;
+    size_t pointSlackBytes = 0;
+    // Other arrays a tree keeps: Morton codes, SoA mirror, index permutation, page cache
+    size_t auxiliaryBytes = 0;
+    // Estimated heap bookkeeping and the number of heap blocks it covers
+    size_t allocatorOverheadBytes = 0;
+    size_t allocations = 0;
+    // File bytes mapped instead of allocated; not part of totalBytes()
+    size_t mappedBytes = 0;
+    size_t points = 0;
+
+    size_t totalBytes() const {
+        return nodeBytes + childIndexBytes + pointBytes + pointSlackBytes + auxiliaryBytes + allocatorOverheadBytes;
+    }
+
+    double bytesPerPoint() const { return points > 0 ? static_cast<double>(totalBytes()) / points : 0.0; }
+};
+
+// Heap block size malloc uses for a request of the given size
+inline size_t heapBlockBytes(size_t bytes) {
+    if (bytes == 0) return 0;
+    size_t block = (bytes + sizeof(size_t) + 15) & ~size_t(15);
+    return block < 32 ? 32 : block;
+}
+
+// Records one allocation of bytes made through Allocator
+template <typename Allocator = std::allocator<char>>
+void addAllocation(OctreeMemoryStats& stats, size_t bytes) {
+    if (bytes == 0) return;
+    stats.allocations++;
+    if constexpr (!is_arena_allocator<Allocator>::value) {
+        stats.allocatorOverheadBytes += heapBlockBytes(bytes) - bytes;
+    }
+}
+
+// Point buffer: points held, capacity slack and its heap block
+template <typename Allocator, typename Vector>
+void addPointVector(OctreeMemoryStats& stats, const Vector& points) {
+    using T = typename Vector::value_type;
+    stats.pointBytes += points.size() * sizeof(T);
+    stats.pointSlackBytes += (points.capacity() - points.size()) * sizeof(T);
+    addAllocation<Allocator>(stats, points.capacity() * sizeof(T));
+}
+
+// Any other vector, counted at its capacity into stats.auxiliaryBytes
+template <typename Allocator = std::allocator<char>, typename Vector>
+void addAuxiliaryVector(OctreeMemoryStats& stats, const Vector& values) {
+    size_t bytes = values.capacity() * sizeof(typename Vector::value_type);
+    stats.auxiliaryBytes += bytes;
+    addAllocation<Allocator>(stats, bytes);
+}
+
+// Bucket array plus one heap node per entry of an unordered_map. The entry
+// layout is the libstdc++ one: next pointer followed by the value, with no
+// cached hash for the integer keys the octrees use. A map with a single
+// bucket uses storage inside the map object and allocates no bucket array.
+template <typename Allocator, typename Map>
+void addUnorderedMap(OctreeMemoryStats& stats, const Map& map) {
+    struct Entry {
+        void* next;
+        typename Map::value_type value;
+    };
+    if (map.bucket_count() > 1) {
+        size_t bucketBytes = map.bucket_count() * sizeof(void*);
+        stats.childIndexBytes += bucketBytes;
+        addAllocation<Allocator>(stats, bucketBytes);
+    }
+    stats.childIndexBytes += map.size() * sizeof(Entry);
+    for (size_t i = 0; i < map.size(); ++i) {
+        addAllocation<Allocator>(stats, sizeof(Entry));
+    }
+}
+
+// Memory section of printStatistics()
+inline void printMemoryStatistics(const OctreeMemoryStats& stats) {
+    std::cout << "Memory: " << stats.totalBytes() << " bytes (" << stats.bytesPerPoint() << " bytes per point)" << std::endl;
+    std::cout << "  Nodes: " << stats.nodeBytes << " bytes (" << stats.nodes << " x " << stats.nodeStructBytes
+              << " bytes)" << std::endl;
+    if (stats.childIndexBytes > 0) {
+        std::cout << "  Child containers: " << stats.childIndexBytes << " bytes" << std::endl;
+    }
+    std::cout << "  Points: " << stats.pointBytes << " bytes, " << stats.pointSlackBytes << " bytes unused capacity" << std::endl;
+    if (stats.auxiliaryBytes > 0) {
+        std::cout << "  Auxiliary arrays: " << stats.auxiliaryBytes << " bytes" << std::endl;
+    }
+    std::cout << "  Allocator overhead (estimated): " << stats.allocatorOverheadBytes << " bytes in "
+              << stats.allocations << " allocations" << std::endl;
+    if (stats.mappedBytes > 0) {
+        std::cout << "  Mapped file: " << stats.mappedBytes << " bytes" << std::endl;
+    }
+}
+
+#endif // OCTREE_MEMORY_H
@@ -5,36 +5,101 @@
 #include <vector>
 #include <unordered_map>
 #include <memory>
-#include <fstream>
-#include <iomanip>
 #include <string>
 #include <cstdint>
 #include <algorithm>
+#include <queue>
+#include <optional>
+#include <functional>
+#include <array>
 #include "point.h"
-
-class OctreeMortonNode {
+#include "octree_query.h"
+#include "octree_options.h"
+#include "vtk_writer.h"
+#include "octree_memory.h"
+#include "octree_traversal.h"
+#include "octree_geometry.h"
+#include "octree_aggregate.h"
+#include "octree_instrumentation.h"
+#include "node_arena.h"
+#include "thread_pool.h"
+#include "child_storage.h"
+
+// LeafCapacity and MaxDepth are the compile-time defaults for the
+// subdivision limits; OctreeOptions can override them per tree at runtime.
+// Nodes, child maps and point buffers are allocated through Allocator, which
+// must be either stateless (like std::allocator) or an arena allocator; with
+// an ArenaAllocator the tree is torn down by releasing the arena.
+// ChildStorage selects the child container: HashChildStorage (one
+// unordered_map per node) or CompactChildStorage (occupancy mask + packed array).
+// PointType is the stored element: Point or a type derived from it that
+// carries a payload, e.g. IndexedPoint. Queries return PointType values.
+template <size_t LeafCapacity = 1, int MaxDepth = 20, typename Allocator = std::allocator<Point>,
+          template <typename, typename, typename> class ChildStorage = HashChildStorage,
+          typename PointType = Point>
+class BasicOctreeMortonNode {
 public:
+    using allocator_type = Allocator;
+    using value_type = PointType;
+    using PointAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<PointType>;
+    using PointIterator = typename std::vector<PointType>::iterator;
+    using NodeAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<BasicOctreeMortonNode>;
+    using NodeTraits = std::allocator_traits<NodeAllocator>;
+
+    // Returns a child to its allocator. Arena memory is reclaimed in bulk,
+    // so arena-backed children are simply dropped.
+    struct ChildDeleter {
+        void operator()(BasicOctreeMortonNode* child) const {
+            if constexpr (!is_arena_allocator<Allocator>::value) {
+                NodeAllocator alloc;
+                NodeTraits::destroy(alloc, child);
+                NodeTraits::deallocate(alloc, child, 1);
+            }
+        }
+    };
+    using ChildPtr = std::unique_ptr<BasicOctreeMortonNode, ChildDeleter>;
+    using ChildContainer = ChildStorage<uint64_t, ChildPtr, Allocator>;
+
     // Bounding box: min and max coordinates
     Point min, max;
+    // Midpoint of the box, kept for octant selection and child bounds
+    Point center;
     
     // Child nodes stored in hashmap with Morton key as key
-    std::unordered_map<uint64_t, std::unique_ptr<OctreeMortonNode>> children;
+    ChildContainer children;
     
     // Data (list of points)
-    std::vector<Point> points;
+    std::vector<PointType, PointAllocator> points;
     
     // Morton key for this node
     uint64_t morton_key;
     int depth;
+    // Subdivision limits, inherited by every child
+    OctreeOptions options;
+    // Count, coordinate sums and tight bounds of the points in this subtree
+    PointAggregate aggregate;
     
     // Maximum points per leaf before subdivision
-    static const size_t MAX_POINTS_PER_LEAF = 1;
-    static const int MAX_DEPTH = 20;  // Practical limit for 64-bit Morton keys
+    static constexpr size_t MAX_POINTS_PER_LEAF = LeafCapacity;
+    static constexpr int MAX_DEPTH = MaxDepth;
+    static_assert(MaxDepth <= 21, "Morton keys hold 3 bits per level in 64 bits");
+
+    static constexpr OctreeOptions defaultOptions() {
+        return OctreeOptions{static_cast<uint32_t>(LeafCapacity), MaxDepth};
+    }
 
-    OctreeMortonNode(const Point& min, const Point& max, uint64_t key = 0, int d = 0) 
-        : min(min), max(max), morton_key(key), depth(d) {}
+    BasicOctreeMortonNode(const Point& min, const Point& max, uint64_t key = 0, int d = 0)
+        : BasicOctreeMortonNode(min, max, defaultOptions(), key, d) {}
 
-    void insert(const Point& p) {
+    BasicOctreeMortonNode(const Point& min, const Point& max, const Allocator& alloc)
+        : BasicOctreeMortonNode(min, max, defaultOptions(), 0, 0, alloc) {}
+
+    BasicOctreeMortonNode(const Point& min, const Point& max, const OctreeOptions& options, uint64_t key = 0, int d = 0,
+                          const Allocator& alloc = Allocator())
+        : min(min), max(max), center(boxCenter(min, max)), children(alloc), points(PointAllocator(alloc)),
+          morton_key(key), depth(d), options(options.clampedTo(MaxDepth)) {}
+
+    void insert(const PointType& p) {
         // Check if point is within bounds
         if (!contains(p)) {
             std::cout << "Warning: Point (" << p.x << ", " << p.y << ", " << p.z 
@@ -42,23 +107,265 @@ public:
             return;
         }
 
+        // Descend to the leaf that owns p, creating missing children on the way
+        BasicOctreeMortonNode* node = this;
+        while (!node->isLeaf()) {
+            OCTREE_COUNT(NodesVisited, 1);
+            node->aggregate.add(p);
+            uint64_t childKey = node->getChildMortonKey(p);
+            BasicOctreeMortonNode* child = node->children.get(childKey);
+            OCTREE_COUNT(ChildLookups, 1);
+            if (child == nullptr) {
+                child = node->children.set(childKey, node->createChild(childKey));
+            }
+            node = child;
+        }
+
+        OCTREE_COUNT(NodesVisited, 1);
+        node->aggregate.add(p);
+        node->points.push_back(p);
+        // Subdivide if too many points, unless a limit or a cluster keeps the leaf whole
+        if (options.shouldSplitAfterInsert(node->points.begin(), node->points.end(), node->depth, node->min, node->max)) {
+            node->subdivide();
+        }
+    }
+
+    // Remove all points and children
+    void clear() {
+        children.clear();
+        points.clear();
+        aggregate = PointAggregate();
+    }
+
+    // Remove one stored point equal to p; false if there is none. On the way
+    // back up, a subtree left with at most maxPointsPerLeaf points is merged
+    // into its root, undoing subdivide().
+    bool remove(const PointType& p) {
+        if (!contains(p)) {
+            return false;
+        }
+
+        if (isLeaf()) {
+            auto it = std::find(points.begin(), points.end(), p);
+            if (it == points.end()) return false;
+            *it = points.back();
+            points.pop_back();
+            aggregate.remove(p);
+            return true;
+        }
+
+        uint64_t childKey = getChildMortonKey(p);
+        BasicOctreeMortonNode* child = children.get(childKey);
+        OCTREE_COUNT(ChildLookups, 1);
+        if (child == nullptr || !child->remove(p)) {
+            return false;
+        }
+        aggregate.remove(p);
+        // Drop children that lost their last point
+        if (child->isLeaf() && child->points.empty()) {
+            children.erase(childKey);
+        }
+
+        if (aggregate.count <= options.maxPointsPerLeaf) {
+            coalesce();
+        }
+        return true;
+    }
+
+    // Move a stored point. Both positions are followed down while they share
+    // a child; in a common leaf the point is overwritten in place, otherwise
+    // it is removed and reinserted below the deepest node holding both.
+    // False if oldPoint is not stored or newPoint is outside this node.
+    bool update(const PointType& oldPoint, const PointType& newPoint) {
+        if (!contains(oldPoint) || !contains(newPoint)) {
+            return false;
+        }
+
         if (isLeaf()) {
-            points.push_back(p);
-            // Subdivide if too many points
-            if (points.size() > MAX_POINTS_PER_LEAF && depth < MAX_DEPTH) {
-                subdivide();
+            auto it = std::find(points.begin(), points.end(), oldPoint);
+            if (it == points.end()) return false;
+            *it = newPoint;
+            aggregate.remove(oldPoint);
+            aggregate.add(newPoint);
+            return true;
+        }
+
+        uint64_t oldKey = getChildMortonKey(oldPoint);
+        if (oldKey == getChildMortonKey(newPoint)) {
+            BasicOctreeMortonNode* child = children.get(oldKey);
+            OCTREE_COUNT(ChildLookups, 1);
+            if (child == nullptr || !child->update(oldPoint, newPoint)) return false;
+            aggregate.remove(oldPoint);
+            aggregate.add(newPoint);
+            return true;
+        }
+        if (!remove(oldPoint)) {
+            return false;
+        }
+        insert(newPoint);
+        return true;
+    }
+
+    // Undo subdivide(): pull every point of the subtree into this node and free the children
+    void coalesce() {
+        std::vector<PointType> merged;
+        collectAllPoints(merged);
+        children.clear();
+        points.assign(merged.begin(), merged.end());
+    }
+
+    // Bulk load: replaces the contents of this node with the given points.
+    // Points are partitioned top-down in place and each node is allocated once.
+    void build(const std::vector<PointType>& input) {
+        build(input.begin(), input.end());
+    }
+
+    template <typename InputIt>
+    void build(InputIt first, InputIt last) {
+        OCTREE_TRACE_SCOPE("build");
+        clear();
+
+        std::vector<PointType> work;
+        size_t outside = 0;
+        for (; first != last; ++first) {
+            if (contains(*first)) {
+                work.push_back(*first);
+            } else {
+                outside++;
             }
-        } else {
-            uint64_t childKey = getChildMortonKey(p);
-            
-            // Create child node if it doesn't exist
-            if (children.find(childKey) == children.end()) {
-                Point childMin, childMax;
-                calculateChildBounds(childKey, childMin, childMax);
-                children[childKey] = std::make_unique<OctreeMortonNode>(childMin, childMax, childKey, depth + 1);
+        }
+        if (outside > 0) {
+            std::cout << "Warning: " << outside << " points are outside node bounds" << std::endl;
+        }
+
+        buildRecursive(work.begin(), work.end());
+    }
+
+    void buildRecursive(PointIterator first, PointIterator last) {
+        if (!options.shouldSplit(first, last, depth, min, max)) {
+            points.assign(first, last);
+            aggregate = PointAggregate::of(first, last);
+            return;
+        }
+
+        PointIterator bounds[9];
+        OCTREE_COUNT(Subdivisions, 1);
+        partitionOctants(first, last, bounds);
+
+        // Only octants that received points get a child
+        for (int octant = 0; octant < 8; ++octant) {
+            if (bounds[octant] == bounds[octant + 1]) continue;
+            uint64_t childKey = (morton_key << 3) | octant;
+            ChildPtr child = createChild(childKey);
+            child->buildRecursive(bounds[octant], bounds[octant + 1]);
+            children.set(childKey, std::move(child));
+        }
+        mergeChildAggregates();
+    }
+
+    // Parallel bulk load, same result as build(). The top levels are split
+    // breadth-first, partitioning the nodes of each level concurrently, until
+    // there are several subtrees per thread; the subtrees are then built on
+    // the pool. threadCount == 0 uses every hardware thread.
+    void buildParallel(const std::vector<PointType>& input, size_t threadCount = 0) {
+        ThreadPool pool(threadCount);
+        buildParallel(input, pool);
+    }
+
+    void buildParallel(const std::vector<PointType>& input, ThreadPool& pool) {
+        OCTREE_TRACE_SCOPE("buildParallel");
+        clear();
+
+        std::vector<PointType> work;
+        work.reserve(input.size());
+        size_t outside = 0;
+        for (const auto& p : input) {
+            if (contains(p)) {
+                work.push_back(p);
+            } else {
+                outside++;
+            }
+        }
+        if (outside > 0) {
+            std::cout << "Warning: " << outside << " points are outside node bounds" << std::endl;
+        }
+
+        struct Subtree {
+            BasicOctreeMortonNode* node;
+            PointIterator first, last;
+        };
+        std::vector<Subtree> frontier = {{this, work.begin(), work.end()}};
+        const size_t targetSubtrees = pool.size() * 8;
+        // Nodes split here, parents before children
+        std::vector<BasicOctreeMortonNode*> splitNodes;
+
+        while (pool.size() > 1 && frontier.size() < targetSubtrees) {
+            std::vector<std::array<PointIterator, 9>> bounds(frontier.size());
+            std::vector<char> split(frontier.size(), 0);
+            parallelFor(pool, frontier.size(), 1, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                    const Subtree& s = frontier[i];
+                    if (!s.node->options.shouldSplit(s.first, s.last, s.node->depth, s.node->min, s.node->max)) {
+                        continue;
+                    }
+                    OCTREE_COUNT(Subdivisions, 1);
+                    s.node->partitionOctants(s.first, s.last, bounds[i].data());
+                    split[i] = 1;
+                }
+            });
+
+            std::vector<Subtree> next;
+            bool anySplit = false;
+            for (size_t i = 0; i < frontier.size(); ++i) {
+                if (!split[i]) {
+                    next.push_back(frontier[i]);
+                    continue;
+                }
+                anySplit = true;
+                BasicOctreeMortonNode* node = frontier[i].node;
+                splitNodes.push_back(node);
+                const auto& b = bounds[i];
+                for (int octant = 0; octant < 8; ++octant) {
+                    if (b[octant] == b[octant + 1]) continue;
+                    uint64_t childKey = (node->morton_key << 3) | octant;
+                    BasicOctreeMortonNode* child = node->children.set(childKey, node->createChild(childKey));
+                    next.push_back({child, b[octant], b[octant + 1]});
+                }
+            }
+            frontier.swap(next);
+            if (!anySplit) break;
+        }
+
+        parallelFor(pool, frontier.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                frontier[i].node->buildRecursive(frontier[i].first, frontier[i].last);
+            }
+        });
+        for (size_t i = splitNodes.size(); i-- > 0;) {
+            splitNodes[i]->mergeChildAggregates();
+        }
+    }
+
+    // Recompute this node's aggregate from its children's
+    void mergeChildAggregates() {
+        aggregate = PointAggregate();
+        for (const auto& [key, child] : children) {
+            aggregate.merge(child->aggregate);
+        }
+    }
+
+    // Reorder [first, last) so that the points of octant i occupy
+    // [bounds[i], bounds[i + 1]). Splits on z, then y, then x.
+    void partitionOctants(PointIterator first, PointIterator last,
+                          PointIterator bounds[9]) const {
+        bounds[0] = first;
+        bounds[8] = last;
+        bounds[4] = std::partition(first, last, [&](const Point& p) { return !(p.z > center.z); });
+        for (int z = 0; z < 8; z += 4) {
+            bounds[z + 2] = std::partition(bounds[z], bounds[z + 4], [&](const Point& p) { return !(p.y > center.y); });
+            for (int y = z; y < z + 4; y += 2) {
+                bounds[y + 1] = std::partition(bounds[y], bounds[y + 2], [&](const Point& p) { return !(p.x > center.x); });
             }
-            
-            children[childKey]->insert(p);
         }
     }
 
@@ -72,12 +379,6 @@ public:
         // Extract octant from Morton key
         int octant = static_cast<int>(childKey & 7); // Last 3 bits
         
-        Point center = {
-            (min.x + max.x) / 2.0f,
-            (min.y + max.y) / 2.0f,
-            (min.z + max.z) / 2.0f
-        };
-
         childMin.x = (octant & 1) ? center.x : min.x;
         childMin.y = (octant & 2) ? center.y : min.y;
         childMin.z = (octant & 4) ? center.z : min.z;
@@ -90,11 +391,25 @@ public:
         return children.empty(); 
     }
 
+    allocator_type get_allocator() const { return allocator_type(points.get_allocator()); }
+
+    // Allocate a child for the given Morton key from this node's allocator
+    ChildPtr createChild(uint64_t childKey) {
+        Point childMin, childMax;
+        calculateChildBounds(childKey, childMin, childMax);
+        NodeAllocator alloc(points.get_allocator());
+        BasicOctreeMortonNode* child = NodeTraits::allocate(alloc, 1);
+        NodeTraits::construct(alloc, child, childMin, childMax, options, childKey, depth + 1, get_allocator());
+        OCTREE_COUNT(NodesAllocated, 1);
+        return ChildPtr(child);
+    }
+
     void subdivide() {
-        if (!isLeaf() || depth >= MAX_DEPTH) return;
+        if (!isLeaf() || depth >= options.maxDepth) return;
+        OCTREE_COUNT(Subdivisions, 1);
         
         // Create children for each octant that has points
-        std::unordered_map<uint64_t, std::vector<Point>> childPoints;
+        std::unordered_map<uint64_t, std::vector<PointType>> childPoints;
         
         // Distribute points to octants
         for (const auto& p : points) {
@@ -104,12 +419,10 @@ public:
         
         // Create child nodes and insert points
         for (const auto& [childKey, childPointList] : childPoints) {
-            Point childMin, childMax;
-            calculateChildBounds(childKey, childMin, childMax);
-            children[childKey] = std::make_unique<OctreeMortonNode>(childMin, childMax, childKey, depth + 1);
+            BasicOctreeMortonNode* child = children.set(childKey, createChild(childKey));
             
             for (const auto& p : childPointList) {
-                children[childKey]->insert(p);
+                child->insert(p);
             }
         }
         
@@ -123,16 +436,24 @@ public:
     }
 
     int getOctant(const Point& p) const {
-        Point center = {
-            (min.x + max.x) / 2.0f,
-            (min.y + max.y) / 2.0f,
-            (min.z + max.z) / 2.0f
-        };
-        int idx = 0;
-        if (p.x > center.x) idx |= 1;
-        if (p.y > center.y) idx |= 2;
-        if (p.z > center.z) idx |= 4;
-        return idx;
+        return octantOf(p, center);
+    }
+
+    // Push the children for a depth-first walk in reverse storage order, so
+    // they pop in the order the container lists them. Prefetching them
+    // overlaps the cache misses of all children instead of taking them one
+    // pop at a time.
+    template <typename Stack>
+    void pushChildren(Stack& stack) const {
+        const BasicOctreeMortonNode* pending[8];
+        int count = 0;
+        for (const auto& [key, child] : children) {
+            pending[count++] = &*child;
+        }
+        while (count > 0) {
+            prefetchRead(pending[--count]);
+            stack.push(pending[count]);
+        }
     }
 
     // Helper function to print the octree structure
@@ -147,183 +468,446 @@ public:
         
         if (!isLeaf()) {
             for (const auto& [childKey, child] : children) {
-                std::cout << indent << "Child Morton key 0x" << std::hex << childKey << std::dec << ":" << std::endl;
+                std::cout << indent << "Child Morton key 0x" << std::hex << child->morton_key << std::dec << ":" << std::endl;
                 child->print(printDepth + 1);
             }
         }
     }
 
     // Collect all points in the octree
-    void collectAllPoints(std::vector<Point>& allPoints) const {
-        // Add points from this node
-        for (const auto& p : points) {
-            allPoints.push_back(p);
-        }
-        
-        // Recursively collect from children
-        for (const auto& [childKey, child] : children) {
-            child->collectAllPoints(allPoints);
-        }
+    void collectAllPoints(std::vector<PointType>& allPoints) const {
+        forEachPoint([&](const PointType& p) { allPoints.push_back(p); });
     }
 
     // Collect all node bounding boxes for visualization
     void collectNodeBoxes(std::vector<std::pair<Point, Point>>& boxes, std::vector<int>& levels, int currentLevel = 0) const {
-        // Add this node's bounding box
-        boxes.push_back({min, max});
-        levels.push_back(currentLevel);
-        
-        // Recursively collect from children
-        for (const auto& [childKey, child] : children) {
-            child->collectNodeBoxes(boxes, levels, currentLevel + 1);
-        }
+        forEachNode([&](const Point& nodeMin, const Point& nodeMax, int level) {
+            boxes.push_back({nodeMin, nodeMax});
+            levels.push_back(level);
+        }, currentLevel);
     }
 
-    // Export octree to VTK format for ParaView visualization
-    void exportToVTK(const std::string& filename) const {
-        std::ofstream file(filename);
-        if (!file.is_open()) {
-            std::cerr << "Error: Could not open file " << filename << " for writing." << std::endl;
-            return;
+    // Export octree to VTK format for ParaView visualization. Binary output is
+    // smaller and much faster to write; ASCII stays readable for debugging.
+    bool exportToVTK(const std::string& filename, VtkFormat format = VtkFormat::Ascii) const {
+        if (!writeOctreeVTK(*this, filename, "Morton Octree Visualization", format)) {
+            std::cerr << "Error: Could not write file " << filename << std::endl;
+            return false;
         }
+        std::cout << "Morton Octree exported to " << filename << std::endl;
+        std::cout << "Open this file in ParaView to visualize the octree structure!" << std::endl;
+        return true;
+    }
 
-        // Collect all points and boxes
-        std::vector<Point> allPoints;
-        std::vector<std::pair<Point, Point>> boxes;
-        std::vector<int> levels;
-        
-        collectAllPoints(allPoints);
-        collectNodeBoxes(boxes, levels);
+    // Query methods
+    std::vector<PointType> rangeQuery(const Point& queryMin, const Point& queryMax) const {
+        std::vector<PointType> result;
+        rangeQuery(queryMin, queryMax, [&](const PointType& p) { result.push_back(p); });
+        return result;
+    }
 
-        // Write VTK header
-        file << "# vtk DataFile Version 3.0\n";
-        file << "Morton Octree Visualization\n";
-        file << "ASCII\n";
-        file << "DATASET UNSTRUCTURED_GRID\n\n";
+    // Streams every point inside the box to visit(p) without allocating.
+    // A visitor returning bool can stop the query by returning false; the
+    // result is false if the query was stopped early.
+    template <typename Visitor>
+    bool rangeQuery(const Point& queryMin, const Point& queryMax, Visitor&& visit) const {
+        OCTREE_TRACE_SCOPE("rangeQuery");
+        TraversalStack<const BasicOctreeMortonNode*, MaxDepth> stack;
+        stack.push(this);
+        while (!stack.empty()) {
+            const BasicOctreeMortonNode* node = stack.pop();
+            OCTREE_COUNT(NodesVisited, 1);
+            // Skip subtrees whose bounding box is disjoint from the query range
+            if (!node->boxIntersects(queryMin, queryMax)) {
+                OCTREE_COUNT(NodesPruned, 1);
+                continue;
+            }
 
-        // Calculate total points: original points + 8 corners per box
-        int totalPoints = allPoints.size() + boxes.size() * 8;
-        
-        file << "POINTS " << totalPoints << " float\n";
-        
-        // Write original points
-        for (const auto& p : allPoints) {
-            file << std::fixed << std::setprecision(6) << p.x << " " << p.y << " " << p.z << "\n";
+            // Whole subtree lies inside the query: emit it without per-point tests
+            if (node->boxContainedIn(queryMin, queryMax)) {
+                OCTREE_COUNT(SubtreesAccepted, 1);
+                OCTREE_COUNT(PointsMatched, node->aggregate.count);
+                if (!node->forEachPoint(visit)) return false;
+                continue;
+            }
+
+            // Check points in this node
+            OCTREE_COUNT(PointsTested, node->points.size());
+            for (const auto& p : node->points) {
+                if (p.x >= queryMin.x && p.x <= queryMax.x &&
+                    p.y >= queryMin.y && p.y <= queryMax.y &&
+                    p.z >= queryMin.z && p.z <= queryMax.z) {
+                    OCTREE_COUNT(PointsMatched, 1);
+                    if (!invokeVisitor(visit, p)) return false;
+                }
+            }
+            node->pushChildren(stack);
         }
-        
-        // Write box corner points
-        for (const auto& box : boxes) {
-            const Point& minP = box.first;
-            const Point& maxP = box.second;
-            
-            // 8 corners of the box
-            file << minP.x << " " << minP.y << " " << minP.z << "\n";  // 0
-            file << maxP.x << " " << minP.y << " " << minP.z << "\n";  // 1
-            file << maxP.x << " " << maxP.y << " " << minP.z << "\n";  // 2
-            file << minP.x << " " << maxP.y << " " << minP.z << "\n";  // 3
-            file << minP.x << " " << minP.y << " " << maxP.z << "\n";  // 4
-            file << maxP.x << " " << minP.y << " " << maxP.z << "\n";  // 5
-            file << maxP.x << " " << maxP.y << " " << maxP.z << "\n";  // 6
-            file << minP.x << " " << maxP.y << " " << maxP.z << "\n";  // 7
-        }
-
-        // Write cells (points as vertices + boxes as hexahedrons)
-        int totalCells = allPoints.size() + boxes.size();
-        int totalCellData = allPoints.size() * 2 + boxes.size() * 9; // 2 for points (1+1), 9 for hex (8+1)
-        
-        file << "\nCELLS " << totalCells << " " << totalCellData << "\n";
-        
-        // Write point cells (vertices)
-        for (size_t i = 0; i < allPoints.size(); ++i) {
-            file << "1 " << i << "\n";
+        return true;
+    }
+
+    // Number of points inside the box; contained subtrees are counted without per-point tests
+    size_t countInRange(const Point& queryMin, const Point& queryMax) const {
+        OCTREE_TRACE_SCOPE("countInRange");
+        size_t count = 0;
+        TraversalStack<const BasicOctreeMortonNode*, MaxDepth> stack;
+        stack.push(this);
+        while (!stack.empty()) {
+            const BasicOctreeMortonNode* node = stack.pop();
+            OCTREE_COUNT(NodesVisited, 1);
+            if (!node->boxIntersects(queryMin, queryMax)) {
+                OCTREE_COUNT(NodesPruned, 1);
+                continue;
+            }
+            if (node->boxContainedIn(queryMin, queryMax)) {
+                OCTREE_COUNT(SubtreesAccepted, 1);
+                OCTREE_COUNT(PointsMatched, node->aggregate.count);
+                count += node->aggregate.count;
+                continue;
+            }
+
+            OCTREE_COUNT(PointsTested, node->points.size());
+            for (const auto& p : node->points) {
+                if (p.x >= queryMin.x && p.x <= queryMax.x &&
+                    p.y >= queryMin.y && p.y <= queryMax.y &&
+                    p.z >= queryMin.z && p.z <= queryMax.z) {
+                    OCTREE_COUNT(PointsMatched, 1);
+                    count++;
+                }
+            }
+            node->pushChildren(stack);
         }
-        
-        // Write box cells (hexahedrons)
-        int baseIdx = allPoints.size();
-        for (size_t i = 0; i < boxes.size(); ++i) {
-            int start = baseIdx + i * 8;
-            file << "8 " << start << " " << (start+1) << " " << (start+2) << " " << (start+3)
-                 << " " << (start+4) << " " << (start+5) << " " << (start+6) << " " << (start+7) << "\n";
+        return count;
+    }
+
+    // True if at least one point lies inside the box; stops at the first hit
+    bool anyInRange(const Point& queryMin, const Point& queryMax) const {
+        return !rangeQuery(queryMin, queryMax, [](const Point&) { return false; });
+    }
+
+    // Aggregate of the points inside the box. Subtrees whose points all lie
+    // inside contribute their stored aggregate without being descended.
+    PointAggregate aggregateInRange(const Point& queryMin, const Point& queryMax) const {
+        PointAggregate result;
+        TraversalStack<const BasicOctreeMortonNode*, MaxDepth> stack;
+        stack.push(this);
+        while (!stack.empty()) {
+            const BasicOctreeMortonNode* node = stack.pop();
+            if (!node->boxIntersects(queryMin, queryMax)) {
+                continue;
+            }
+            if (node->boxContainedIn(queryMin, queryMax)) {
+                result.merge(node->aggregate);
+                continue;
+            }
+
+            for (const auto& p : node->points) {
+                if (p.x >= queryMin.x && p.x <= queryMax.x &&
+                    p.y >= queryMin.y && p.y <= queryMax.y &&
+                    p.z >= queryMin.z && p.z <= queryMax.z) {
+                    result.add(p);
+                }
+            }
+            node->pushChildren(stack);
         }
+        return result;
+    }
 
-        // Write cell types
-        file << "\nCELL_TYPES " << totalCells << "\n";
-        
-        // Point cells (VTK_VERTEX = 1)
-        for (size_t i = 0; i < allPoints.size(); ++i) {
-            file << "1\n";
+    // Mean of the points inside the box, or nothing if there are none
+    std::optional<Point> centroidInRange(const Point& queryMin, const Point& queryMax) const {
+        PointAggregate result = aggregateInRange(queryMin, queryMax);
+        if (result.empty()) return std::nullopt;
+        return result.centroid();
+    }
+
+    // Points within radius of center (sphere query)
+    std::vector<PointType> radiusQuery(const Point& center, float radius) const {
+        std::vector<PointType> result;
+        radiusQuery(center, radius, [&](const PointType& p) { result.push_back(p); });
+        return result;
+    }
+
+    // Visitor overload of radiusQuery, same contract as the rangeQuery one
+    template <typename Visitor>
+    bool radiusQuery(const Point& center, float radius, Visitor&& visit) const {
+        const float radiusSquared = radius * radius;
+        TraversalStack<const BasicOctreeMortonNode*, MaxDepth> stack;
+        stack.push(this);
+        while (!stack.empty()) {
+            const BasicOctreeMortonNode* node = stack.pop();
+            // Skip subtrees whose bounding box does not touch the sphere
+            if (node->boxDistanceSquared(center) > radiusSquared) {
+                continue;
+            }
+
+            // Whole subtree inside the sphere: emit it without per-point tests
+            if (::boxMaxDistanceSquared(center, node->aggregate.min, node->aggregate.max) <= radiusSquared) {
+                if (!node->forEachPoint(visit)) return false;
+                continue;
+            }
+
+            // Check points in this node
+            for (const auto& p : node->points) {
+                if (distanceSquared(p, center) <= radiusSquared) {
+                    if (!invokeVisitor(visit, p)) return false;
+                }
+            }
+            node->pushChildren(stack);
         }
-        
-        // Hexahedron cells (VTK_HEXAHEDRON = 12)
-        for (size_t i = 0; i < boxes.size(); ++i) {
-            file << "12\n";
+        return true;
+    }
+
+    // Points inside the view frustum
+    std::vector<PointType> frustumQuery(const Frustum& frustum) const {
+        std::vector<PointType> result;
+        frustumQuery(frustum, [&](const PointType& p) { result.push_back(p); });
+        return result;
+    }
+
+    // Visitor overload of frustumQuery, same contract as the rangeQuery one
+    template <typename Visitor>
+    bool frustumQuery(const Frustum& frustum, Visitor&& visit) const {
+        TraversalStack<const BasicOctreeMortonNode*, MaxDepth> stack;
+        stack.push(this);
+        while (!stack.empty()) {
+            const BasicOctreeMortonNode* node = stack.pop();
+            BoxRelation relation = frustum.classify(node->aggregate.min, node->aggregate.max);
+            if (relation == BoxRelation::Outside) {
+                continue;
+            }
+
+            // Whole subtree inside the frustum: emit it without per-point tests
+            if (relation == BoxRelation::Inside) {
+                if (!node->forEachPoint(visit)) return false;
+                continue;
+            }
+
+            for (const auto& p : node->points) {
+                if (frustum.contains(p)) {
+                    if (!invokeVisitor(visit, p)) return false;
+                }
+            }
+            node->pushChildren(stack);
         }
+        return true;
+    }
 
-        // Write cell data (octree levels for coloring)
-        file << "\nCELL_DATA " << totalCells << "\n";
-        file << "SCALARS OctreeLevel int 1\n";
-        file << "LOOKUP_TABLE default\n";
-        
-        // Points are at level -1 (to distinguish from boxes)
-        for (size_t i = 0; i < allPoints.size(); ++i) {
-            file << "-1\n";
+    // Points within radius of the ray, cell by cell from front to back
+    std::vector<PointType> rayQuery(const Ray& ray, float radius) const {
+        std::vector<PointType> result;
+        rayQuery(ray, radius, [&](const PointType& p) { result.push_back(p); });
+        return result;
+    }
+
+    // Visitor overload of rayQuery, same contract as the rangeQuery one.
+    // Cells come in the order the ray enters them, the points of one cell
+    // in storage order.
+    template <typename Visitor>
+    bool rayQuery(const Ray& ray, float radius, Visitor&& visit) const {
+        const float cutoff = ray.maxDistance;
+        return rayTraverse(ray, radius, cutoff, [&](const BasicOctreeMortonNode* node) {
+            float t;
+            for (const auto& p : node->points) {
+                if (ray.hits(p, radius, t) && !invokeVisitor(visit, p)) return false;
+            }
+            return true;
+        });
+    }
+
+    // First point along the ray within radius of it, or nothing. Cells the
+    // ray enters beyond the best hit so far are skipped, so the walk usually
+    // ends a few cells after the first hit.
+    std::optional<RayHit<PointType>> raycast(const Ray& ray, float radius) const {
+        std::optional<RayHit<PointType>> best;
+        float cutoff = ray.maxDistance;
+        rayTraverse(ray, radius, cutoff, [&](const BasicOctreeMortonNode* node) {
+            float t;
+            for (const auto& p : node->points) {
+                if (ray.hits(p, radius, t) && (!best || t < best->distance)) {
+                    best = RayHit<PointType>{p, t};
+                    cutoff = t;
+                }
+            }
+            return true;
+        });
+        return best;
+    }
+
+    // Front-to-back walk over the cells near the ray, see ::rayTraverse
+    template <typename VisitNode>
+    bool rayTraverse(const Ray& ray, float radius, const float& cutoff, VisitNode&& visitNode) const {
+        return ::rayTraverse<MaxDepth>(
+            ray, radius, cutoff, static_cast<const BasicOctreeMortonNode*>(this),
+            [](const BasicOctreeMortonNode* node) -> const BasicOctreeMortonNode& { return *node; },
+            [](const BasicOctreeMortonNode* node, RayChildOrder<const BasicOctreeMortonNode*>& children) { node->pushChildren(children); },
+            visitNode);
+    }
+
+    // Calls visit(p) for every point in this subtree, same contract as rangeQuery
+    template <typename Visitor>
+    bool forEachPoint(Visitor&& visit) const {
+        TraversalStack<const BasicOctreeMortonNode*, MaxDepth> stack;
+        stack.push(this);
+        while (!stack.empty()) {
+            const BasicOctreeMortonNode* node = stack.pop();
+            for (const auto& p : node->points) {
+                if (!invokeVisitor(visit, p)) return false;
+            }
+            node->pushChildren(stack);
         }
-        
-        // Box levels
-        for (int level : levels) {
-            file << level << "\n";
+        return true;
+    }
+
+    // Calls visit(min, max, level) for every node in this subtree, parents
+    // before children; level counts from this node
+    template <typename Visitor>
+    void forEachNode(Visitor&& visit, int level = 0) const {
+        TraversalStack<const BasicOctreeMortonNode*, MaxDepth> stack;
+        stack.push(this);
+        while (!stack.empty()) {
+            const BasicOctreeMortonNode* node = stack.pop();
+            visit(node->min, node->max, level + node->depth - depth);
+            node->pushChildren(stack);
         }
+    }
 
-        file.close();
-        std::cout << "Morton Octree exported to " << filename << std::endl;
-        std::cout << "Open this file in ParaView to visualize the octree structure!" << std::endl;
+    // Number of points stored in this subtree
+    size_t pointCount() const {
+        return aggregate.count;
     }
 
-    // Query methods
-    std::vector<Point> rangeQuery(const Point& queryMin, const Point& queryMax) const {
-        std::vector<Point> result;
-        rangeQueryRecursive(queryMin, queryMax, result);
-        return result;
+    // The box tests of the queries use the tight bounds of the subtree's
+    // points, which reject empty parts of a cell and empty subtrees
+    bool boxIntersects(const Point& queryMin, const Point& queryMax) const {
+        const Point& lo = aggregate.min;
+        const Point& hi = aggregate.max;
+        return !(hi.x < queryMin.x || lo.x > queryMax.x ||
+                 hi.y < queryMin.y || lo.y > queryMax.y ||
+                 hi.z < queryMin.z || lo.z > queryMax.z);
     }
 
-    void rangeQueryRecursive(const Point& queryMin, const Point& queryMax, std::vector<Point>& result) const {
-        // Check if this node's bounding box intersects with query range
-        if (!boxIntersects(queryMin, queryMax)) {
-            return;
-        }
+    bool boxContainedIn(const Point& queryMin, const Point& queryMax) const {
+        const Point& lo = aggregate.min;
+        const Point& hi = aggregate.max;
+        return lo.x >= queryMin.x && hi.x <= queryMax.x &&
+               lo.y >= queryMin.y && hi.y <= queryMax.y &&
+               lo.z >= queryMin.z && hi.z <= queryMax.z;
+    }
 
-        // Check points in this node
-        for (const auto& p : points) {
-            if (p.x >= queryMin.x && p.x <= queryMax.x &&
-                p.y >= queryMin.y && p.y <= queryMax.y &&
-                p.z >= queryMin.z && p.z <= queryMax.z) {
-                result.push_back(p);
+    // Squared distance from q to the tight bounds of this subtree (0 if
+    // inside, infinite if the subtree is empty)
+    float boxDistanceSquared(const Point& q) const {
+        return ::boxDistanceSquared(q, aggregate.min, aggregate.max);
+    }
+
+    // The k points closest to q, closest first. Nodes are visited best-first
+    // in order of their box distance to q; the search stops once the next
+    // node is farther away than the current k-th neighbor.
+    std::vector<PointType> knn(const Point& q, size_t k) const {
+        if (k == 0) return {};
+        OCTREE_TRACE_SCOPE("knn");
+        KnnCollector<PointType> collector(k);
+
+        using Entry = std::pair<float, const BasicOctreeMortonNode*>;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+        queue.push({boxDistanceSquared(q), this});
+
+        while (!queue.empty()) {
+            auto [dist, node] = queue.top();
+            queue.pop();
+            if (dist > collector.worstDistanceSquared()) break;
+            OCTREE_COUNT(NodesVisited, 1);
+
+            OCTREE_COUNT(PointsTested, node->points.size());
+            for (const auto& p : node->points) {
+                collector.offer(p, distanceSquared(p, q));
+            }
+            for (const auto& [childKey, child] : node->children) {
+                float childDist = child->boxDistanceSquared(q);
+                if (childDist <= collector.worstDistanceSquared()) {
+                    queue.push({childDist, &*child});
+                }
             }
         }
+        return collector.sortedPoints();
+    }
+
+    // Closest point to q, or nothing if the tree is empty
+    std::optional<PointType> nearest(const Point& q) const {
+        std::vector<PointType> result = knn(q, 1);
+        if (result.empty()) return std::nullopt;
+        return result.front();
+    }
 
-        // Recursively search children
-        for (const auto& [childKey, child] : children) {
-            child->rangeQueryRecursive(queryMin, queryMax, result);
+    // Batched rangeQuery: result[i] holds the points inside
+    // [queryMins[i], queryMaxs[i]]. Queries run in Morton order of their
+    // box centers so that neighbouring queries share cached nodes.
+    std::vector<std::vector<PointType>> rangeQueryBatch(const std::vector<Point>& queryMins,
+                                                        const std::vector<Point>& queryMaxs) const {
+        size_t count = std::min(queryMins.size(), queryMaxs.size());
+        std::vector<Point> centers(count);
+        for (size_t i = 0; i < count; ++i) {
+            centers[i] = Point((queryMins[i].x + queryMaxs[i].x) * 0.5f,
+                               (queryMins[i].y + queryMaxs[i].y) * 0.5f,
+                               (queryMins[i].z + queryMaxs[i].z) * 0.5f);
         }
+
+        std::vector<std::vector<PointType>> results(count);
+        for (uint32_t i : mortonQueryOrder(centers, min, max)) {
+            std::vector<PointType>& result = results[i];
+            rangeQuery(queryMins[i], queryMaxs[i], [&](const PointType& p) { result.push_back(p); });
+        }
+        return results;
     }
 
-    bool boxIntersects(const Point& queryMin, const Point& queryMax) const {
-        return !(max.x < queryMin.x || min.x > queryMax.x ||
-                 max.y < queryMin.y || min.y > queryMax.y ||
-                 max.z < queryMin.z || min.z > queryMax.z);
+    // Batched knn: result[i] holds the k points closest to queries[i], run in Morton order
+    std::vector<std::vector<PointType>> knnBatch(const std::vector<Point>& queries, size_t k) const {
+        std::vector<std::vector<PointType>> results(queries.size());
+        for (uint32_t i : mortonQueryOrder(queries, min, max)) {
+            results[i] = knn(queries[i], k);
+        }
+        return results;
     }
 
     // Get statistics about the octree
     void getStatistics(int& totalNodes, int& leafNodes, int& totalPoints, int& maxDepth, int currentDepth = 0) const {
-        totalNodes++;
-        totalPoints += points.size();
-        maxDepth = std::max(maxDepth, currentDepth);
+        TraversalStack<const BasicOctreeMortonNode*, MaxDepth> stack;
+        stack.push(this);
+        while (!stack.empty()) {
+            const BasicOctreeMortonNode* node = stack.pop();
+            totalNodes++;
+            totalPoints += node->points.size();
+            maxDepth = std::max(maxDepth, currentDepth + node->depth - depth);
+            if (node->isLeaf()) {
+                leafNodes++;
+            }
+            node->pushChildren(stack);
+        }
+    }
 
-        if (isLeaf()) {
-            leafNodes++;
-        } else {
-            for (const auto& [childKey, child] : children) {
-                child->getStatistics(totalNodes, leafNodes, totalPoints, maxDepth, currentDepth + 1);
+    // Heap footprint of this subtree. The node itself is counted, but not as
+    // an allocation: its owner allocated it.
+    OctreeMemoryStats getMemoryStatistics() const {
+        OctreeMemoryStats stats;
+        stats.nodeStructBytes = sizeof(BasicOctreeMortonNode);
+        getMemoryStatistics(stats);
+        return stats;
+    }
+
+    void getMemoryStatistics(OctreeMemoryStats& stats) const {
+        TraversalStack<const BasicOctreeMortonNode*, MaxDepth> stack;
+        stack.push(this);
+        while (!stack.empty()) {
+            const BasicOctreeMortonNode* node = stack.pop();
+            stats.nodes++;
+            stats.nodeBytes += sizeof(BasicOctreeMortonNode);
+            stats.points += node->points.size();
+            addPointVector<Allocator>(stats, node->points);
+            node->children.addMemory(stats);
+            if (node != this) {
+                addAllocation<Allocator>(stats, sizeof(BasicOctreeMortonNode));
             }
+            node->pushChildren(stack);
         }
     }
 
@@ -338,10 +922,25 @@ public:
         std::cout << "Total points: " << totalPoints << std::endl;
         std::cout << "Maximum depth: " << maxDepth << std::endl;
         std::cout << "Average points per leaf: " << (leafNodes > 0 ? (float)totalPoints / leafNodes : 0) << std::endl;
+        printMemoryStatistics(getMemoryStatistics());
+        printInstrumentationStatistics();
     }
 };
 
-// Convenience typedef for the Morton octree
+// Convenience typedefs for the Morton octree with default limits
+using OctreeMortonNode = BasicOctreeMortonNode<>;
 using OctreeMorton = OctreeMortonNode;
 
+// Morton octree whose nodes and child maps live in a NodeArena
+template <size_t LeafCapacity = 1, int MaxDepth = 20>
+using ArenaOctreeMorton = BasicOctreeMortonNode<LeafCapacity, MaxDepth, ArenaAllocator<Point>>;
+
+// Morton octree with mask + packed-array child storage instead of per-node hash maps
+template <size_t LeafCapacity = 1, int MaxDepth = 20>
+using CompactOctreeMorton = BasicOctreeMortonNode<LeafCapacity, MaxDepth, std::allocator<Point>, CompactChildStorage>;
+
+// Morton octree storing IndexedPoint, so queries return object indices directly
+template <size_t LeafCapacity = 1, int MaxDepth = 20>
+using IndexedOctreeMorton = BasicOctreeMortonNode<LeafCapacity, MaxDepth, std::allocator<Point>, HashChildStorage, IndexedPoint>;
+
 #endif // OCTREE_MORTON_H 
\ No newline at end of file
@@ -0,0 +1,190 @@
+#ifndef OCTREE_MORTON_INDEX_H
+#define OCTREE_MORTON_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include "point.h"
+#include "morton_code.h"
+#include "octree_traversal.h"
+#include "octree_morton.h"
+
+// How far forEachNeighbor looks: cells sharing a face (6), also an edge (18)
+// or also a corner (26). The value is the number of axes a step may change.
+enum class NeighborConnectivity {
+    Face = 1,
+    Edge = 2,
+    Vertex = 3
+};
+
+// Direct lookup of the nodes of a Morton octree (BasicOctreeMortonNode) by
+// key and level, without descending from the root. Every node is entered in
+// one open-addressing hash table under its locational code: the node key
+// with a marker bit above its 3 * level bits, which keeps the keys of all
+// levels apart. The index holds pointers into the tree and is a snapshot:
+// rebuild it after the tree is modified. Lookups are const and may run from
+// several threads at once.
+template <typename Tree>
+class MortonNodeIndex {
+public:
+    MortonNodeIndex() = default;
+
+    explicit MortonNodeIndex(const Tree& root) { build(root); }
+
+    // Index every node below root, which must be the root of its tree (depth 0)
+    void build(const Tree& root) {
+        rootNode = &root;
+        nodeCount = 0;
+        root.forEachNode([&](const Point&, const Point&, int) { nodeCount++; });
+
+        // Power of two with a load factor of at most 1/2
+        int bits = 1;
+        while ((size_t(1) << bits) < 2 * nodeCount) bits++;
+        shift = 64 - bits;
+        slots.assign(size_t(1) << bits, Slot{0, nullptr});
+
+        TraversalStack<const Tree*, Tree::MAX_DEPTH> stack;
+        stack.push(&root);
+        while (!stack.empty()) {
+            const Tree* node = stack.pop();
+            uint64_t code = locationalCode(node->morton_key, node->depth);
+            size_t slot = slotOf(code);
+            while (slots[slot].node != nullptr) slot = (slot + 1) & (slots.size() - 1);
+            slots[slot] = Slot{code, node};
+            node->pushChildren(stack);
+        }
+    }
+
+    // Node with the given key at the given level, or nullptr if the tree has none
+    const Tree* findNode(uint64_t key, int level) const {
+        if (slots.empty()) return nullptr;
+        uint64_t code = locationalCode(key, level);
+        for (size_t slot = slotOf(code);; slot = (slot + 1) & (slots.size() - 1)) {
+            if (slots[slot].code == code) return slots[slot].node;
+            if (slots[slot].node == nullptr) return nullptr;
+        }
+    }
+
+    // Deepest node whose cell holds p, the node insert(p) would descend to
+    // (nullptr if p is outside the tree). The level is found by a binary
+    // search over the prefixes of p's key, since a node exists at a level
+    // only if its parent does. Points on a split plane belong to the lower
+    // cell; if rounding of the split planes makes p's key disagree with the
+    // tree, the lookup falls back to descending from the root.
+    const Tree* findContaining(const Point& p) const {
+        if (rootNode == nullptr || !rootNode->contains(p)) return nullptr;
+
+        const int depth = rootNode->options.maxDepth;
+        uint64_t key = mortonEncode(cellCoordinate(p.x, rootNode->min.x, rootNode->max.x, depth),
+                                    cellCoordinate(p.y, rootNode->min.y, rootNode->max.y, depth),
+                                    cellCoordinate(p.z, rootNode->min.z, rootNode->max.z, depth));
+        int lo = 0, hi = depth;
+        while (lo < hi) {
+            int mid = (lo + hi + 1) / 2;
+            if (findNode(key >> (3 * (depth - mid)), mid) != nullptr) {
+                lo = mid;
+            } else {
+                hi = mid - 1;
+            }
+        }
+
+        const Tree* node = findNode(key >> (3 * (depth - lo)), lo);
+        if (!cellHolds(*node, p)) node = rootNode;
+        // The tree's own rule settles any remaining levels
+        while (!node->isLeaf()) {
+            const Tree* child = node->children.get(node->getChildMortonKey(p));
+            if (child == nullptr) break;
+            node = child;
+        }
+        return node;
+    }
+
+    // Node covering the cell one step of dx, dy, dz in {-1, 0, 1} away from
+    // node's cell: the node of the same level, which may have children of
+    // its own, or else the coarser leaf containing that cell. nullptr if the
+    // cell lies outside the tree or in a part of it that holds no points.
+    const Tree* findNeighbor(const Tree& node, int dx, int dy, int dz) const {
+        uint64_t key;
+        if (!mortonNeighborKey(node.morton_key, node.depth, dx, dy, dz, key)) return nullptr;
+        for (int level = node.depth; level >= 0; --level, key >>= 3) {
+            const Tree* found = findNode(key, level);
+            if (found != nullptr) {
+                return (level == node.depth || found->isLeaf()) ? found : nullptr;
+            }
+        }
+        return nullptr;
+    }
+
+    // Calls visit(neighbor, dx, dy, dz) for every direction findNeighbor
+    // resolves to a node. A coarser leaf next to several of the cells is
+    // visited once per direction.
+    template <typename Visitor>
+    void forEachNeighbor(const Tree& node, NeighborConnectivity connectivity, Visitor&& visit) const {
+        const int maxChanged = static_cast<int>(connectivity);
+        for (int dz = -1; dz <= 1; ++dz) {
+            for (int dy = -1; dy <= 1; ++dy) {
+                for (int dx = -1; dx <= 1; ++dx) {
+                    int changed = (dx != 0) + (dy != 0) + (dz != 0);
+                    if (changed == 0 || changed > maxChanged) continue;
+                    const Tree* neighbor = findNeighbor(node, dx, dy, dz);
+                    if (neighbor != nullptr) visit(*neighbor, dx, dy, dz);
+                }
+            }
+        }
+    }
+
+    // Number of indexed nodes
+    size_t size() const { return nodeCount; }
+
+    // Bytes of the hash table
+    size_t memoryBytes() const { return slots.capacity() * sizeof(Slot); }
+
+private:
+    // Empty slots have node == nullptr; code 0 is never a locational code
+    struct Slot {
+        uint64_t code;
+        const Tree* node;
+    };
+
+    static uint64_t locationalCode(uint64_t key, int level) {
+        return (uint64_t(1) << (3 * level)) | key;
+    }
+
+    // Fibonacci hashing: the top bits of the product mix all bits of the code
+    size_t slotOf(uint64_t code) const {
+        return static_cast<size_t>((code * 0x9E3779B97F4A7C15ULL) >> shift);
+    }
+
+    // Cell of v among 2^depth along an axis, with a value on a cell boundary
+    // in the lower cell, as getOctant assigns it
+    static uint32_t cellCoordinate(float v, float min, float max, int depth) {
+        double extent = static_cast<double>(max) - min;
+        if (!(extent > 0.0)) return 0;
+        double scaled = (static_cast<double>(v) - min) / extent * static_cast<double>(uint64_t(1) << depth);
+        if (!(scaled > 1.0)) return 0;
+        double cell = std::ceil(scaled) - 1.0;
+        double last = static_cast<double>((uint64_t(1) << depth) - 1);
+        return static_cast<uint32_t>(std::min(cell, last));
+    }
+
+    // True if p is in node's cell as the tree splits space: above the lower
+    // split plane, on or below the upper one, and on the root's box faces
+    bool cellHolds(const Tree& node, const Point& p) const {
+        const Point& rootMin = rootNode->min;
+        return (p.x > node.min.x || node.min.x == rootMin.x) && p.x <= node.max.x &&
+               (p.y > node.min.y || node.min.y == rootMin.y) && p.y <= node.max.y &&
+               (p.z > node.min.z || node.min.z == rootMin.z) && p.z <= node.max.z;
+    }
+
+    const Tree* rootNode = nullptr;
+    std::vector<Slot> slots;
+    size_t nodeCount = 0;
+    int shift = 63;
+};
+
+// Index over the default Morton octree
+using OctreeMortonIndex = MortonNodeIndex<OctreeMorton>;
+
+#endif // OCTREE_MORTON_INDEX_H
@@ -0,0 +1,88 @@
+#ifndef OCTREE_OPTIONS_H
+#define OCTREE_OPTIONS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <cmath>
+#include "point.h"
+
+// Runtime subdivision limits. Every octree takes its compile-time
+// LeafCapacity / MaxDepth template parameters as the defaults and lets the
+// caller override them per tree; the runtime depth can only be lowered.
+//
+// A leaf holding more than maxPointsPerLeaf points is split unless it is at
+// maxDepth, its children would be smaller than minCellSize, or its points
+// form a cluster: all of them within minCellSize of the first one along
+// every axis. With the default minCellSize of 0 a cluster is a set of
+// coincident points, which no split can separate; such leaves stay
+// oversized instead of growing a chain of single-child nodes to maxDepth.
+struct OctreeOptions {
+    // Maximum points per leaf before subdivision
+    uint32_t maxPointsPerLeaf;
+    // Leaves at this depth are never subdivided
+    int maxDepth;
+    // Cells are not split into children whose longest side is below this
+    float minCellSize = 0.0f;
+
+    OctreeOptions clampedTo(int depthLimit) const {
+        OctreeOptions clamped = *this;
+        clamped.maxPointsPerLeaf = std::max<uint32_t>(clamped.maxPointsPerLeaf, 1);
+        clamped.maxDepth = std::max(0, std::min(clamped.maxDepth, depthLimit));
+        if (!(clamped.minCellSize > 0.0f)) clamped.minCellSize = 0.0f;
+        return clamped;
+    }
+
+    // True if the children of the cell [cellMin, cellMax] would be at least
+    // minCellSize on their longest side
+    bool allowsSplit(const Point& cellMin, const Point& cellMax) const {
+        float longest = std::max({cellMax.x - cellMin.x, cellMax.y - cellMin.y, cellMax.z - cellMin.z});
+        return longest * 0.5f >= minCellSize;
+    }
+
+    // True if p belongs to the cluster around anchor
+    bool inCluster(const Point& anchor, const Point& p) const {
+        return std::fabs(p.x - anchor.x) <= minCellSize && std::fabs(p.y - anchor.y) <= minCellSize &&
+               std::fabs(p.z - anchor.z) <= minCellSize;
+    }
+
+    // True if a leaf at depth with the given cell, holding [first, last), is
+    // to be split. The cluster scan stops at the first point outside it.
+    template <typename It>
+    bool shouldSplit(It first, It last, int depth, const Point& cellMin, const Point& cellMax) const {
+        if (static_cast<size_t>(last - first) <= maxPointsPerLeaf || depth >= maxDepth ||
+            !allowsSplit(cellMin, cellMax)) {
+            return false;
+        }
+        for (It it = first; it != last; ++it) {
+            if (!inCluster(*first, *it)) return true;
+        }
+        return false;
+    }
+
+    // shouldSplit for a leaf whose last point was just inserted. A leaf that
+    // was already over the cap was kept as a cluster, so only the new point
+    // needs checking, which keeps inserting into a cluster O(1).
+    template <typename It>
+    bool shouldSplitAfterInsert(It first, It last, int depth, const Point& cellMin, const Point& cellMax) const {
+        if (static_cast<size_t>(last - first) > static_cast<size_t>(maxPointsPerLeaf) + 1) {
+            return depth < maxDepth && allowsSplit(cellMin, cellMax) && !inCluster(*first, *(last - 1));
+        }
+        return shouldSplit(first, last, depth, cellMin, cellMax);
+    }
+
+    // Deepest level a tree over [rootMin, rootMax] reaches under maxDepth and
+    // minCellSize, for the trees that split at fixed levels of the Morton grid
+    int depthLimitFor(const Point& rootMin, const Point& rootMax) const {
+        int level = 0;
+        Point cellMax = rootMax;
+        while (level < maxDepth && allowsSplit(rootMin, cellMax)) {
+            cellMax = Point(rootMin.x + (cellMax.x - rootMin.x) * 0.5f, rootMin.y + (cellMax.y - rootMin.y) * 0.5f,
+                            rootMin.z + (cellMax.z - rootMin.z) * 0.5f);
+            level++;
+        }
+        return level;
+    }
+};
+
+#endif // OCTREE_OPTIONS_H
@@ -0,0 +1,1113 @@
+#ifndef OCTREE_OUT_OF_CORE_H
+#define OCTREE_OUT_OF_CORE_H
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <string>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <queue>
+#include <optional>
+#include <functional>
+#include "point.h"
+#include "octree_query.h"
+#include "morton_code.h"
+#include "octree_options.h"
+#include "vtk_writer.h"
+#include "octree_memory.h"
+#include "octree_traversal.h"
+#include "octree_geometry.h"
+#include "octree_aggregate.h"
+#include "octree_instrumentation.h"
+#include "octree_io.h"
+#include "page_cache.h"
+
+// Octree for point clouds larger than memory. buildStreaming() streams the input in
+// chunks, sorts every chunk by Morton code into a run file, merges the runs
+// and cuts the merged stream into leaves; the leaf points go to one file in
+// Morton order and only the node array stays in memory. Queries load leaf
+// pages on demand through an LRU cache bounded by the memory budget.
+// The leaves are the same cells the linear octree builds for the same input,
+// including oversized leaves for runs of one code; minCellSize is applied as
+// a depth limit rather than a cluster test.
+template <size_t LeafCapacity = 4096, int MaxDepth = MORTON_BITS_PER_AXIS>
+class BasicOctreeOutOfCore {
+public:
+    struct Node {
+        // Bounding box of the cell
+        Point min, max;
+        // Morton prefix of the cell (3 bits per level)
+        uint64_t key;
+        // Range [begin, end) of the cell's points in the file
+        uint64_t begin, end;
+        // Index of the first child in nodes; children are contiguous
+        uint32_t firstChild;
+        uint8_t level;
+        uint8_t childCount;
+        // Bit i is set if octant i has a child
+        uint8_t childMask;
+        // Count, coordinate sums and tight bounds of the cell's points
+        PointAggregate aggregate;
+
+        bool isLeaf() const { return childCount == 0; }
+
+        bool contains(const Point& p) const {
+            return p.x >= min.x && p.x <= max.x &&
+                   p.y >= min.y && p.y <= max.y &&
+                   p.z >= min.z && p.z <= max.z;
+        }
+
+        // The box tests of the queries use the tight bounds of the cell's
+        // points, which reject its empty parts
+        bool boxIntersects(const Point& queryMin, const Point& queryMax) const {
+            const Point& lo = aggregate.min;
+            const Point& hi = aggregate.max;
+            return !(hi.x < queryMin.x || lo.x > queryMax.x ||
+                     hi.y < queryMin.y || lo.y > queryMax.y ||
+                     hi.z < queryMin.z || lo.z > queryMax.z);
+        }
+
+        bool boxContainedIn(const Point& queryMin, const Point& queryMax) const {
+            const Point& lo = aggregate.min;
+            const Point& hi = aggregate.max;
+            return lo.x >= queryMin.x && hi.x <= queryMax.x &&
+                   lo.y >= queryMin.y && hi.y <= queryMax.y &&
+                   lo.z >= queryMin.z && hi.z <= queryMax.z;
+        }
+
+        // Squared distance from q to the tight bounds (0 if inside)
+        float boxDistanceSquared(const Point& q) const {
+            return ::boxDistanceSquared(q, aggregate.min, aggregate.max);
+        }
+    };
+
+    // A leaf's points, loaded from the file
+    using Page = std::vector<Point>;
+    using PagePtr = std::shared_ptr<const Page>;
+
+    // Root bounding box used to quantize the Morton codes
+    Point min, max;
+
+    // Flat node array, nodes[0] is the root; always resident
+    std::vector<Node> nodes;
+
+    // Subdivision limits
+    OctreeOptions options;
+
+    // Maximum points per leaf before subdivision
+    static constexpr size_t MAX_POINTS_PER_LEAF = LeafCapacity;
+    static constexpr int MAX_DEPTH = MaxDepth;
+    static_assert(MaxDepth <= MORTON_BITS_PER_AXIS, "One level per bit of each axis");
+
+    // Default bound on the memory used by build() buffers and cached pages
+    static constexpr size_t DEFAULT_MEMORY_BUDGET = size_t(256) << 20;
+
+    static constexpr OctreeOptions defaultOptions() {
+        return OctreeOptions{static_cast<uint32_t>(LeafCapacity), MaxDepth};
+    }
+
+    BasicOctreeOutOfCore(const Point& min, const Point& max)
+        : BasicOctreeOutOfCore(min, max, defaultOptions()) {}
+
+    BasicOctreeOutOfCore(const Point& min, const Point& max, const OctreeOptions& options,
+                         size_t memoryBudget = DEFAULT_MEMORY_BUDGET)
+        : min(min), max(max), options(options.clampedTo(MaxDepth)), memoryBudget(memoryBudget),
+          cache(new PageCache<Page>(memoryBudget)) {
+        nodes.push_back(makeNode(0, 0, 0, 0));
+    }
+
+    BasicOctreeOutOfCore(const BasicOctreeOutOfCore&) = delete;
+    BasicOctreeOutOfCore& operator=(const BasicOctreeOutOfCore&) = delete;
+
+    // Build the tree into filename from a chunked point source: source(out,
+    // maxCount) writes up to maxCount points to out and returns how many, 0
+    // at the end of the input. Run files are written next to filename and
+    // removed afterwards. Memory use stays within the budget apart from the
+    // node array.
+    template <typename Source>
+    bool buildStreaming(Source&& source, const std::string& filename) {
+        file.reset();
+        cache->clear();
+
+        // Pass 1: sorted runs of (code, point) records
+        std::vector<std::string> runFiles;
+        uint64_t outside = 0;
+        if (!writeRuns(source, filename, runFiles, outside)) {
+            removeFiles(runFiles);
+            return false;
+        }
+        if (outside > 0) {
+            std::cout << "Warning: " << outside << " points are outside node bounds" << std::endl;
+        }
+
+        // Pass 2: merge the runs into leaf pages and lay out the nodes
+        bool written = writeTree(runFiles, filename);
+        removeFiles(runFiles);
+        if (!written) {
+            std::cerr << "Error: Failed writing octree to " << filename << std::endl;
+            return false;
+        }
+        return open(filename);
+    }
+
+    // Build from points already in memory, through the same pipeline
+    bool build(const std::vector<Point>& input, const std::string& filename) {
+        size_t next = 0;
+        return buildStreaming([&](Point* out, size_t maxCount) {
+            size_t count = std::min(maxCount, input.size() - next);
+            std::copy(input.begin() + next, input.begin() + next + count, out);
+            next += count;
+            return count;
+        }, filename);
+    }
+
+    // Open a file written by build(). Only the header and the node array are
+    // read; leaf pages are read when queries reach them. The sections must
+    // fit the actual file and every node link must stay inside the arrays,
+    // so a truncated or corrupt file fails here rather than in a query.
+    bool open(const std::string& filename) {
+        auto pageFile = std::make_unique<PositionalFile>(filename);
+        OutOfCoreFileHeader header;
+        bool valid = pageFile->isOpen() && pageFile->readAt(0, &header, sizeof(header)) &&
+                     std::memcmp(header.magic, OutOfCoreFileHeader::MAGIC, sizeof(header.magic)) == 0 &&
+                     header.version == OutOfCoreFileHeader::VERSION &&
+                     header.endianTag == OutOfCoreFileHeader::ENDIAN_TAG &&
+                     header.headerSize == sizeof(OutOfCoreFileHeader) &&
+                     header.nodeSize == sizeof(Node) && header.pointSize == sizeof(Point) &&
+                     header.fileSize == pageFile->size() && header.nodeCount > 0 &&
+                     header.nodeCount <= UINT32_MAX &&
+                     header.hasValidSection(header.pointsOffset, header.pointCount, sizeof(Point)) &&
+                     header.hasValidSection(header.nodesOffset, header.nodeCount, sizeof(Node)) &&
+                     header.pointsOffset + header.pointCount * sizeof(Point) <= header.nodesOffset;
+        std::vector<Node> fileNodes;
+        if (valid) {
+            fileNodes.resize(static_cast<size_t>(header.nodeCount));
+            valid = pageFile->readAt(header.nodesOffset, fileNodes.data(), fileNodes.size() * sizeof(Node)) &&
+                    hasValidLinks(fileNodes, header.pointCount);
+        }
+        if (!valid) {
+            std::cerr << "Error: " << filename << " is not a compatible out-of-core octree file" << std::endl;
+            return false;
+        }
+
+        min = Point(header.min[0], header.min[1], header.min[2]);
+        max = Point(header.max[0], header.max[1], header.max[2]);
+        options = OctreeOptions{header.maxPointsPerLeaf, header.maxDepth};
+        nodes.swap(fileNodes);
+        pointsOffset = header.pointsOffset;
+        file = std::move(pageFile);
+        cache->clear();
+        return true;
+    }
+
+    bool contains(const Point& p) const {
+        return p.x >= min.x && p.x <= max.x &&
+               p.y >= min.y && p.y <= max.y &&
+               p.z >= min.z && p.z <= max.z;
+    }
+
+    const Node& root() const { return nodes[0]; }
+
+    // Bound on cached page bytes; pages in use by a query are kept alive
+    // until it finishes even if the cache evicts them
+    void setMemoryBudget(size_t bytes) {
+        memoryBudget = bytes;
+        cache->setBudget(bytes);
+    }
+
+    size_t getMemoryBudget() const { return memoryBudget; }
+
+    // Cache counters: resident page bytes, pages, hits and misses
+    size_t residentPageBytes() const { return cache->bytes(); }
+    size_t residentPages() const { return cache->pages(); }
+    uint64_t pageHits() const { return cache->hits(); }
+    uint64_t pageMisses() const { return cache->misses(); }
+
+    // Drop every cached page
+    void clearCache() { cache->clear(); }
+
+    // Points of leaf nodes[nodeIndex], from the cache or the file; nullptr if
+    // the page could not be read. A failed read is not cached, so a later
+    // query tries the file again. The visitor queries then return false,
+    // the others leave out the leaf's points.
+    PagePtr page(uint32_t nodeIndex) const {
+        const Node& node = nodes[nodeIndex];
+        return cache->get(nodeIndex, [&]() -> std::pair<PagePtr, size_t> {
+            auto loaded = std::make_shared<Page>(static_cast<size_t>(node.end - node.begin));
+            size_t bytes = loaded->size() * sizeof(Point);
+            if (bytes > 0 && (file == nullptr ||
+                              !file->readAt(pointsOffset + node.begin * sizeof(Point), loaded->data(), bytes))) {
+                std::cerr << "Error: Could not read octree page " << nodeIndex << std::endl;
+                return {nullptr, 0};
+            }
+            return {loaded, bytes + sizeof(Page)};
+        });
+    }
+
+    // Helper function to print the octree structure
+    void print() const {
+        printNode(0, 0);
+    }
+
+    // Collect all points in the octree
+    void collectAllPoints(std::vector<Point>& allPoints) const {
+        forEachPoint([&](const Point& p) { allPoints.push_back(p); });
+    }
+
+    // Collect all node bounding boxes for visualization
+    void collectNodeBoxes(std::vector<std::pair<Point, Point>>& boxes, std::vector<int>& levels) const {
+        for (const auto& node : nodes) {
+            boxes.push_back({node.min, node.max});
+            levels.push_back(node.level);
+        }
+    }
+
+    // Export octree to VTK format for ParaView visualization. Binary output is
+    // smaller and much faster to write; ASCII stays readable for debugging.
+    bool exportToVTK(const std::string& filename, VtkFormat format = VtkFormat::Ascii) const {
+        if (!writeOctreeVTK(*this, filename, "Out-of-Core Octree Visualization", format)) {
+            std::cerr << "Error: Could not write file " << filename << std::endl;
+            return false;
+        }
+        std::cout << "Out-of-core Octree exported to " << filename << std::endl;
+        std::cout << "Open this file in ParaView to visualize the octree structure!" << std::endl;
+        return true;
+    }
+
+    // Query methods
+    std::vector<Point> rangeQuery(const Point& queryMin, const Point& queryMax) const {
+        std::vector<Point> result;
+        rangeQuery(queryMin, queryMax, [&](const Point& p) { result.push_back(p); });
+        return result;
+    }
+
+    // Streams every point inside the box to visit(p) without allocating.
+    // A visitor returning bool can stop the query by returning false; the
+    // result is false if the query was stopped early.
+    template <typename Visitor>
+    bool rangeQuery(const Point& queryMin, const Point& queryMax, Visitor&& visit) const {
+        OCTREE_TRACE_SCOPE("rangeQuery");
+        TraversalStack<uint32_t, MaxDepth> stack;
+        stack.push(0);
+        while (!stack.empty()) {
+            uint32_t nodeIndex = stack.pop();
+            const Node& node = nodes[nodeIndex];
+            OCTREE_COUNT(NodesVisited, 1);
+
+            // Check if this node's bounding box intersects with query range
+            if (!node.boxIntersects(queryMin, queryMax)) {
+                OCTREE_COUNT(NodesPruned, 1);
+                continue;
+            }
+
+            // Whole cell inside the query: every page below it matches
+            if (node.boxContainedIn(queryMin, queryMax)) {
+                OCTREE_COUNT(SubtreesAccepted, 1);
+                OCTREE_COUNT(PointsMatched, node.aggregate.count);
+                if (!visitSubtree(nodeIndex, visit)) return false;
+                continue;
+            }
+
+            if (node.isLeaf()) {
+                PagePtr points = page(nodeIndex);
+                if (!points) return false;
+                OCTREE_COUNT(PointsTested, points->size());
+                for (const auto& p : *points) {
+                    if (p.x >= queryMin.x && p.x <= queryMax.x &&
+                        p.y >= queryMin.y && p.y <= queryMax.y &&
+                        p.z >= queryMin.z && p.z <= queryMax.z) {
+                        OCTREE_COUNT(PointsMatched, 1);
+                        if (!invokeVisitor(visit, p)) return false;
+                    }
+                }
+                continue;
+            }
+            pushChildren(node, stack);
+        }
+        return true;
+    }
+
+    // Number of points inside the box; contained cells are counted from
+    // their range without reading their pages
+    size_t countInRange(const Point& queryMin, const Point& queryMax) const {
+        size_t count = 0;
+        TraversalStack<uint32_t, MaxDepth> stack;
+        stack.push(0);
+        while (!stack.empty()) {
+            uint32_t nodeIndex = stack.pop();
+            const Node& node = nodes[nodeIndex];
+            if (!node.boxIntersects(queryMin, queryMax)) {
+                continue;
+            }
+            if (node.boxContainedIn(queryMin, queryMax)) {
+                count += static_cast<size_t>(node.end - node.begin);
+                continue;
+            }
+
+            if (node.isLeaf()) {
+                PagePtr points = page(nodeIndex);
+                if (!points) continue;
+                for (const auto& p : *points) {
+                    if (p.x >= queryMin.x && p.x <= queryMax.x &&
+                        p.y >= queryMin.y && p.y <= queryMax.y &&
+                        p.z >= queryMin.z && p.z <= queryMax.z) {
+                        count++;
+                    }
+                }
+                continue;
+            }
+            pushChildren(node, stack);
+        }
+        return count;
+    }
+
+    // True if at least one point lies inside the box; stops at the first hit
+    bool anyInRange(const Point& queryMin, const Point& queryMax) const {
+        return !rangeQuery(queryMin, queryMax, [](const Point&) { return false; });
+    }
+
+    // Aggregate of the points inside the box. Cells whose points all lie
+    // inside contribute their stored aggregate without being descended.
+    PointAggregate aggregateInRange(const Point& queryMin, const Point& queryMax) const {
+        PointAggregate result;
+        TraversalStack<uint32_t, MaxDepth> stack;
+        stack.push(0);
+        while (!stack.empty()) {
+            uint32_t nodeIndex = stack.pop();
+            const Node& node = nodes[nodeIndex];
+            if (!node.boxIntersects(queryMin, queryMax)) {
+                continue;
+            }
+            if (node.boxContainedIn(queryMin, queryMax)) {
+                result.merge(node.aggregate);
+                continue;
+            }
+
+            if (node.isLeaf()) {
+                PagePtr points = page(nodeIndex);
+                if (!points) continue;
+                for (const auto& p : *points) {
+                    if (p.x >= queryMin.x && p.x <= queryMax.x &&
+                        p.y >= queryMin.y && p.y <= queryMax.y &&
+                        p.z >= queryMin.z && p.z <= queryMax.z) {
+                        result.add(p);
+                    }
+                }
+                continue;
+            }
+            pushChildren(node, stack);
+        }
+        return result;
+    }
+
+    // Mean of the points inside the box, or nothing if there are none
+    std::optional<Point> centroidInRange(const Point& queryMin, const Point& queryMax) const {
+        PointAggregate result = aggregateInRange(queryMin, queryMax);
+        if (result.empty()) return std::nullopt;
+        return result.centroid();
+    }
+
+    // Points within radius of center (sphere query)
+    std::vector<Point> radiusQuery(const Point& center, float radius) const {
+        std::vector<Point> result;
+        radiusQuery(center, radius, [&](const Point& p) { result.push_back(p); });
+        return result;
+    }
+
+    // Visitor overload of radiusQuery, same contract as the rangeQuery one
+    template <typename Visitor>
+    bool radiusQuery(const Point& center, float radius, Visitor&& visit) const {
+        const float radiusSquared = radius * radius;
+        TraversalStack<uint32_t, MaxDepth> stack;
+        stack.push(0);
+        while (!stack.empty()) {
+            uint32_t nodeIndex = stack.pop();
+            const Node& node = nodes[nodeIndex];
+
+            // Skip cells that do not touch the sphere
+            if (node.boxDistanceSquared(center) > radiusSquared) {
+                continue;
+            }
+
+            // Whole cell inside the sphere: every page below it matches
+            if (::boxMaxDistanceSquared(center, node.aggregate.min, node.aggregate.max) <= radiusSquared) {
+                if (!visitSubtree(nodeIndex, visit)) return false;
+                continue;
+            }
+
+            if (node.isLeaf()) {
+                PagePtr points = page(nodeIndex);
+                if (!points) return false;
+                for (const auto& p : *points) {
+                    if (distanceSquared(p, center) <= radiusSquared) {
+                        if (!invokeVisitor(visit, p)) return false;
+                    }
+                }
+                continue;
+            }
+            pushChildren(node, stack);
+        }
+        return true;
+    }
+
+    // Points inside the view frustum
+    std::vector<Point> frustumQuery(const Frustum& frustum) const {
+        std::vector<Point> result;
+        frustumQuery(frustum, [&](const Point& p) { result.push_back(p); });
+        return result;
+    }
+
+    // Visitor overload of frustumQuery, same contract as the rangeQuery one
+    template <typename Visitor>
+    bool frustumQuery(const Frustum& frustum, Visitor&& visit) const {
+        TraversalStack<uint32_t, MaxDepth> stack;
+        stack.push(0);
+        while (!stack.empty()) {
+            uint32_t nodeIndex = stack.pop();
+            const Node& node = nodes[nodeIndex];
+            BoxRelation relation = frustum.classify(node.aggregate.min, node.aggregate.max);
+            if (relation == BoxRelation::Outside) {
+                continue;
+            }
+
+            // Whole cell inside the frustum: every page below it matches
+            if (relation == BoxRelation::Inside) {
+                if (!visitSubtree(nodeIndex, visit)) return false;
+                continue;
+            }
+
+            if (node.isLeaf()) {
+                PagePtr points = page(nodeIndex);
+                if (!points) return false;
+                for (const auto& p : *points) {
+                    if (frustum.contains(p)) {
+                        if (!invokeVisitor(visit, p)) return false;
+                    }
+                }
+                continue;
+            }
+            pushChildren(node, stack);
+        }
+        return true;
+    }
+
+    // Points within radius of the ray, cell by cell from front to back
+    std::vector<Point> rayQuery(const Ray& ray, float radius) const {
+        std::vector<Point> result;
+        rayQuery(ray, radius, [&](const Point& p) { result.push_back(p); });
+        return result;
+    }
+
+    // Visitor overload of rayQuery, same contract as the rangeQuery one.
+    // Cells come in the order the ray enters them, the points of one cell
+    // in Morton order.
+    template <typename Visitor>
+    bool rayQuery(const Ray& ray, float radius, Visitor&& visit) const {
+        const float cutoff = ray.maxDistance;
+        return rayTraverse(ray, radius, cutoff, [&](uint32_t nodeIndex) {
+            const Node& node = nodes[nodeIndex];
+            if (!node.isLeaf()) return true;
+            float t;
+            PagePtr points = page(nodeIndex);
+            if (!points) return false;
+            for (const auto& p : *points) {
+                if (ray.hits(p, radius, t) && !invokeVisitor(visit, p)) return false;
+            }
+            return true;
+        });
+    }
+
+    // First point along the ray within radius of it, or nothing. Cells the
+    // ray enters beyond the best hit so far are skipped, so the walk usually
+    // ends a few cells after the first hit.
+    std::optional<RayHit<Point>> raycast(const Ray& ray, float radius) const {
+        std::optional<RayHit<Point>> best;
+        float cutoff = ray.maxDistance;
+        rayTraverse(ray, radius, cutoff, [&](uint32_t nodeIndex) {
+            const Node& node = nodes[nodeIndex];
+            if (!node.isLeaf()) return true;
+            float t;
+            PagePtr points = page(nodeIndex);
+            if (!points) return true;
+            for (const auto& p : *points) {
+                if (ray.hits(p, radius, t) && (!best || t < best->distance)) {
+                    best = RayHit<Point>{p, t};
+                    cutoff = t;
+                }
+            }
+            return true;
+        });
+        return best;
+    }
+
+    // Calls visit(p) for every point in Morton order, same contract as rangeQuery
+    template <typename Visitor>
+    bool forEachPoint(Visitor&& visit) const {
+        return visitSubtree(0, visit);
+    }
+
+    // Calls visit(min, max, level) for every node, parents before children
+    template <typename Visitor>
+    void forEachNode(Visitor&& visit) const {
+        for (const auto& node : nodes) {
+            visit(node.min, node.max, node.level);
+        }
+    }
+
+    size_t pointCount() const { return static_cast<size_t>(nodes[0].end - nodes[0].begin); }
+
+    // The k points closest to q, closest first. Cells are visited best-first
+    // in order of their box distance to q; a leaf's page is only read when
+    // the leaf is closer than the current k-th neighbor.
+    std::vector<Point> knn(const Point& q, size_t k) const {
+        if (k == 0) return {};
+        OCTREE_TRACE_SCOPE("knn");
+        KnnCollector<Point> collector(k);
+
+        using Entry = std::pair<float, uint32_t>;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+        queue.push({nodes[0].boxDistanceSquared(q), 0});
+
+        while (!queue.empty()) {
+            auto [dist, nodeIndex] = queue.top();
+            queue.pop();
+            if (dist > collector.worstDistanceSquared()) break;
+
+            const Node& node = nodes[nodeIndex];
+            OCTREE_COUNT(NodesVisited, 1);
+            if (node.isLeaf()) {
+                PagePtr points = page(nodeIndex);
+                if (!points) continue;
+                OCTREE_COUNT(PointsTested, points->size());
+                for (const auto& p : *points) {
+                    collector.offer(p, distanceSquared(p, q));
+                }
+                continue;
+            }
+
+            for (uint32_t c = 0; c < node.childCount; ++c) {
+                float childDist = nodes[node.firstChild + c].boxDistanceSquared(q);
+                if (childDist <= collector.worstDistanceSquared()) {
+                    queue.push({childDist, node.firstChild + c});
+                }
+            }
+        }
+        return collector.sortedPoints();
+    }
+
+    // Closest point to q, or nothing if the tree is empty
+    std::optional<Point> nearest(const Point& q) const {
+        std::vector<Point> result = knn(q, 1);
+        if (result.empty()) return std::nullopt;
+        return result.front();
+    }
+
+    // Batched rangeQuery: result[i] holds the points inside
+    // [queryMins[i], queryMaxs[i]]. Queries run in Morton order of their
+    // box centers so that neighbouring queries share cached pages.
+    std::vector<std::vector<Point>> rangeQueryBatch(const std::vector<Point>& queryMins,
+                                                    const std::vector<Point>& queryMaxs) const {
+        size_t count = std::min(queryMins.size(), queryMaxs.size());
+        std::vector<Point> centers(count);
+        for (size_t i = 0; i < count; ++i) {
+            centers[i] = Point((queryMins[i].x + queryMaxs[i].x) * 0.5f,
+                               (queryMins[i].y + queryMaxs[i].y) * 0.5f,
+                               (queryMins[i].z + queryMaxs[i].z) * 0.5f);
+        }
+
+        std::vector<std::vector<Point>> results(count);
+        for (uint32_t i : mortonQueryOrder(centers, min, max)) {
+            std::vector<Point>& result = results[i];
+            rangeQuery(queryMins[i], queryMaxs[i], [&](const Point& p) { result.push_back(p); });
+        }
+        return results;
+    }
+
+    // Batched knn: result[i] holds the k points closest to queries[i], run in Morton order
+    std::vector<std::vector<Point>> knnBatch(const std::vector<Point>& queries, size_t k) const {
+        std::vector<std::vector<Point>> results(queries.size());
+        for (uint32_t i : mortonQueryOrder(queries, min, max)) {
+            results[i] = knn(queries[i], k);
+        }
+        return results;
+    }
+
+    // Get statistics about the octree
+    void getStatistics(int& totalNodes, int& leafNodes, int& totalPoints, int& maxDepth) const {
+        totalNodes = static_cast<int>(nodes.size());
+        totalPoints = static_cast<int>(pointCount());
+        for (const auto& node : nodes) {
+            if (node.isLeaf()) leafNodes++;
+            maxDepth = std::max(maxDepth, static_cast<int>(node.level));
+        }
+    }
+
+    // In-memory footprint: the node array plus the pages the cache holds.
+    // Resident page bytes count as point storage; the rest of the points
+    // stay on disk.
+    OctreeMemoryStats getMemoryStatistics() const {
+        OctreeMemoryStats stats;
+        stats.nodes = nodes.size();
+        stats.nodeStructBytes = sizeof(Node);
+        stats.points = pointCount();
+        stats.nodeBytes = nodes.capacity() * sizeof(Node);
+        addAllocation(stats, stats.nodeBytes);
+        // Each resident page is a shared vector: one block for the vector
+        // and its control block, one for the points
+        size_t pages = residentPages();
+        size_t pageHeaders = pages * sizeof(Page);
+        stats.pointBytes = std::max(residentPageBytes(), pageHeaders) - pageHeaders;
+        stats.auxiliaryBytes = pageHeaders;
+        for (size_t i = 0; i < pages; ++i) {
+            addAllocation(stats, sizeof(Page));
+            addAllocation(stats, stats.pointBytes / pages);
+        }
+        return stats;
+    }
+
+    void printStatistics() const {
+        int totalNodes = 0, leafNodes = 0, totalPoints = 0, maxDepth = 0;
+        getStatistics(totalNodes, leafNodes, totalPoints, maxDepth);
+
+        std::cout << "=== Out-of-Core Octree Statistics ===" << std::endl;
+        std::cout << "Total nodes: " << totalNodes << std::endl;
+        std::cout << "Leaf nodes: " << leafNodes << std::endl;
+        std::cout << "Internal nodes: " << (totalNodes - leafNodes) << std::endl;
+        std::cout << "Total points: " << totalPoints << std::endl;
+        std::cout << "Maximum depth: " << maxDepth << std::endl;
+        std::cout << "Average points per leaf: " << (leafNodes > 0 ? (float)totalPoints / leafNodes : 0) << std::endl;
+        printMemoryStatistics(getMemoryStatistics());
+        std::cout << "Resident pages: " << residentPages() << " (" << residentPageBytes() << " of "
+                  << memoryBudget << " bytes)" << std::endl;
+        std::cout << "Page hits / misses: " << pageHits() << " / " << pageMisses() << std::endl;
+        printInstrumentationStatistics();
+    }
+
+private:
+    // Front-to-back walk over the cells near the ray, see ::rayTraverse
+    template <typename VisitNode>
+    bool rayTraverse(const Ray& ray, float radius, const float& cutoff, VisitNode&& visitNode) const {
+        return ::rayTraverse<MaxDepth>(
+            ray, radius, cutoff, uint32_t(0),
+            [this](uint32_t nodeIndex) -> const Node& { return nodes[nodeIndex]; },
+            [this](uint32_t nodeIndex, RayChildOrder<uint32_t>& children) { pushChildren(nodes[nodeIndex], children); },
+            visitNode);
+    }
+
+    // Record of the external sort
+    struct SortRecord {
+        uint64_t code;
+        Point point;
+    };
+
+    // Buffered sequential reader of one sorted run
+    class RunReader {
+    public:
+        RunReader(const std::string& filename, size_t bufferRecords)
+            : file(std::fopen(filename.c_str(), "rb")), buffer(std::max<size_t>(bufferRecords, 1)) {}
+
+        ~RunReader() {
+            if (file != nullptr) std::fclose(file);
+        }
+
+        RunReader(const RunReader&) = delete;
+        RunReader& operator=(const RunReader&) = delete;
+
+        bool isOpen() const { return file != nullptr; }
+
+        bool next(SortRecord& record) {
+            if (position == filled) {
+                filled = file != nullptr ? std::fread(buffer.data(), sizeof(SortRecord), buffer.size(), file) : 0;
+                position = 0;
+                if (filled == 0) return false;
+            }
+            record = buffer[position++];
+            return true;
+        }
+
+    private:
+        std::FILE* file;
+        std::vector<SortRecord> buffer;
+        size_t position = 0;
+        size_t filled = 0;
+    };
+
+    // Bytes of build memory per point of a run: the chunk, its codes and
+    // order, the radix sort scratch and the record buffer
+    static constexpr size_t RUN_BYTES_PER_POINT = sizeof(Point) + 2 * (sizeof(uint64_t) + sizeof(uint32_t)) + sizeof(SortRecord);
+    static constexpr size_t MIN_RUN_POINTS = size_t(1) << 16;
+    static constexpr size_t WRITE_BATCH = size_t(1) << 14;
+
+    template <typename Source>
+    bool writeRuns(Source& source, const std::string& filename, std::vector<std::string>& runFiles, uint64_t& outside) {
+        const size_t runPoints = std::max(MIN_RUN_POINTS, memoryBudget / RUN_BYTES_PER_POINT);
+        std::vector<Point> chunk(runPoints);
+        std::vector<uint64_t> codes;
+        std::vector<uint32_t> order;
+        std::vector<SortRecord> records;
+
+        for (;;) {
+            size_t read = 0;
+            while (read < runPoints) {
+                size_t n = source(chunk.data() + read, runPoints - read);
+                if (n == 0) break;
+                read += n;
+            }
+            if (read == 0) return true;
+
+            codes.resize(read);
+            order.clear();
+            curveEncodePoints(SpaceFillingCurve::Morton, chunk.data(), read, min, max, codes.data());
+            for (size_t i = 0; i < read; ++i) {
+                if (!contains(chunk[i])) {
+                    outside++;
+                    continue;
+                }
+                codes[order.size()] = codes[i];
+                order.push_back(static_cast<uint32_t>(i));
+            }
+            codes.resize(order.size());
+            mortonRadixSort(codes, order);
+
+            runFiles.push_back(filename + ".run" + std::to_string(runFiles.size()));
+            AlignedFileWriter run(runFiles.back());
+            for (size_t i = 0; i < codes.size(); i += WRITE_BATCH) {
+                size_t last = std::min(codes.size(), i + WRITE_BATCH);
+                records.clear();
+                for (size_t j = i; j < last; ++j) {
+                    records.push_back(SortRecord{codes[j], chunk[order[j]]});
+                }
+                run.write(records.data(), records.size() * sizeof(SortRecord));
+            }
+            if (!run.close()) {
+                std::cerr << "Error: Could not write sort run " << runFiles.back() << std::endl;
+                return false;
+            }
+            if (read < runPoints) return true;
+        }
+    }
+
+    // Merge the runs and cut the sorted stream into leaves. A cell starting
+    // at the current point is a leaf if the point cap positions ahead lies
+    // outside it (so it holds at most cap points), it is at the depth limit,
+    // or it holds only points with the current point's code; otherwise its
+    // child holding the current point is tried. A lookahead window of
+    // cap + 1 records is all that is kept in memory.
+    bool writeTree(const std::vector<std::string>& runFiles, const std::string& filename) {
+        size_t bufferRecords = memoryBudget / 2 / std::max<size_t>(runFiles.size(), 1) / sizeof(SortRecord);
+        std::vector<std::unique_ptr<RunReader>> runs;
+        for (const auto& name : runFiles) {
+            runs.push_back(std::make_unique<RunReader>(name, std::max<size_t>(bufferRecords, 1024)));
+            if (!runs.back()->isOpen()) return false;
+        }
+
+        // Min-heap over the head record of every run; ties go to the earlier
+        // run, so equal codes keep their input order
+        using Head = std::pair<uint64_t, size_t>;
+        std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+        std::vector<SortRecord> current(runs.size());
+        for (size_t r = 0; r < runs.size(); ++r) {
+            if (runs[r]->next(current[r])) heads.push({current[r].code, r});
+        }
+        auto nextRecord = [&](SortRecord& record) {
+            if (heads.empty()) return false;
+            size_t r = heads.top().second;
+            heads.pop();
+            record = current[r];
+            if (runs[r]->next(current[r])) heads.push({current[r].code, r});
+            return true;
+        };
+
+        AlignedFileWriter out(filename);
+        if (!out.isOpen()) return false;
+        OutOfCoreFileHeader header = {};
+        out.write(&header, sizeof(header));
+        out.pad(OCTREE_FILE_ALIGNMENT);
+        header.pointsOffset = out.offset();
+
+        struct Leaf {
+            uint64_t key;
+            int level;
+            uint64_t begin, end;
+            PointAggregate aggregate;
+        };
+        std::vector<Leaf> leaves;
+        std::deque<SortRecord> window;
+        std::vector<Point> pending;
+        const size_t cap = options.maxPointsPerLeaf;
+        // Cells are split at fixed levels, so minCellSize is a depth limit
+        const int depthLimit = options.depthLimitFor(min, max);
+        bool exhausted = false;
+        auto fill = [&](size_t count) {
+            while (window.size() < count && !exhausted) {
+                SortRecord record;
+                if (nextRecord(record)) {
+                    window.push_back(record);
+                } else {
+                    exhausted = true;
+                }
+            }
+        };
+
+        uint64_t written = 0;
+        uint64_t previousCode = 0;
+        fill(cap + 1);
+        while (!window.empty()) {
+            uint64_t first = window.front().code;
+            // The largest cell starting at this point: one level below the
+            // deepest cell it shares with the previous leaf's last point
+            int level = leaves.empty() ? 0 : commonLevels(previousCode, first) + 1;
+            bool cluster = false;
+            while (level < depthLimit && window.size() > cap &&
+                   cellAt(window[cap].code, level) == cellAt(first, level)) {
+                // More than cap points share one code, and no level separates them
+                if (window[cap].code == first) {
+                    cluster = true;
+                    break;
+                }
+                level++;
+            }
+
+            uint64_t begin = written;
+            PointAggregate aggregate;
+            auto take = [&]() {
+                pending.push_back(window.front().point);
+                aggregate.add(window.front().point);
+                previousCode = window.front().code;
+                window.pop_front();
+                written++;
+                if (pending.size() == WRITE_BATCH) {
+                    out.write(pending.data(), pending.size() * sizeof(Point));
+                    pending.clear();
+                }
+            };
+            auto refill = [&]() {
+                if (window.empty()) fill(1);
+                return !window.empty();
+            };
+            if (cluster) {
+                // The cluster leaf is the largest cell holding only the run of
+                // equal codes, as in the linear octree. The run may be longer
+                // than the window, so it is written before the cell is known.
+                while (refill() && window.front().code == first) take();
+                if (!window.empty()) level = std::max(level, commonLevels(first, window.front().code) + 1);
+                level = std::min(level, depthLimit);
+            }
+
+            uint64_t cell = cellAt(first, level);
+            while (refill() && cellAt(window.front().code, level) == cell) take();
+            leaves.push_back(Leaf{cell, level, begin, written, aggregate});
+            fill(cap + 1);
+        }
+        out.write(pending.data(), pending.size() * sizeof(Point));
+        if (leaves.empty()) {
+            leaves.push_back(Leaf{0, 0, 0, 0, PointAggregate()});
+        }
+
+        // Internal nodes are the ancestors of the leaves, laid out breadth-first
+        std::vector<Node> tree;
+        struct Span { size_t first, last; };
+        std::vector<Span> spans;
+        tree.push_back(makeNode(0, 0, 0, written));
+        spans.push_back(Span{0, leaves.size()});
+        for (size_t current = 0; current < tree.size(); ++current) {
+            Span span = spans[current];
+            int level = tree[current].level;
+            if (span.last - span.first == 1 && leaves[span.first].level == level) {
+                tree[current].aggregate = leaves[span.first].aggregate;
+                continue;
+            }
+
+            uint32_t firstChild = static_cast<uint32_t>(tree.size());
+            uint8_t childCount = 0;
+            uint8_t childMask = 0;
+            for (size_t i = span.first; i < span.last;) {
+                uint64_t childKey = leaves[i].key >> (3 * (leaves[i].level - level - 1));
+                size_t j = i + 1;
+                while (j < span.last && (leaves[j].key >> (3 * (leaves[j].level - level - 1))) == childKey) {
+                    j++;
+                }
+                tree.push_back(makeNode(childKey, level + 1, leaves[i].begin, leaves[j - 1].end));
+                spans.push_back(Span{i, j});
+                childMask |= static_cast<uint8_t>(1u << (childKey & 7));
+                childCount++;
+                i = j;
+            }
+            tree[current].firstChild = firstChild;
+            tree[current].childCount = childCount;
+            tree[current].childMask = childMask;
+        }
+        // Children follow their parent, so a backward pass sees them first
+        for (size_t i = tree.size(); i-- > 0;) {
+            for (uint32_t c = 0; c < tree[i].childCount; ++c) {
+                tree[i].aggregate.merge(tree[tree[i].firstChild + c].aggregate);
+            }
+        }
+
+        out.pad(OCTREE_FILE_ALIGNMENT);
+        header.nodesOffset = out.offset();
+        out.write(tree.data(), tree.size() * sizeof(Node));
+        std::memcpy(header.magic, OutOfCoreFileHeader::MAGIC, sizeof(header.magic));
+        header.version = OutOfCoreFileHeader::VERSION;
+        header.endianTag = OutOfCoreFileHeader::ENDIAN_TAG;
+        header.headerSize = sizeof(OutOfCoreFileHeader);
+        header.nodeSize = sizeof(Node);
+        header.pointSize = sizeof(Point);
+        header.maxPointsPerLeaf = options.maxPointsPerLeaf;
+        header.maxDepth = options.maxDepth;
+        header.min[0] = min.x; header.min[1] = min.y; header.min[2] = min.z;
+        header.max[0] = max.x; header.max[1] = max.y; header.max[2] = max.z;
+        header.nodeCount = tree.size();
+        header.pointCount = written;
+        header.fileSize = out.offset();
+        out.writeAt(0, &header, sizeof(header));
+        return out.close();
+    }
+
+    // True if every node's point range lies within pointCount and its
+    // children within nodes, one level deeper and after the node itself. The
+    // levels then bound the depth of every walk by MaxDepth.
+    static bool hasValidLinks(const std::vector<Node>& nodes, uint64_t pointCount) {
+        if (nodes[0].level != 0) return false;
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            const Node& node = nodes[i];
+            if (node.level > MaxDepth || node.begin > node.end || node.end > pointCount || node.childCount > 8) {
+                return false;
+            }
+            if (node.childCount == 0) continue;
+            if (node.firstChild <= i || node.firstChild + uint64_t{node.childCount} > nodes.size()) return false;
+            for (uint32_t c = 0; c < node.childCount; ++c) {
+                if (nodes[node.firstChild + c].level != node.level + 1) return false;
+            }
+        }
+        return true;
+    }
+
+    // Cell of the given level that holds a code
+    static uint64_t cellAt(uint64_t code, int level) {
+        return code >> (3 * (MORTON_BITS_PER_AXIS - level));
+    }
+
+    // Number of leading levels two codes share
+    static int commonLevels(uint64_t a, uint64_t b) {
+        int level = 0;
+        while (level < MORTON_BITS_PER_AXIS && cellAt(a, level + 1) == cellAt(b, level + 1)) {
+            level++;
+        }
+        return level;
+    }
+
+    static void removeFiles(const std::vector<std::string>& files) {
+        for (const auto& name : files) {
+            std::remove(name.c_str());
+        }
+    }
+
+    template <typename Visitor>
+    bool visitSubtree(uint32_t root, Visitor& visit) const {
+        TraversalStack<uint32_t, MaxDepth> stack;
+        stack.push(root);
+        while (!stack.empty()) {
+            uint32_t nodeIndex = stack.pop();
+            const Node& node = nodes[nodeIndex];
+            if (node.isLeaf()) {
+                PagePtr points = page(nodeIndex);
+                if (!points) return false;
+                for (const auto& p : *points) {
+                    if (!invokeVisitor(visit, p)) return false;
+                }
+                continue;
+            }
+            pushChildren(node, stack);
+        }
+        return true;
+    }
+
+    // Push the children of node for a depth-first walk, last child first so
+    // that they pop in storage order. Siblings are contiguous, so the
+    // prefetch covers the whole block at once.
+    template <typename Stack>
+    void pushChildren(const Node& node, Stack& stack) const {
+        if (node.childCount == 0) return;
+        prefetchRead(&nodes[node.firstChild]);
+        prefetchRead(&nodes[node.firstChild + node.childCount - 1]);
+        for (uint32_t c = node.childCount; c > 0; --c) {
+            stack.push(node.firstChild + c - 1);
+        }
+    }
+
+    Node makeNode(uint64_t key, int level, uint64_t begin, uint64_t end) const {
+        Node node;
+        node.key = key;
+        node.level = static_cast<uint8_t>(level);
+        node.begin = begin;
+        node.end = end;
+        node.firstChild = 0;
+        node.childCount = 0;
+        node.childMask = 0;
+        calculateCellBounds(key, level, node.min, node.max);
+        return node;
+    }
+
+    // Derive the cell bounds from its Morton prefix and level. The bounds are
+    // rounded outwards so they always contain the points quantized into them.
+    void calculateCellBounds(uint64_t key, int level, Point& cellMin, Point& cellMax) const {
+        uint32_t cell[3];
+        mortonDecode(key, cell[0], cell[1], cell[2]);
+        const float rootMin[3] = {min.x, min.y, min.z};
+        const float rootMax[3] = {max.x, max.y, max.z};
+        float lo[3], hi[3];
+        uint32_t last = (1u << level) - 1;
+
+        for (int axis = 0; axis < 3; ++axis) {
+            double size = (static_cast<double>(rootMax[axis]) - rootMin[axis]) / static_cast<double>(1u << level);
+            double cellLo = rootMin[axis] + cell[axis] * size;
+            lo[axis] = (cell[axis] == 0) ? rootMin[axis] : roundDown(cellLo);
+            hi[axis] = (cell[axis] == last) ? rootMax[axis] : roundUp(cellLo + size);
+        }
+
+        cellMin = {lo[0], lo[1], lo[2]};
+        cellMax = {hi[0], hi[1], hi[2]};
+    }
+
+    static float roundDown(double v) {
+        float f = static_cast<float>(v);
+        return (f > v) ? std::nextafter(f, -HUGE_VALF) : f;
+    }
+
+    static float roundUp(double v) {
+        float f = static_cast<float>(v);
+        return (f < v) ? std::nextafter(f, HUGE_VALF) : f;
+    }
+
+    void printNode(uint32_t nodeIndex, int depth) const {
+        const Node& node = nodes[nodeIndex];
+        std::string indent(depth * 2, ' ');
+        std::cout << indent << "Node bounds: (" << node.min.x << "," << node.min.y << "," << node.min.z
+                  << ") to (" << node.max.x << "," << node.max.y << "," << node.max.z << ")" << std::endl;
+        std::cout << indent << "Points: " << (node.isLeaf() ? node.end - node.begin : 0) << std::endl;
+        std::cout << indent << "Active children: " << static_cast<int>(node.childCount) << std::endl;
+        std::cout << indent << "Morton key: 0x" << std::hex << node.key << std::dec
+                  << ", Depth: " << static_cast<int>(node.level) << std::endl;
+
+        for (uint32_t c = 0; c < node.childCount; ++c) {
+            printNode(node.firstChild + c, depth + 1);
+        }
+    }
+
+    size_t memoryBudget;
+    // Cache and file sit behind pointers so that const queries can use them
+    std::unique_ptr<PageCache<Page>> cache;
+    std::unique_ptr<PositionalFile> file;
+    uint64_t pointsOffset = 0;
+};
+
+// Convenience typedef for the out-of-core octree with default limits
+using OctreeOutOfCore = BasicOctreeOutOfCore<>;
+
+#endif // OCTREE_OUT_OF_CORE_H
@@ -0,0 +1,82 @@
+#ifndef OCTREE_QUERY_H
+#define OCTREE_QUERY_H
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+#include "point.h"
+#include "morton_code.h"
+
+// Calls visit(item) for a query visitor. Visitors may return bool, where
+// false asks the query to stop; the result is false if the query should stop.
+template <typename Visitor, typename T>
+inline bool invokeVisitor(Visitor& visit, const T& item) {
+    if constexpr (std::is_same_v<std::invoke_result_t<Visitor&, const T&>, bool>) {
+        return visit(item);
+    } else {
+        visit(item);
+        return true;
+    }
+}
+
+// Execution order for a batch of queries: indices sorted by the Morton code
+// of each query point relative to the tree bounds. Consecutive queries then
+// descend through mostly the same nodes, which stay hot in cache.
+inline std::vector<uint32_t> mortonQueryOrder(const std::vector<Point>& queryPoints, const Point& min, const Point& max) {
+    std::vector<uint64_t> codes(queryPoints.size());
+    curveEncodePoints(SpaceFillingCurve::Morton, queryPoints.data(), queryPoints.size(), min, max, codes.data());
+    std::vector<uint32_t> order(queryPoints.size());
+    for (uint32_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    mortonRadixSort(codes, order);
+    return order;
+}
+
+// Bounded max-heap holding the k closest points seen so far. The octrees
+// feed it from a best-first traversal and stop once the next node is
+// farther away than worstDistanceSquared(). PointType is the stored element.
+template <typename PointType = Point>
+class KnnCollector {
+public:
+    explicit KnnCollector(size_t k) : k(k) { heap.reserve(k); }
+
+    // Squared distance a candidate must beat to enter the result
+    float worstDistanceSquared() const {
+        return heap.size() < k ? std::numeric_limits<float>::infinity() : heap.front().first;
+    }
+
+    void offer(const PointType& p, float distSquared) {
+        if (heap.size() < k) {
+            heap.push_back({distSquared, p});
+            std::push_heap(heap.begin(), heap.end(), farther);
+        } else if (distSquared < heap.front().first) {
+            std::pop_heap(heap.begin(), heap.end(), farther);
+            heap.back() = {distSquared, p};
+            std::push_heap(heap.begin(), heap.end(), farther);
+        }
+    }
+
+    // The collected points, closest first
+    std::vector<PointType> sortedPoints() {
+        std::sort_heap(heap.begin(), heap.end(), farther);
+        std::vector<PointType> result;
+        result.reserve(heap.size());
+        for (const auto& entry : heap) {
+            result.push_back(entry.second);
+        }
+        return result;
+    }
+
+private:
+    static bool farther(const std::pair<float, PointType>& a, const std::pair<float, PointType>& b) {
+        return a.first < b.first;
+    }
+
+    size_t k;
+    std::vector<std::pair<float, PointType>> heap;
+};
+
+#endif // OCTREE_QUERY_H
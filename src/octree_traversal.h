@@ -0,0 +1,56 @@
+#ifndef OCTREE_TRAVERSAL_H
+#define OCTREE_TRAVERSAL_H
+
+#include <cstddef>
+#include "point.h"
+
+#if defined(_MSC_VER) && !defined(__clang__) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#endif
+
+// Building blocks of the iterative tree walks. Traversals keep their pending
+// nodes in a TraversalStack on the caller's stack frame instead of recursing,
+// so a walk costs no call per node and its memory is fixed by MaxDepth.
+
+// Fixed-capacity LIFO of pending traversal entries. A depth-first walk pops
+// one entry before pushing up to 8 children, so at most 7 entries per level
+// wait beside the path to the current node: 7 * depth + 8 bounds the stack.
+template <typename T, int MaxDepth>
+class TraversalStack {
+public:
+    static constexpr size_t CAPACITY = 7 * static_cast<size_t>(MaxDepth) + 8;
+
+    bool empty() const { return count == 0; }
+    void push(const T& entry) { entries[count++] = entry; }
+    T pop() { return entries[--count]; }
+
+private:
+    T entries[CAPACITY];
+    size_t count = 0;
+};
+
+// Midpoint of a box. Halving by a multiply gives the same float as dividing by 2.
+inline Point boxCenter(const Point& min, const Point& max) {
+    return Point((min.x + max.x) * 0.5f, (min.y + max.y) * 0.5f, (min.z + max.z) * 0.5f);
+}
+
+// Octant of p around center: bit 0 for x, 1 for y, 2 for z, set on the
+// upper side. Built from the comparison results, so it has no branches.
+inline int octantOf(const Point& p, const Point& center) {
+    return static_cast<int>(p.x > center.x) |
+           (static_cast<int>(p.y > center.y) << 1) |
+           (static_cast<int>(p.z > center.z) << 2);
+}
+
+// Starts loading *address into cache ahead of its use
+inline void prefetchRead(const void* address) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(address, 0, 3);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#else
+    (void)address;
+#endif
+}
+
+#endif // OCTREE_TRAVERSAL_H
@@ -0,0 +1,115 @@
+#ifndef PAGE_CACHE_H
+#define PAGE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+// Thread-safe least-recently-used cache of immutable pages. get() returns a
+// shared_ptr, so a page stays valid for as long as a caller holds it even if
+// the cache evicts it meanwhile; only the cache's own references count
+// against the byte budget. The loader runs outside the lock, so a miss never
+// blocks hits on other pages.
+template <typename Page>
+class PageCache {
+public:
+    using PagePtr = std::shared_ptr<const Page>;
+
+    explicit PageCache(size_t budgetBytes) : budget(budgetBytes) {}
+
+    PageCache(const PageCache&) = delete;
+    PageCache& operator=(const PageCache&) = delete;
+
+    // Page id from the cache, or from load() -> std::pair<PagePtr, size_t bytes> on a miss
+    template <typename Loader>
+    PagePtr get(uint64_t id, Loader&& load) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = index.find(id);
+            if (it != index.end()) {
+                hitCount++;
+                lru.splice(lru.begin(), lru, it->second);
+                return it->second->page;
+            }
+            missCount++;
+        }
+
+        std::pair<PagePtr, size_t> loaded = load();
+        if (!loaded.first) return nullptr;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        // Another thread may have loaded the same page meanwhile
+        auto it = index.find(id);
+        if (it != index.end()) {
+            lru.splice(lru.begin(), lru, it->second);
+            return it->second->page;
+        }
+        lru.push_front(Entry{id, loaded.first, loaded.second});
+        index[id] = lru.begin();
+        residentBytes += loaded.second;
+        // The page just added is kept even if it alone exceeds the budget
+        while (residentBytes > budget && lru.size() > 1) {
+            Entry& victim = lru.back();
+            residentBytes -= victim.bytes;
+            index.erase(victim.id);
+            lru.pop_back();
+        }
+        return loaded.first;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        lru.clear();
+        index.clear();
+        residentBytes = 0;
+    }
+
+    void setBudget(size_t budgetBytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        budget = budgetBytes;
+    }
+
+    size_t budgetBytes() const { return budget; }
+
+    size_t bytes() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return residentBytes;
+    }
+
+    size_t pages() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return lru.size();
+    }
+
+    uint64_t hits() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return hitCount;
+    }
+
+    uint64_t misses() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return missCount;
+    }
+
+private:
+    struct Entry {
+        uint64_t id;
+        PagePtr page;
+        size_t bytes;
+    };
+
+    size_t budget;
+    size_t residentBytes = 0;
+    uint64_t hitCount = 0;
+    uint64_t missCount = 0;
+    // Most recently used first
+    std::list<Entry> lru;
+    std::unordered_map<uint64_t, typename std::list<Entry>::iterator> index;
+    mutable std::mutex mutex;
+};
+
+#endif // PAGE_CACHE_H
@@ -1,11 +1,50 @@
 #ifndef POINT_H
 #define POINT_H
 
+#include <cstdint>
+
 struct Point { 
     float x, y, z; 
     
     Point() : x(0), y(0), z(0) {}
     Point(float x, float y, float z) : x(x), y(y), z(z) {}
+
+    bool operator==(const Point& other) const { return x == other.x && y == other.y && z == other.z; }
+    bool operator!=(const Point& other) const { return !(*this == other); }
 };
 
-#endif // POINT_H 
\ No newline at end of file
+// Point tagged with the index of the object it belongs to. Used as the
+// PointType of the pointer-based octrees so queries return indices directly.
+struct IndexedPoint : Point {
+    uint32_t index;
+
+    IndexedPoint() : index(0) {}
+    IndexedPoint(const Point& p, uint32_t index) : Point(p), index(index) {}
+    IndexedPoint(float x, float y, float z, uint32_t index) : Point(x, y, z), index(index) {}
+
+    bool operator==(const IndexedPoint& other) const { return Point::operator==(other) && index == other.index; }
+    bool operator!=(const IndexedPoint& other) const { return !(*this == other); }
+};
+
+inline float distanceSquared(const Point& a, const Point& b) {
+    float dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+    return dx * dx + dy * dy + dz * dz;
+}
+
+// Squared distance from p to the box [min, max] (0 if p is inside)
+inline float boxDistanceSquared(const Point& p, const Point& min, const Point& max) {
+    float dx = p.x < min.x ? min.x - p.x : (p.x > max.x ? p.x - max.x : 0.0f);
+    float dy = p.y < min.y ? min.y - p.y : (p.y > max.y ? p.y - max.y : 0.0f);
+    float dz = p.z < min.z ? min.z - p.z : (p.z > max.z ? p.z - max.z : 0.0f);
+    return dx * dx + dy * dy + dz * dz;
+}
+
+// Squared distance from p to the farthest corner of the box [min, max]
+inline float boxMaxDistanceSquared(const Point& p, const Point& min, const Point& max) {
+    float dx = p.x - min.x > max.x - p.x ? p.x - min.x : max.x - p.x;
+    float dy = p.y - min.y > max.y - p.y ? p.y - min.y : max.y - p.y;
+    float dz = p.z - min.z > max.z - p.z ? p.z - min.z : max.z - p.z;
+    return dx * dx + dy * dy + dz * dz;
+}
+
+#endif // POINT_H
@@ -0,0 +1,70 @@
+#ifndef POINT_GENERATORS_H
+#define POINT_GENERATORS_H
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include "point.h"
+
+// Synthetic point sets shared by the example program and the benchmark
+
+// Function to generate random points within bounds. A fixed seed makes
+// the set reproducible; by default every call draws a fresh one.
+inline std::vector<Point> generateRandomPoints(int numPoints, const Point& min, const Point& max,
+                                               unsigned seed = std::random_device{}()) {
+    std::vector<Point> points;
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> distX(min.x, max.x);
+    std::uniform_real_distribution<float> distY(min.y, max.y);
+    std::uniform_real_distribution<float> distZ(min.z, max.z);
+
+    points.reserve(numPoints);
+    for (int i = 0; i < numPoints; ++i) {
+        points.push_back({distX(gen), distY(gen), distZ(gen)});
+    }
+    return points;
+}
+
+// Function to generate points in a grid pattern
+inline std::vector<Point> generateGridPoints(int pointsPerSide, const Point& min, const Point& max) {
+    std::vector<Point> points;
+    float stepX = (max.x - min.x) / (pointsPerSide - 1);
+    float stepY = (max.y - min.y) / (pointsPerSide - 1);
+    float stepZ = (max.z - min.z) / (pointsPerSide - 1);
+
+    for (int x = 0; x < pointsPerSide; ++x) {
+        for (int y = 0; y < pointsPerSide; ++y) {
+            for (int z = 0; z < pointsPerSide; ++z) {
+                points.push_back({
+                    min.x + x * stepX,
+                    min.y + y * stepY,
+                    min.z + z * stepZ
+                });
+            }
+        }
+    }
+    return points;
+}
+
+// Function to generate points in a spiral pattern
+inline std::vector<Point> generateSpiralPoints(int numPoints, const Point& min, const Point& max) {
+    std::vector<Point> points;
+    float centerX = (min.x + max.x) / 2;
+    float centerY = (min.y + max.y) / 2;
+    float centerZ = (min.z + max.z) / 2;
+    float radius = std::min({max.x - min.x, max.y - min.y, max.z - min.z}) / 2;
+
+    for (int i = 0; i < numPoints; ++i) {
+        float t = i * 0.1f;
+        float r = radius * (1.0f - float(i) / numPoints);
+        points.push_back({
+            centerX + r * std::cos(t),
+            centerY + r * std::sin(t),
+            centerZ + t * 0.1f
+        });
+    }
+    return points;
+}
+
+#endif // POINT_GENERATORS_H
@@ -0,0 +1,78 @@
+#ifndef POINT_SOA_H
+#define POINT_SOA_H
+
+#include <cstddef>
+#include <new>
+#include <vector>
+#include "point.h"
+#include "array_view.h"
+
+// Allocator returning Alignment-byte aligned storage, so that SIMD kernels
+// can start every array on a cache line
+template <typename T, size_t Alignment = 64>
+class AlignedAllocator {
+public:
+    using value_type = T;
+
+    template <typename U>
+    struct rebind { using other = AlignedAllocator<U, Alignment>; };
+
+    AlignedAllocator() noexcept = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+
+    void deallocate(T* p, size_t) noexcept {
+        ::operator delete(p, std::align_val_t(Alignment));
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment>&) const noexcept { return false; }
+};
+
+// Structure-of-arrays copy of a point sequence: one aligned float array per
+// axis, the layout the leaf-scan kernels in simd_kernels.h read
+struct PointSoA {
+    std::vector<float, AlignedAllocator<float>> x, y, z;
+
+    size_t size() const { return x.size(); }
+
+    void clear() {
+        x.clear();
+        y.clear();
+        z.clear();
+    }
+
+    void resize(size_t n) {
+        x.resize(n);
+        y.resize(n);
+        z.resize(n);
+    }
+
+    void set(size_t i, const Point& p) {
+        x[i] = p.x;
+        y[i] = p.y;
+        z[i] = p.z;
+    }
+
+    Point operator[](size_t i) const { return Point(x[i], y[i], z[i]); }
+};
+
+// Read-only view of a PointSoA, or of x/y/z arrays stored elsewhere
+struct PointSoAView {
+    ArrayView<float> x, y, z;
+
+    PointSoAView() = default;
+    explicit PointSoAView(const PointSoA& soa) : x(soa.x), y(soa.y), z(soa.z) {}
+
+    size_t size() const { return x.size(); }
+
+    Point operator[](size_t i) const { return Point(x[i], y[i], z[i]); }
+};
+
+#endif // POINT_SOA_H
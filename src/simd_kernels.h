@@ -0,0 +1,229 @@
+#ifndef SIMD_KERNELS_H
+#define SIMD_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include "point.h"
+
+#if defined(__AVX512F__)
+#include <immintrin.h>
+#define OCTREE_SIMD_AVX512 1
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define OCTREE_SIMD_AVX2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define OCTREE_SIMD_NEON 1
+#endif
+
+// Leaf-scan kernels over structure-of-arrays coordinates (see point_soa.h).
+// Each block of SIMD_WIDTH points is tested without branches and yields a
+// bit mask of hits; the callers only branch on the mask. The instruction set
+// is chosen at compile time (-mavx2, -mavx512f or -march=native on x86,
+// NEON on AArch64), with a scalar fallback of the same shape.
+
+#if defined(OCTREE_SIMD_AVX512)
+static constexpr size_t SIMD_WIDTH = 16;
+static constexpr const char* SIMD_NAME = "AVX-512";
+#elif defined(OCTREE_SIMD_AVX2)
+static constexpr size_t SIMD_WIDTH = 8;
+static constexpr const char* SIMD_NAME = "AVX2";
+#elif defined(OCTREE_SIMD_NEON)
+static constexpr size_t SIMD_WIDTH = 4;
+static constexpr const char* SIMD_NAME = "NEON";
+#else
+static constexpr size_t SIMD_WIDTH = 8;
+static constexpr const char* SIMD_NAME = "scalar";
+#endif
+
+// Bit j is set if point j of the block lies inside [qmin, qmax]
+inline uint32_t simdBoxMask(const float* x, const float* y, const float* z,
+                            const Point& qmin, const Point& qmax) {
+#if defined(OCTREE_SIMD_AVX512)
+    __m512 px = _mm512_loadu_ps(x), py = _mm512_loadu_ps(y), pz = _mm512_loadu_ps(z);
+    __mmask16 m = _mm512_cmp_ps_mask(px, _mm512_set1_ps(qmin.x), _CMP_GE_OQ);
+    m = _mm512_mask_cmp_ps_mask(m, px, _mm512_set1_ps(qmax.x), _CMP_LE_OQ);
+    m = _mm512_mask_cmp_ps_mask(m, py, _mm512_set1_ps(qmin.y), _CMP_GE_OQ);
+    m = _mm512_mask_cmp_ps_mask(m, py, _mm512_set1_ps(qmax.y), _CMP_LE_OQ);
+    m = _mm512_mask_cmp_ps_mask(m, pz, _mm512_set1_ps(qmin.z), _CMP_GE_OQ);
+    m = _mm512_mask_cmp_ps_mask(m, pz, _mm512_set1_ps(qmax.z), _CMP_LE_OQ);
+    return static_cast<uint32_t>(m);
+#elif defined(OCTREE_SIMD_AVX2)
+    __m256 px = _mm256_loadu_ps(x), py = _mm256_loadu_ps(y), pz = _mm256_loadu_ps(z);
+    __m256 in = _mm256_and_ps(_mm256_cmp_ps(px, _mm256_set1_ps(qmin.x), _CMP_GE_OQ),
+                              _mm256_cmp_ps(px, _mm256_set1_ps(qmax.x), _CMP_LE_OQ));
+    in = _mm256_and_ps(in, _mm256_cmp_ps(py, _mm256_set1_ps(qmin.y), _CMP_GE_OQ));
+    in = _mm256_and_ps(in, _mm256_cmp_ps(py, _mm256_set1_ps(qmax.y), _CMP_LE_OQ));
+    in = _mm256_and_ps(in, _mm256_cmp_ps(pz, _mm256_set1_ps(qmin.z), _CMP_GE_OQ));
+    in = _mm256_and_ps(in, _mm256_cmp_ps(pz, _mm256_set1_ps(qmax.z), _CMP_LE_OQ));
+    return static_cast<uint32_t>(_mm256_movemask_ps(in));
+#elif defined(OCTREE_SIMD_NEON)
+    float32x4_t px = vld1q_f32(x), py = vld1q_f32(y), pz = vld1q_f32(z);
+    uint32x4_t in = vandq_u32(vcgeq_f32(px, vdupq_n_f32(qmin.x)), vcleq_f32(px, vdupq_n_f32(qmax.x)));
+    in = vandq_u32(in, vcgeq_f32(py, vdupq_n_f32(qmin.y)));
+    in = vandq_u32(in, vcleq_f32(py, vdupq_n_f32(qmax.y)));
+    in = vandq_u32(in, vcgeq_f32(pz, vdupq_n_f32(qmin.z)));
+    in = vandq_u32(in, vcleq_f32(pz, vdupq_n_f32(qmax.z)));
+    const uint32_t lanes[4] = {1, 2, 4, 8};
+    return vaddvq_u32(vandq_u32(in, vld1q_u32(lanes)));
+#else
+    uint32_t m = 0;
+    for (size_t j = 0; j < SIMD_WIDTH; ++j) {
+        bool in = (x[j] >= qmin.x) & (x[j] <= qmax.x) &
+                  (y[j] >= qmin.y) & (y[j] <= qmax.y) &
+                  (z[j] >= qmin.z) & (z[j] <= qmax.z);
+        m |= static_cast<uint32_t>(in) << j;
+    }
+    return m;
+#endif
+}
+
+// Squared distances from q to each point of the block
+inline void simdDistancesSquared(const float* x, const float* y, const float* z,
+                                 const Point& q, float* out) {
+#if defined(OCTREE_SIMD_AVX512)
+    __m512 dx = _mm512_sub_ps(_mm512_loadu_ps(x), _mm512_set1_ps(q.x));
+    __m512 dy = _mm512_sub_ps(_mm512_loadu_ps(y), _mm512_set1_ps(q.y));
+    __m512 dz = _mm512_sub_ps(_mm512_loadu_ps(z), _mm512_set1_ps(q.z));
+    _mm512_storeu_ps(out, _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)),
+                                        _mm512_mul_ps(dz, dz)));
+#elif defined(OCTREE_SIMD_AVX2)
+    __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x), _mm256_set1_ps(q.x));
+    __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y), _mm256_set1_ps(q.y));
+    __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(z), _mm256_set1_ps(q.z));
+    _mm256_storeu_ps(out, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+                                        _mm256_mul_ps(dz, dz)));
+#elif defined(OCTREE_SIMD_NEON)
+    float32x4_t dx = vsubq_f32(vld1q_f32(x), vdupq_n_f32(q.x));
+    float32x4_t dy = vsubq_f32(vld1q_f32(y), vdupq_n_f32(q.y));
+    float32x4_t dz = vsubq_f32(vld1q_f32(z), vdupq_n_f32(q.z));
+    vst1q_f32(out, vaddq_f32(vaddq_f32(vmulq_f32(dx, dx), vmulq_f32(dy, dy)), vmulq_f32(dz, dz)));
+#else
+    for (size_t j = 0; j < SIMD_WIDTH; ++j) {
+        float dx = x[j] - q.x, dy = y[j] - q.y, dz = z[j] - q.z;
+        out[j] = dx * dx + dy * dy + dz * dz;
+    }
+#endif
+}
+
+// Bit j is set if point j of the block is within sqrt(radiusSquared) of center
+inline uint32_t simdSphereMask(const float* x, const float* y, const float* z,
+                               const Point& center, float radiusSquared) {
+#if defined(OCTREE_SIMD_AVX512)
+    __m512 dx = _mm512_sub_ps(_mm512_loadu_ps(x), _mm512_set1_ps(center.x));
+    __m512 dy = _mm512_sub_ps(_mm512_loadu_ps(y), _mm512_set1_ps(center.y));
+    __m512 dz = _mm512_sub_ps(_mm512_loadu_ps(z), _mm512_set1_ps(center.z));
+    __m512 d2 = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)), _mm512_mul_ps(dz, dz));
+    return static_cast<uint32_t>(_mm512_cmp_ps_mask(d2, _mm512_set1_ps(radiusSquared), _CMP_LE_OQ));
+#elif defined(OCTREE_SIMD_AVX2)
+    __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x), _mm256_set1_ps(center.x));
+    __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y), _mm256_set1_ps(center.y));
+    __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(z), _mm256_set1_ps(center.z));
+    __m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+    return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(d2, _mm256_set1_ps(radiusSquared), _CMP_LE_OQ)));
+#elif defined(OCTREE_SIMD_NEON)
+    float d2[4];
+    simdDistancesSquared(x, y, z, center, d2);
+    uint32x4_t in = vcleq_f32(vld1q_f32(d2), vdupq_n_f32(radiusSquared));
+    const uint32_t lanes[4] = {1, 2, 4, 8};
+    return vaddvq_u32(vandq_u32(in, vld1q_u32(lanes)));
+#else
+    float d2[SIMD_WIDTH];
+    simdDistancesSquared(x, y, z, center, d2);
+    uint32_t m = 0;
+    for (size_t j = 0; j < SIMD_WIDTH; ++j) {
+        m |= static_cast<uint32_t>(d2[j] <= radiusSquared) << j;
+    }
+    return m;
+#endif
+}
+
+inline int simdLowestBit(uint32_t m) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward(&index, m);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctz(m);
+#endif
+}
+
+inline int simdPopcount(uint32_t m) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    return static_cast<int>(__popcnt(m));
+#else
+    return __builtin_popcount(m);
+#endif
+}
+
+// Calls emit(i) for every i in [begin, end) whose point lies inside
+// [qmin, qmax]. emit returns false to stop the scan; so does the result.
+template <typename Emit>
+inline bool simdScanBox(const float* x, const float* y, const float* z, size_t begin, size_t end,
+                        const Point& qmin, const Point& qmax, Emit&& emit) {
+    size_t i = begin;
+    for (; i + SIMD_WIDTH <= end; i += SIMD_WIDTH) {
+        for (uint32_t m = simdBoxMask(x + i, y + i, z + i, qmin, qmax); m != 0; m &= m - 1) {
+            if (!emit(i + simdLowestBit(m))) return false;
+        }
+    }
+    for (; i < end; ++i) {
+        if (x[i] >= qmin.x && x[i] <= qmax.x && y[i] >= qmin.y && y[i] <= qmax.y &&
+            z[i] >= qmin.z && z[i] <= qmax.z) {
+            if (!emit(i)) return false;
+        }
+    }
+    return true;
+}
+
+// Number of points in [begin, end) inside [qmin, qmax]
+inline size_t simdCountBox(const float* x, const float* y, const float* z, size_t begin, size_t end,
+                           const Point& qmin, const Point& qmax) {
+    size_t count = 0;
+    size_t i = begin;
+    for (; i + SIMD_WIDTH <= end; i += SIMD_WIDTH) {
+        count += simdPopcount(simdBoxMask(x + i, y + i, z + i, qmin, qmax));
+    }
+    for (; i < end; ++i) {
+        count += (x[i] >= qmin.x) & (x[i] <= qmax.x) & (y[i] >= qmin.y) & (y[i] <= qmax.y) &
+                 (z[i] >= qmin.z) & (z[i] <= qmax.z);
+    }
+    return count;
+}
+
+// Calls emit(i) for every i in [begin, end) within the sphere, same contract as simdScanBox
+template <typename Emit>
+inline bool simdScanSphere(const float* x, const float* y, const float* z, size_t begin, size_t end,
+                           const Point& center, float radiusSquared, Emit&& emit) {
+    size_t i = begin;
+    for (; i + SIMD_WIDTH <= end; i += SIMD_WIDTH) {
+        for (uint32_t m = simdSphereMask(x + i, y + i, z + i, center, radiusSquared); m != 0; m &= m - 1) {
+            if (!emit(i + simdLowestBit(m))) return false;
+        }
+    }
+    for (; i < end; ++i) {
+        if (distanceSquared(Point(x[i], y[i], z[i]), center) <= radiusSquared) {
+            if (!emit(i)) return false;
+        }
+    }
+    return true;
+}
+
+// Calls visit(i, d2) for every i in [begin, end) with its squared distance to q
+template <typename Visit>
+inline void simdScanDistances(const float* x, const float* y, const float* z, size_t begin, size_t end,
+                              const Point& q, Visit&& visit) {
+    float d2[SIMD_WIDTH];
+    size_t i = begin;
+    for (; i + SIMD_WIDTH <= end; i += SIMD_WIDTH) {
+        simdDistancesSquared(x + i, y + i, z + i, q, d2);
+        for (size_t j = 0; j < SIMD_WIDTH; ++j) {
+            visit(i + j, d2[j]);
+        }
+    }
+    for (; i < end; ++i) {
+        visit(i, distanceSquared(Point(x[i], y[i], z[i]), q));
+    }
+}
+
+#endif // SIMD_KERNELS_H
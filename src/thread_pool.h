@@ -0,0 +1,119 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <cstddef>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads fed from a single FIFO queue. Tasks must
+// not block on other tasks of the same pool; the parallel builds split their
+// work so that only the calling thread ever waits.
+class ThreadPool {
+public:
+    // threadCount == 0 uses one worker per hardware thread
+    explicit ThreadPool(size_t threadCount = 0) {
+        if (threadCount == 0) {
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
+        workers.reserve(threadCount);
+        for (size_t i = 0; i < threadCount; ++i) {
+            workers.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers.size(); }
+
+    // Queue a task; the future becomes ready when it has run and rethrows its exception
+    template <typename F>
+    std::future<void> submit(F&& task) {
+        auto packaged = std::make_shared<std::packaged_task<void()>>(std::forward<F>(task));
+        std::future<void> result = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.emplace_back([packaged] { (*packaged)(); });
+        }
+        wakeup.notify_one();
+        return result;
+    }
+
+private:
+    void workerLoop() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeup.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty()) return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool stopping = false;
+};
+
+// Calls body(begin, end) over [0, count) in chunks of at most grain indices.
+// Workers pull chunks from a shared counter, so uneven chunks balance out.
+// Returns when every chunk is done.
+template <typename Body>
+void parallelFor(ThreadPool& pool, size_t count, size_t grain, Body&& body) {
+    if (count == 0) return;
+    grain = std::max<size_t>(grain, 1);
+    size_t chunks = (count + grain - 1) / grain;
+    if (pool.size() <= 1 || chunks == 1) {
+        body(size_t(0), count);
+        return;
+    }
+
+    std::atomic<size_t> next{0};
+    auto worker = [&] {
+        for (;;) {
+            size_t begin = next.fetch_add(grain);
+            if (begin >= count) return;
+            body(begin, std::min(begin + grain, count));
+        }
+    };
+
+    std::vector<std::future<void>> done;
+    size_t workerCount = std::min(pool.size(), chunks);
+    done.reserve(workerCount);
+    for (size_t i = 0; i < workerCount; ++i) {
+        done.push_back(pool.submit(worker));
+    }
+    // Wait for every worker before rethrowing: they reference this frame
+    for (auto& f : done) {
+        f.wait();
+    }
+    for (auto& f : done) {
+        f.get();
+    }
+}
+
+#endif // THREAD_POOL_H
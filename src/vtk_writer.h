@@ -0,0 +1,248 @@
+#ifndef VTK_WRITER_H
+#define VTK_WRITER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "point.h"
+
+enum class VtkFormat { Ascii, Binary };
+
+// Buffered writer for legacy VTK files. Values are appended to a large
+// buffer and flushed in big writes. Binary data is stored big-endian as the
+// legacy format requires; ASCII values in a row are separated by spaces.
+class VtkStreamWriter {
+public:
+    VtkStreamWriter(const std::string& filename, VtkFormat format, size_t bufferSize = size_t(1) << 20)
+        : file(std::fopen(filename.c_str(), "wb")), format(format) {
+        buffer.reserve(bufferSize);
+    }
+
+    ~VtkStreamWriter() { close(); }
+
+    VtkStreamWriter(const VtkStreamWriter&) = delete;
+    VtkStreamWriter& operator=(const VtkStreamWriter&) = delete;
+
+    bool isOpen() const { return file != nullptr; }
+    bool ok() const { return file != nullptr && good; }
+    VtkFormat getFormat() const { return format; }
+
+    // Section headers and keywords, written verbatim in both formats
+    void text(const char* s) { append(s, std::strlen(s)); }
+
+    void text(const std::string& s) { append(s.data(), s.size()); }
+
+    void value(float v) {
+        if (format == VtkFormat::Binary) {
+            uint32_t bits;
+            std::memcpy(&bits, &v, sizeof(bits));
+            appendBigEndian(bits);
+        } else {
+            char digits[32];
+            int n = std::snprintf(digits, sizeof(digits), "%.6f", v);
+            appendAscii(digits, n);
+        }
+    }
+
+    void value(int32_t v) {
+        if (format == VtkFormat::Binary) {
+            appendBigEndian(static_cast<uint32_t>(v));
+        } else {
+            char digits[16];
+            int n = std::snprintf(digits, sizeof(digits), "%d", v);
+            appendAscii(digits, n);
+        }
+    }
+
+    void value(const Point& p) {
+        value(p.x);
+        value(p.y);
+        value(p.z);
+    }
+
+    // End of a row of values; ASCII only
+    void endRow() {
+        if (format == VtkFormat::Ascii) {
+            append("\n", 1);
+        }
+        rowStart = true;
+    }
+
+    // End of a data section: binary data must be followed by a newline
+    void endSection() {
+        if (format == VtkFormat::Binary) {
+            append("\n", 1);
+        }
+        rowStart = true;
+    }
+
+    void flush() {
+        if (!buffer.empty()) {
+            if (ok()) good = std::fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+            buffer.clear();
+        }
+    }
+
+    // Flush and close; false if anything failed
+    bool close() {
+        if (file == nullptr) return false;
+        flush();
+        good = (std::fclose(file) == 0) && good;
+        file = nullptr;
+        return good;
+    }
+
+private:
+    void append(const char* data, size_t size) {
+        if (buffer.size() + size > buffer.capacity()) {
+            flush();
+        }
+        buffer.insert(buffer.end(), data, data + size);
+    }
+
+    void appendAscii(const char* digits, int n) {
+        if (!rowStart) {
+            append(" ", 1);
+        }
+        append(digits, static_cast<size_t>(n));
+        rowStart = false;
+    }
+
+    void appendBigEndian(uint32_t v) {
+        char bytes[4] = {
+            static_cast<char>(v >> 24), static_cast<char>(v >> 16),
+            static_cast<char>(v >> 8), static_cast<char>(v)
+        };
+        append(bytes, 4);
+    }
+
+    std::FILE* file;
+    VtkFormat format;
+    std::vector<char> buffer;
+    bool rowStart = true;
+    bool good = true;
+};
+
+// Writes an octree as a legacy VTK unstructured grid: one VTK_VERTEX per
+// stored point and one VTK_HEXAHEDRON per node, with an OctreeLevel cell
+// scalar (-1 for points). Box corners shared between nodes are written once.
+// Tree must provide forEachPoint(visit(p)) and forEachNode(visit(min, max, level)).
+// The tree is traversed several times instead of being copied; only the
+// unique corners are kept in memory. False if the file could not be written.
+template <typename Tree>
+bool writeOctreeVTK(const Tree& tree, const std::string& filename, const std::string& title, VtkFormat format) {
+    VtkStreamWriter out(filename, format);
+    if (!out.isOpen()) {
+        return false;
+    }
+
+    // Corner coordinates are keyed by their bit patterns; siblings derive
+    // shared faces from the same center value, so equal corners compare equal
+    struct CornerKey {
+        uint32_t x, y, z;
+        bool operator==(const CornerKey& other) const { return x == other.x && y == other.y && z == other.z; }
+    };
+    struct CornerHash {
+        size_t operator()(const CornerKey& k) const {
+            uint64_t h = k.x * 0x9E3779B97F4A7C15ULL;
+            h ^= (h >> 29) + k.y * 0xBF58476D1CE4E5B9ULL;
+            h ^= (h >> 31) + k.z * 0x94D049BB133111EBULL;
+            return static_cast<size_t>(h ^ (h >> 32));
+        }
+    };
+    auto keyOf = [](float x, float y, float z) {
+        CornerKey key;
+        // Adding 0 folds -0.0 into +0.0
+        x += 0.0f;
+        y += 0.0f;
+        z += 0.0f;
+        std::memcpy(&key.x, &x, 4);
+        std::memcpy(&key.y, &y, 4);
+        std::memcpy(&key.z, &z, 4);
+        return key;
+    };
+    auto cornerOf = [](const Point& min, const Point& max, int corner) {
+        // VTK_HEXAHEDRON order: bottom face counter-clockwise, then top face
+        static const int xs[8] = {0, 1, 1, 0, 0, 1, 1, 0};
+        static const int ys[8] = {0, 0, 1, 1, 0, 0, 1, 1};
+        return Point(xs[corner] ? max.x : min.x, ys[corner] ? max.y : min.y, corner >= 4 ? max.z : min.z);
+    };
+
+    // Pass 1: number the unique corners and count nodes and points
+    std::unordered_map<CornerKey, uint32_t, CornerHash> cornerIndex;
+    std::vector<Point> corners;
+    size_t nodeCount = 0;
+    tree.forEachNode([&](const Point& min, const Point& max, int) {
+        nodeCount++;
+        for (int c = 0; c < 8; ++c) {
+            Point corner = cornerOf(min, max, c);
+            if (cornerIndex.emplace(keyOf(corner.x, corner.y, corner.z), static_cast<uint32_t>(corners.size())).second) {
+                corners.push_back(corner);
+            }
+        }
+    });
+    size_t pointCount = 0;
+    tree.forEachPoint([&](const Point&) { pointCount++; });
+
+    out.text("# vtk DataFile Version 3.0\n");
+    out.text(title + "\n");
+    out.text(format == VtkFormat::Binary ? "BINARY\n" : "ASCII\n");
+    out.text("DATASET UNSTRUCTURED_GRID\n\n");
+
+    // Stored points, then the unique box corners
+    out.text("POINTS " + std::to_string(pointCount + corners.size()) + " float\n");
+    tree.forEachPoint([&](const Point& p) {
+        out.value(p);
+        out.endRow();
+    });
+    for (const Point& corner : corners) {
+        out.value(corner);
+        out.endRow();
+    }
+    out.endSection();
+
+    size_t cellCount = pointCount + nodeCount;
+    out.text("\nCELLS " + std::to_string(cellCount) + " " + std::to_string(pointCount * 2 + nodeCount * 9) + "\n");
+    for (size_t i = 0; i < pointCount; ++i) {
+        out.value(int32_t(1));
+        out.value(static_cast<int32_t>(i));
+        out.endRow();
+    }
+    tree.forEachNode([&](const Point& min, const Point& max, int) {
+        out.value(int32_t(8));
+        for (int c = 0; c < 8; ++c) {
+            Point corner = cornerOf(min, max, c);
+            out.value(static_cast<int32_t>(pointCount + cornerIndex[keyOf(corner.x, corner.y, corner.z)]));
+        }
+        out.endRow();
+    });
+    out.endSection();
+
+    // VTK_VERTEX = 1, VTK_HEXAHEDRON = 12
+    out.text("\nCELL_TYPES " + std::to_string(cellCount) + "\n");
+    for (size_t i = 0; i < cellCount; ++i) {
+        out.value(int32_t(i < pointCount ? 1 : 12));
+        out.endRow();
+    }
+    out.endSection();
+
+    // Octree levels for coloring; points are at level -1
+    out.text("\nCELL_DATA " + std::to_string(cellCount) + "\n");
+    out.text("SCALARS OctreeLevel int 1\n");
+    out.text("LOOKUP_TABLE default\n");
+    for (size_t i = 0; i < pointCount; ++i) {
+        out.value(int32_t(-1));
+        out.endRow();
+    }
+    tree.forEachNode([&](const Point&, const Point&, int level) {
+        out.value(static_cast<int32_t>(level));
+        out.endRow();
+    });
+    out.endSection();
+    return out.close();
+}
+
+#endif // VTK_WRITER_H
@@ -0,0 +1,146 @@
+#include <atomic>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+#include "octree_concurrent.h"
+
+// A leaf that overflowed as a cluster must split again once points outside
+// the cluster reach its cell, instead of chaining every later point.
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const char* what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+size_t bruteCount(const std::vector<Point>& points, const Point& queryMin, const Point& queryMax) {
+    size_t count = 0;
+    for (const Point& p : points) {
+        if (p.x >= queryMin.x && p.x <= queryMax.x && p.y >= queryMin.y && p.y <= queryMax.y &&
+            p.z >= queryMin.z && p.z <= queryMax.z) {
+            count++;
+        }
+    }
+    return count;
+}
+
+void checkQueries(const OctreeConcurrent& tree, const std::vector<Point>& points, std::mt19937& rng) {
+    check(tree.size() == points.size(), "size matches the inserted points");
+    std::uniform_real_distribution<float> coord(0.0f, 1.0f);
+    for (int i = 0; i < 200; ++i) {
+        Point queryMin(coord(rng) * 0.9f, coord(rng) * 0.9f, coord(rng) * 0.9f);
+        Point queryMax(queryMin.x + 0.1f, queryMin.y + 0.1f, queryMin.z + 0.1f);
+        if (tree.countInRange(queryMin, queryMax) != bruteCount(points, queryMin, queryMax)) {
+            check(false, "range count matches brute force");
+            return;
+        }
+    }
+    check(tree.countInRange(Point(0, 0, 0), Point(1, 1, 1)) == points.size(), "every point is found");
+}
+
+// Cluster of coincident points, then uniform points over the whole cell
+void clusterThenUniform() {
+    OctreeConcurrent tree(Point(0, 0, 0), Point(1, 1, 1));
+    std::vector<Point> points(17, Point(0.3f, 0.3f, 0.3f));
+    for (const Point& p : points) tree.insert(p);
+
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> coord(0.0f, 1.0f);
+    for (int i = 0; i < 40000; ++i) {
+        points.emplace_back(coord(rng), coord(rng), coord(rng));
+        tree.insert(points.back());
+    }
+
+    int totalNodes = 0, leafNodes = 0, totalPoints = 0, maxDepth = 0;
+    tree.getStatistics(totalNodes, leafNodes, totalPoints, maxDepth);
+    check(leafNodes > 1000, "uniform points after a cluster are spread over many leaves");
+    checkQueries(tree, points, rng);
+}
+
+// Cluster, then a few distinct points that stay in its cell for several levels
+void clusterThenNeighbours() {
+    OctreeConcurrent tree(Point(0, 0, 0), Point(1, 1, 1));
+    std::vector<Point> points(40, Point(0.1f, 0.1f, 0.1f));
+    for (const Point& p : points) tree.insert(p);
+    for (int i = 0; i < 5; ++i) {
+        points.emplace_back(0.1f + 0.001f * (i + 1), 0.1f, 0.1f);
+        tree.insert(points.back());
+    }
+
+    int totalNodes = 0, leafNodes = 0, totalPoints = 0, maxDepth = 0;
+    tree.getStatistics(totalNodes, leafNodes, totalPoints, maxDepth);
+    check(maxDepth > 1, "the cluster leaf splits for distinct points in its cell");
+    check(totalPoints == static_cast<int>(points.size()), "statistics count every point");
+
+    std::mt19937 rng(11);
+    checkQueries(tree, points, rng);
+    check(tree.countInRange(Point(0.1f, 0.1f, 0.1f), Point(0.1f, 0.1f, 0.1f)) == 40, "the cluster stays whole");
+}
+
+// With minCellSize a jittered cluster overflows, then distinct points split it
+void jitteredClusterThenNeighbours() {
+    OctreeConcurrent tree(Point(0, 0, 0), Point(1, 1, 1), OctreeOptions{16, 20, 0.01f});
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> jitter(0.0f, 0.005f);
+    std::vector<Point> points;
+    for (int i = 0; i < 100; ++i) {
+        points.emplace_back(0.6f + jitter(rng), 0.6f + jitter(rng), 0.6f + jitter(rng));
+        tree.insert(points.back());
+    }
+    std::uniform_real_distribution<float> coord(0.5f, 1.0f);
+    for (int i = 0; i < 2000; ++i) {
+        points.emplace_back(coord(rng), coord(rng), coord(rng));
+        tree.insert(points.back());
+    }
+
+    int totalNodes = 0, leafNodes = 0, totalPoints = 0, maxDepth = 0;
+    tree.getStatistics(totalNodes, leafNodes, totalPoints, maxDepth);
+    check(leafNodes > 100, "points after a jittered cluster are spread over many leaves");
+    checkQueries(tree, points, rng);
+}
+
+// Readers keep querying while the writer splits overflowed cluster leaves
+void concurrentReaders() {
+    OctreeConcurrent tree(Point(0, 0, 0), Point(1, 1, 1));
+    std::atomic<bool> done{false};
+    std::atomic<bool> shrank{false};
+    std::thread reader([&] {
+        size_t last = 0;
+        while (!done.load()) {
+            size_t count = tree.countInRange(Point(0, 0, 0), Point(1, 1, 1));
+            if (count < last) shrank = true;
+            last = count;
+        }
+    });
+
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> coord(0.0f, 1.0f);
+    for (int round = 0; round < 50; ++round) {
+        Point anchor(coord(rng), coord(rng), coord(rng));
+        for (int i = 0; i < 40; ++i) tree.insert(anchor);
+        for (int i = 0; i < 200; ++i) tree.insert(Point(coord(rng), coord(rng), coord(rng)));
+    }
+    done = true;
+    reader.join();
+
+    check(!shrank.load(), "readers never see points disappear during splits");
+    check(tree.countInRange(Point(0, 0, 0), Point(1, 1, 1)) == 50 * 240, "every point is found after the inserts");
+}
+
+}  // namespace
+
+int main() {
+    clusterThenUniform();
+    clusterThenNeighbours();
+    jitteredClusterThenNeighbours();
+    concurrentReaders();
+    if (failures > 0) return 1;
+    std::cout << "concurrent_cluster_test passed" << std::endl;
+    return 0;
+}